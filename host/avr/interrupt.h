@@ -0,0 +1,105 @@
+/*
+ * avr/interrupt.h (host)
+ *
+ *  Created on: October 15, 2026
+ *  ISR() defines an ordinary function that sim.c calls when it raises the
+ *  interrupt. cli() and sei() clear and set the I bit in the simulated
+ *  SREG, which sim.c consults before dispatching anything.
+ */
+
+/*
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+*/
+
+#ifndef HOST_AVR_INTERRUPT_H_
+#define HOST_AVR_INTERRUPT_H_
+
+#include <avr/io.h>
+
+// Vector numbers, in hardware priority order (lowest number wins)
+#define SIM_INT0		1
+#define SIM_INT1		2
+#define SIM_INT2		3
+#define SIM_TIMER2_COMP		4
+#define SIM_TIMER2_OVF		5
+#define SIM_TIMER1_CAPT		6
+#define SIM_TIMER1_COMPA	7
+#define SIM_TIMER1_COMPB	8
+#define SIM_TIMER1_OVF		9
+#define SIM_TIMER0_COMP		10
+#define SIM_TIMER0_OVF		11
+#define SIM_SPI_STC		12
+#define SIM_USART_RXC		13
+#define SIM_USART_UDRE		14
+#define SIM_USART_TXC		15
+#define SIM_ADC			16
+#define SIM_EE_RDY		17
+#define SIM_ANA_COMP		18
+#define SIM_TWI			19
+#define SIM_SPM_RDY		20
+#define SIM_VECTORS		21
+
+#define INT0_vect		sim_INT0_vect
+#define INT1_vect		sim_INT1_vect
+#define INT2_vect		sim_INT2_vect
+#define TIMER2_COMP_vect	sim_TIMER2_COMP_vect
+#define TIMER2_OVF_vect		sim_TIMER2_OVF_vect
+#define TIMER1_CAPT_vect	sim_TIMER1_CAPT_vect
+#define TIMER1_COMPA_vect	sim_TIMER1_COMPA_vect
+#define TIMER1_COMPB_vect	sim_TIMER1_COMPB_vect
+#define TIMER1_OVF_vect		sim_TIMER1_OVF_vect
+#define TIMER0_COMP_vect	sim_TIMER0_COMP_vect
+#define TIMER0_OVF_vect		sim_TIMER0_OVF_vect
+#define SPI_STC_vect		sim_SPI_STC_vect
+#define USART_RXC_vect		sim_USART_RXC_vect
+#define USART_UDRE_vect		sim_USART_UDRE_vect
+#define USART_TXC_vect		sim_USART_TXC_vect
+#define ADC_vect		sim_ADC_vect
+#define EE_RDY_vect		sim_EE_RDY_vect
+#define ANA_COMP_vect		sim_ANA_COMP_vect
+#define TWI_vect		sim_TWI_vect
+#define SPM_RDY_vect		sim_SPM_RDY_vect
+
+void sim_INT0_vect(void);
+void sim_INT1_vect(void);
+void sim_INT2_vect(void);
+void sim_TIMER2_COMP_vect(void);
+void sim_TIMER2_OVF_vect(void);
+void sim_TIMER1_CAPT_vect(void);
+void sim_TIMER1_COMPA_vect(void);
+void sim_TIMER1_COMPB_vect(void);
+void sim_TIMER1_OVF_vect(void);
+void sim_TIMER0_COMP_vect(void);
+void sim_TIMER0_OVF_vect(void);
+void sim_SPI_STC_vect(void);
+void sim_USART_RXC_vect(void);
+void sim_USART_UDRE_vect(void);
+void sim_USART_TXC_vect(void);
+void sim_ADC_vect(void);
+void sim_EE_RDY_vect(void);
+void sim_ANA_COMP_vect(void);
+void sim_TWI_vect(void);
+void sim_SPM_RDY_vect(void);
+
+#define ISR(vector, ...) void vector(void)
+
+#define cli() (SREG &= ~(1 << SREG_I))
+#define sei() (SREG |= (1 << SREG_I))
+
+#endif /* HOST_AVR_INTERRUPT_H_ */
@@ -0,0 +1,227 @@
+/*
+ * avr/io.h (host)
+ *
+ *  Created on: October 15, 2026
+ *  Register map of the ATmega32A for building the firmware on Linux. Every
+ *  register is a byte in the simulated data space sim_io, at the same data
+ *  memory address the real part uses, so sim.c can play the peripherals
+ *  by reading and writing the same locations the firmware does.
+ */
+
+/*
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+*/
+
+#ifndef HOST_AVR_IO_H_
+#define HOST_AVR_IO_H_
+
+#include <stdint.h>
+
+#if !defined (__AVR_ATmega32A__)
+  #pragma GCC error "Host shim only models the ATmega32A, build with -D__AVR_ATmega32A__"
+#endif
+
+// Simulated data space. 16 bit registers all sit on even addresses.
+#define SIM_IO_SIZE 0x60
+extern volatile union sim_io_space {
+	uint8_t  b[SIM_IO_SIZE];
+	uint16_t w[SIM_IO_SIZE / 2];
+} sim_io;
+
+#define _SFR_MEM8(a)  (sim_io.b[(a)])
+#define _SFR_MEM16(a) (sim_io.w[(a) / 2])
+#define _BV(bit) (1 << (bit))
+
+// ADC
+#define ADC     _SFR_MEM16(0x24)
+#define ADCL    _SFR_MEM8(0x24)
+#define ADCH    _SFR_MEM8(0x25)
+#define ADCSRA  _SFR_MEM8(0x26)
+#define ADMUX   _SFR_MEM8(0x27)
+
+// USART. UBRRH and UCSRC share 0x40 on the part (selected by URSEL); the
+// shim gives UCSRC a slot of its own at an unused address.
+#define UBRRL   _SFR_MEM8(0x29)
+#define UCSRB   _SFR_MEM8(0x2A)
+#define UCSRA   _SFR_MEM8(0x2B)
+#define UDR     _SFR_MEM8(0x2C)
+#define UBRRH   _SFR_MEM8(0x40)
+#define UCSRC   _SFR_MEM8(0x5D)
+
+// SPI
+#define SPCR    _SFR_MEM8(0x2D)
+#define SPSR    _SFR_MEM8(0x2E)
+#define SPDR    _SFR_MEM8(0x2F)
+
+// Ports
+#define PIND    _SFR_MEM8(0x30)
+#define DDRD    _SFR_MEM8(0x31)
+#define PORTD   _SFR_MEM8(0x32)
+#define PINC    _SFR_MEM8(0x33)
+#define DDRC    _SFR_MEM8(0x34)
+#define PORTC   _SFR_MEM8(0x35)
+#define PINB    _SFR_MEM8(0x36)
+#define DDRB    _SFR_MEM8(0x37)
+#define PORTB   _SFR_MEM8(0x38)
+#define PINA    _SFR_MEM8(0x39)
+#define DDRA    _SFR_MEM8(0x3A)
+#define PORTA   _SFR_MEM8(0x3B)
+
+// Timer 2
+#define OCR2    _SFR_MEM8(0x43)
+#define TCNT2   _SFR_MEM8(0x44)
+#define TCCR2   _SFR_MEM8(0x45)
+
+// Timer 1
+#define ICR1    _SFR_MEM16(0x46)
+#define ICR1L   _SFR_MEM8(0x46)
+#define ICR1H   _SFR_MEM8(0x47)
+#define OCR1B   _SFR_MEM16(0x48)
+#define OCR1A   _SFR_MEM16(0x4A)
+#define TCNT1   _SFR_MEM16(0x4C)
+#define TCCR1B  _SFR_MEM8(0x4E)
+#define TCCR1A  _SFR_MEM8(0x4F)
+
+// Timer 0 and system
+#define OSCCAL  _SFR_MEM8(0x51)
+#define TCNT0   _SFR_MEM8(0x52)
+#define TCCR0   _SFR_MEM8(0x53)
+#define MCUCSR  _SFR_MEM8(0x54)
+#define MCUCR   _SFR_MEM8(0x55)
+#define TIFR    _SFR_MEM8(0x58)
+#define TIMSK   _SFR_MEM8(0x59)
+#define GIFR    _SFR_MEM8(0x5A)
+#define GICR    _SFR_MEM8(0x5B)
+#define OCR0    _SFR_MEM8(0x5C)
+#define SFIOR   _SFR_MEM8(0x50)
+#define SREG    _SFR_MEM8(0x5F)
+
+// Bits
+#define ADEN 7
+#define ADSC 6
+#define ADATE 5
+#define ADIF 4
+#define ADIE 3
+#define ADPS2 2
+#define ADPS1 1
+#define ADPS0 0
+#define REFS1 7
+#define REFS0 6
+#define ADLAR 5
+#define ADTS2 7
+#define ADTS1 6
+#define ADTS0 5
+
+#define RXC 7
+#define TXC 6
+#define UDRE 5
+#define U2X 1
+#define RXCIE 7
+#define TXCIE 6
+#define UDRIE 5
+#define RXEN 4
+#define TXEN 3
+#define URSEL 7
+#define UCSZ1 2
+#define UCSZ0 1
+
+#define SPIE 7
+#define SPE 6
+#define DORD 5
+#define MSTR 4
+#define CPOL 3
+#define CPHA 2
+#define SPIF 7
+#define WCOL 6
+
+#define FOC2 7
+#define WGM20 6
+#define COM21 5
+#define COM20 4
+#define WGM21 3
+#define CS22 2
+#define CS21 1
+#define CS20 0
+
+#define ICNC1 7
+#define ICES1 6
+#define WGM13 4
+#define WGM12 3
+#define CS12 2
+#define CS11 1
+#define CS10 0
+#define WGM11 1
+#define WGM10 0
+
+#define FOC0 7
+#define WGM00 6
+#define WGM01 3
+#define CS02 2
+#define CS01 1
+#define CS00 0
+
+#define OCIE2 7
+#define TOIE2 6
+#define TICIE1 5
+#define OCIE1A 4
+#define OCIE1B 3
+#define TOIE1 2
+#define OCIE0 1
+#define TOIE0 0
+#define OCF2 7
+#define TOV2 6
+#define ICF1 5
+#define OCF1A 4
+#define OCF1B 3
+#define TOV1 2
+#define OCF0 1
+#define TOV0 0
+
+#define INT2 5
+#define INTF2 5
+#define ISC2 6
+
+#define SREG_I 7
+
+#define PORTA0 0
+#define PORTA1 1
+#define PORTA2 2
+#define PORTA3 3
+#define PORTA4 4
+#define PORTA5 5
+#define PORTA6 6
+#define PORTA7 7
+#define PORTB0 0
+#define PORTB1 1
+#define PORTB2 2
+#define PORTB3 3
+#define PORTB4 4
+#define PORTB5 5
+#define PORTB6 6
+#define PORTB7 7
+#define PORTD0 0
+#define PORTD1 1
+#define PORTD2 2
+#define PORTD3 3
+#define PORTD4 4
+#define PORTD5 5
+#define PORTD6 6
+#define PORTD7 7
+
+#endif /* HOST_AVR_IO_H_ */
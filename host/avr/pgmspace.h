@@ -0,0 +1,40 @@
+/*
+ * avr/pgmspace.h (host)
+ *
+ *  Created on: October 16, 2026
+ */
+
+/*
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+*/
+
+#ifndef HOST_AVR_PGMSPACE_H_
+#define HOST_AVR_PGMSPACE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+// One address space here, so flash data is just const data
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define pgm_read_dword(p) (*(const uint32_t *)(p))
+#define vsnprintf_P vsnprintf
+
+#endif /* HOST_AVR_PGMSPACE_H_ */
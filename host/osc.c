@@ -0,0 +1,113 @@
+/*
+ * osc.c
+ *
+ *  Created on: October 15, 2026
+ *  Simulated oscillator for the host build (see osc.h). The noise comes
+ *  from its own generator so results are the same on any host.
+ */
+
+/*
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+*/
+
+#include <stdint.h>
+#include <math.h>
+#include <avr/io.h>
+
+#include "config.h"
+#include "sim.h"
+#include "event.h"
+#include "time.h"
+#include "efc.h"
+#include "osc.h"
+
+static uint64_t seed = 88172645463325252ULL;
+
+void osc_seed(uint64_t s)
+{
+	seed = s ? s : 1;
+}
+
+static double uniform(void)
+// xorshift64, in (0, 1]
+{
+	seed ^= seed << 13;
+	seed ^= seed >> 7;
+	seed ^= seed << 17;
+	return ((seed >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+double osc_gauss(void)
+{
+	return sqrt(-2 * log(uniform())) * cos(2 * M_PI * uniform());
+}
+
+void osc_init(struct osc * o)
+// Start at GPS time 0, now
+{
+	o->y = o->y0;
+	o->x = 0;
+	o->c0 = sim_cycles;
+	o->t = 0;
+
+	// The steps of a real RC oscillator are uneven, so these are too, the
+	// same way each run
+	o->rc_f[0] = 1;
+	for (int i = 1; i < 256; i++)
+	{
+	    o->rc_f[i] = o->rc_f[i - 1] * (1 + o->rc_step * (0.5 + (i * 37 % 19) / 18.0));
+	}
+}
+
+double osc_freq(struct osc * o)
+// Frequency offset now, with the temperature and the EFC, Hz. An RC
+// oscillator has no EFC but scales with OSCCAL.
+{
+	double f = o->y + o->tc * o->temp;
+
+	if (o->rc_step)
+	{
+	    return (sim_hz + f) * o->rc_f[OSCCAL] / o->rc_f[o->rc_cal] - sim_hz;
+	}
+	return f + o->kv * ((double)efc_get() - EFC_MID);
+}
+
+void osc_second(struct osc * o, uint8_t pulse)
+// Run one GPS second, ending with a PPS edge if pulse is set, and let the
+// background run
+{
+	uint64_t at;
+
+	o->x += osc_freq(o);
+	o->y += o->aging + o->rwfm * osc_gauss();
+	o->t++;
+	at = o->c0 + (uint64_t)o->t * sim_hz + llround(o->x + o->wpm * osc_gauss());
+	while (at - sim_cycles > 0x80000000)
+	{
+	    sim_advance(0x80000000);
+	}
+	sim_advance(at - sim_cycles);
+	if (pulse)
+	{
+	    sim_capture();
+	}
+	proc_timer();
+	event_xeq();
+	time_xeq();
+}
@@ -0,0 +1,61 @@
+/*
+ * osc.h
+ *
+ *  Created on: October 15, 2026
+ *  Simulated oscillator for the host build. The CPU runs from it, so each
+ *  GPS second it decides how many CPU cycles go by, from its frequency
+ *  offset, aging, temperature and noise and the EFC code the firmware is
+ *  putting out.
+ */
+
+/*
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+*/
+
+#ifndef OSC_H_
+#define OSC_H_
+
+#include <stdint.h>
+
+struct osc {
+	// Settings
+	double y0;			// Frequency offset at EFC_MID, Hz
+	double kv;			// Frequency change per EFC code, Hz
+	double aging;			// Frequency drift, Hz per second
+	double rwfm;			// Random walk of frequency, Hz per root second
+	double wpm;			// PPS capture jitter, cycles rms
+	double tc;			// Frequency change per degree, Hz
+	double temp;			// Temperature, degrees from where y0 holds
+	double rc_step;			// RC oscillator: mean fractional change per OSCCAL step (0 = crystal)
+	uint8_t rc_cal;			// RC oscillator: OSCCAL where y0 holds
+	// State
+	double y;			// Frequency offset now, without the EFC, Hz
+	double x;			// Time error, cycles (+ = fast)
+	uint64_t c0;			// sim_cycles at GPS time 0
+	uint32_t t;			// GPS seconds since osc_init()
+	double rc_f[256];		// Relative frequency at each OSCCAL code
+};
+
+void osc_seed(uint64_t);
+double osc_gauss(void);
+void osc_init(struct osc *);
+double osc_freq(struct osc *);
+void osc_second(struct osc *, uint8_t);
+
+#endif /* OSC_H_ */
@@ -0,0 +1,527 @@
+/*
+ * sim.c
+ *
+ *  Created on: October 15, 2026
+ *  Simulated ATmega32A peripherals for the host build. Time only moves when
+ *  the test driver calls sim_advance() or sim_run(); interrupts are raised
+ *  by setting the same flag bits the hardware uses and then dispatched,
+ *  highest priority first, whenever the I bit and the enable bit allow.
+ *
+ *  Limits of the model: the prescaler counts are exact but there is no
+ *  interrupt latency, UDRE is an edge supplied by the driver rather than a
+ *  level, and nothing is modelled for pins other than what the firmware
+ *  writes to the port registers and the time OC2 (the EFC PWM) is high.
+ *  An ADC conversion completes as soon as it is started (by ADSC, or in
+ *  auto trigger mode by Timer 1 overflow), taking its result from
+ *  sim_adc_hook.
+ */
+
+/*
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/crc16.h>
+
+#include "sim.h"
+#include "spi.h"
+
+volatile union sim_io_space sim_io;
+
+uint32_t sim_count[SIM_VECTORS];
+uint32_t sim_hz;
+uint64_t sim_cycles;
+
+void (*sim_spi_hook)(uint8_t);
+void (*sim_usart_hook)(uint8_t);
+uint16_t (*sim_adc_hook)(uint8_t);
+
+static uint32_t t0_period;			// Timer0 override, cycles (0 = registers)
+static uint32_t t0_pre;				// Cycles into the current Timer0 count
+static uint32_t t1_pre;				// Cycles into the current Timer1 count
+static uint32_t t2_pre;				// Cycles into the current Timer2 count
+static uint8_t  ocr2_buf;			// OCR2 for this PWM period (double buffered)
+
+uint8_t  sim_timer2;				// Clock Timer2 (off unless a test wants it)
+uint64_t sim_oc2_high;				// Cycles OC2 has been high
+uint64_t sim_oc2_cycles;			// Cycles of whole PWM periods
+static uint8_t  udre_pending;			// UDRE edge supplied by sim_usart()
+
+#define SIM_FRAMES 8				// Good frames the master holds
+#define SIM_FRAME_LEN 64
+uint8_t  sim_spi_seq;
+uint16_t sim_spi_bad;
+static uint8_t  spi_txseq;			// Master's next sequence number
+static uint8_t  spi_frame[SIM_FRAME_LEN];	// Frame being read, unescaped
+static int      spi_len;			// Its length so far, -1 if it is bad
+static uint8_t  spi_esc;			// Last byte was ESC
+static uint8_t  spi_frames[SIM_FRAMES][SIM_FRAME_LEN];
+static uint8_t  spi_flen[SIM_FRAMES];
+static uint8_t  spi_fhead, spi_fcount;
+
+// Default (empty) handlers, replaced by any ISR() the firmware defines
+#define SIM_WEAK __attribute__((weak))
+SIM_WEAK void sim_INT0_vect(void) {}
+SIM_WEAK void sim_INT1_vect(void) {}
+SIM_WEAK void sim_INT2_vect(void) {}
+SIM_WEAK void sim_TIMER2_COMP_vect(void) {}
+SIM_WEAK void sim_TIMER2_OVF_vect(void) {}
+SIM_WEAK void sim_TIMER1_CAPT_vect(void) {}
+SIM_WEAK void sim_TIMER1_COMPA_vect(void) {}
+SIM_WEAK void sim_TIMER1_COMPB_vect(void) {}
+SIM_WEAK void sim_TIMER1_OVF_vect(void) {}
+SIM_WEAK void sim_TIMER0_COMP_vect(void) {}
+SIM_WEAK void sim_TIMER0_OVF_vect(void) {}
+SIM_WEAK void sim_SPI_STC_vect(void) {}
+SIM_WEAK void sim_USART_RXC_vect(void) {}
+SIM_WEAK void sim_USART_UDRE_vect(void) {}
+SIM_WEAK void sim_USART_TXC_vect(void) {}
+SIM_WEAK void sim_ADC_vect(void) {}
+SIM_WEAK void sim_EE_RDY_vect(void) {}
+SIM_WEAK void sim_ANA_COMP_vect(void) {}
+SIM_WEAK void sim_TWI_vect(void) {}
+SIM_WEAK void sim_SPM_RDY_vect(void) {}
+
+// spi.c calls back into the application (gpsdo.c), which is not part of
+// the host library.
+struct spi_buf;
+SIM_WEAK void msg1(struct spi_buf * buf) {}
+
+// Vector table: flag register & bit, enable register & bit, handler.
+// Flag address 0 marks a source the model doesn't raise.
+struct sim_vector {
+	uint8_t flag_reg;
+	uint8_t flag_bit;
+	uint8_t en_reg;
+	uint8_t en_bit;
+	void (*isr)(void);
+};
+
+static const struct sim_vector sim_vectors[SIM_VECTORS] = {
+	[SIM_INT2]		= {0x5A, INTF2, 0x5B, INT2,   sim_INT2_vect},
+	[SIM_TIMER2_COMP]	= {0x58, OCF2,  0x59, OCIE2,  sim_TIMER2_COMP_vect},
+	[SIM_TIMER2_OVF]	= {0x58, TOV2,  0x59, TOIE2,  sim_TIMER2_OVF_vect},
+	[SIM_TIMER1_CAPT]	= {0x58, ICF1,  0x59, TICIE1, sim_TIMER1_CAPT_vect},
+	[SIM_TIMER1_COMPA]	= {0x58, OCF1A, 0x59, OCIE1A, sim_TIMER1_COMPA_vect},
+	[SIM_TIMER1_COMPB]	= {0x58, OCF1B, 0x59, OCIE1B, sim_TIMER1_COMPB_vect},
+	[SIM_TIMER1_OVF]	= {0x58, TOV1,  0x59, TOIE1,  sim_TIMER1_OVF_vect},
+	[SIM_TIMER0_COMP]	= {0x58, OCF0,  0x59, OCIE0,  sim_TIMER0_COMP_vect},
+	[SIM_TIMER0_OVF]	= {0x58, TOV0,  0x59, TOIE0,  sim_TIMER0_OVF_vect},
+	[SIM_SPI_STC]		= {0x2E, SPIF,  0x2D, SPIE,   sim_SPI_STC_vect},
+	[SIM_USART_UDRE]	= {0x2B, UDRE,  0x2A, UDRIE,  sim_USART_UDRE_vect},
+	[SIM_ADC]		= {0x26, ADIF,  0x26, ADIE,   sim_ADC_vect},
+};
+
+void sim_init(uint32_t hz)
+// Power-on reset: clear every register and counter, leave interrupts off
+{
+	for (uint8_t i = 0; i < SIM_IO_SIZE; i++) sim_io.b[i] = 0;
+	for (uint8_t i = 0; i < SIM_VECTORS; i++) sim_count[i] = 0;
+	sim_hz = hz;
+	sim_spi_seq = 0;
+	sim_spi_bad = 0;
+	spi_txseq = 0;
+	spi_len = 0;
+	spi_esc = 0;
+	spi_fhead = 0;
+	spi_fcount = 0;
+	sim_cycles = 0;
+	t0_period = 0;
+	t0_pre = 0;
+	t1_pre = 0;
+	t2_pre = 0;
+	ocr2_buf = 0;
+	sim_timer2 = 0;
+	sim_oc2_high = 0;
+	sim_oc2_cycles = 0;
+	udre_pending = 0;
+}
+
+uint8_t sim_dispatch(void)
+// Run every pending, enabled interrupt, highest priority first. As on the
+// part, the flag is cleared on entry and I is clear while the ISR runs.
+// Returns the number of ISRs run.
+{
+	uint8_t n = 0;
+	uint8_t v = 1;
+
+	while (v < SIM_VECTORS)
+	{
+	    const struct sim_vector * sv = &sim_vectors[v];
+
+	    if (sv->flag_reg && (SREG & 1<<SREG_I)
+		&& (sim_io.b[sv->flag_reg] & 1<<sv->flag_bit)
+		&& (sim_io.b[sv->en_reg] & 1<<sv->en_bit)
+		&& (v != SIM_USART_UDRE || udre_pending))
+	    {
+		if (v == SIM_USART_UDRE)
+		{
+		    udre_pending = 0;
+		    UDR = 0;			// Firmware never sends NUL
+		} else {
+		    sim_io.b[sv->flag_reg] &= ~(1<<sv->flag_bit);
+		}
+		cli();
+		sv->isr();
+		sei();
+		sim_count[v]++;
+		n++;
+
+		if (v == SIM_USART_UDRE && UDR && sim_usart_hook)
+		    sim_usart_hook(UDR);
+		v = 1;				// Rescan from the top
+	    } else {
+		v++;
+	    }
+	}
+	return n;
+}
+
+static uint32_t prescale(uint8_t cs)
+// Clock select bits to prescaler value, 0 if stopped or external
+{
+	static const uint16_t div[8] = {0, 1, 8, 64, 256, 1024, 0, 0};
+	return div[cs & 7];
+}
+
+static void adc_convert(void)
+// Complete a conversion of the channel selected by ADMUX
+{
+	ADC = sim_adc_hook ? sim_adc_hook(ADMUX & 0x1F) & 0x3FF : 0;
+	ADCSRA &= ~(1<<ADSC);
+	ADCSRA |= 1<<ADIF;
+}
+
+static uint32_t oc2_high(uint8_t ocr)
+// Counts of 256 OC2 is high for in fast PWM
+{
+	switch (TCCR2 & (1<<COM21 | 1<<COM20))
+	{
+	    case 1<<COM21:			// Set at BOTTOM, clear on match
+		return ocr + 1;
+	    case 1<<COM21 | 1<<COM20:		// Clear at BOTTOM, set on match
+		return 255 - ocr;
+	}
+	return 0;
+}
+
+static uint32_t advance(uint32_t cycles, uint8_t wake)
+// Let the CPU clock run for a number of cycles, stepping Timer0 (CTC on
+// OCR0), Timer1 (normal mode) and, if sim_timer2 is set, Timer2 (fast
+// PWM), and taking their interrupts as they fall. Timer2 is left off
+// otherwise as at PWM rates it would dominate long runs.
+// If wake is set, stop early after any interrupt has been taken, as the
+// main loop would return from sleep_mode(). Returns the cycles run.
+{
+	uint32_t run = 0;
+
+	while (run < cycles)
+	{
+	    uint32_t step = cycles - run;
+	    uint32_t p0 = prescale(TCCR0);
+	    uint32_t p1 = prescale(TCCR1B);
+	    uint32_t p2 = sim_timer2 ? prescale(TCCR2) : 0;
+	    uint32_t c0 = 0;
+	    uint32_t c1 = 0;
+
+	    // A conversion started by the firmware
+	    if ((ADCSRA & (1<<ADEN | 1<<ADSC)) == (1<<ADEN | 1<<ADSC))
+	    {
+		adc_convert();
+		if (sim_dispatch() && wake) break;
+	    }
+
+	    // Cycles to the next Timer0 compare match and Timer1 overflow
+	    if (t0_period)
+	    {
+		c0 = t0_period - t0_pre;
+	    } else if (p0) {
+		c0 = ((uint32_t)(uint8_t)(OCR0 - TCNT0) + 1) * p0 - t0_pre;
+	    }
+	    if (c0 && c0 < step) step = c0;
+	    if (p1)
+	    {
+		c1 = (0x10000 - (uint32_t)TCNT1) * p1 - t1_pre;
+		if (c1 < step) step = c1;
+	    }
+	    if (p2)
+	    {
+		uint32_t c2 = (0x100 - (uint32_t)TCNT2) * p2 - t2_pre;
+		if (c2 < step) step = c2;
+	    }
+
+	    // Move both timers along
+	    if (t0_period)
+	    {
+		t0_pre += step;
+		if (t0_pre == t0_period)
+		{
+		    t0_pre = 0;
+		    TIFR |= 1<<OCF0;
+		}
+	    } else if (p0) {
+		t0_pre += step;
+		while (t0_pre >= p0)
+		{
+		    t0_pre -= p0;
+		    if (TCNT0 == OCR0)
+		    {
+			TCNT0 = 0;
+			TIFR |= 1<<OCF0;
+		    } else {
+			TCNT0++;
+		    }
+		}
+	    }
+	    if (p1)
+	    {
+		uint32_t t = TCNT1 + (t1_pre + step) / p1;
+		t1_pre = (t1_pre + step) % p1;
+		if (t > 0xFFFF)
+		{
+		    TIFR |= 1<<TOV1;
+		    // ADC auto trigger source 6 is Timer 1 overflow
+		    if ((ADCSRA & (1<<ADEN | 1<<ADATE)) == (1<<ADEN | 1<<ADATE)
+			&& (SFIOR >> ADTS0) == 6)
+		    {
+			adc_convert();
+		    }
+		}
+		TCNT1 = t;
+	    }
+	    if (p2)
+	    {
+		uint32_t t = TCNT2 + (t2_pre + step) / p2;
+		t2_pre = (t2_pre + step) % p2;
+		if (t > 0xFF)
+		{
+		    // End of a PWM period; OCR2 is latched for the next at BOTTOM
+		    sim_oc2_high += oc2_high(ocr2_buf) * p2;
+		    sim_oc2_cycles += 0x100 * p2;
+		    ocr2_buf = OCR2;
+		    TIFR |= 1<<TOV2;
+		}
+		TCNT2 = t;
+	    }
+
+	    sim_cycles += step;
+	    run += step;
+	    if (sim_dispatch() && wake) break;
+	}
+	return run;
+}
+
+void sim_advance(uint32_t cycles)
+{
+	advance(cycles, 0);
+}
+
+void sim_capture(void)
+// An edge on ICP1: latch Timer1 into ICR1 and raise TIMER1_CAPT
+{
+	ICR1 = TCNT1;
+	TIFR |= 1<<ICF1;
+	sim_dispatch();
+}
+
+static uint16_t spi_crc(const uint8_t * p, int n)
+{
+	uint16_t crc = 0xFFFF;
+
+	while (n--)
+	    crc = _crc_ccitt_update(crc, *p++);
+	return crc;
+}
+
+static void spi_deframe(uint8_t c)
+// The master's SLIP decoder: keep frames with a good length and CRC
+{
+	if (c == END)
+	{
+	    if (spi_len >= 5 && spi_frame[0] == spi_len - 4
+		&& spi_crc(spi_frame, spi_len - 2) == (spi_frame[spi_len - 2] | spi_frame[spi_len - 1] << 8))
+	    {
+		uint8_t i;
+
+		// If nobody has been reading, the oldest go
+		if (spi_fcount == SIM_FRAMES)
+		{
+		    spi_fhead = (spi_fhead + 1) % SIM_FRAMES;
+		    spi_fcount--;
+		}
+		i = (spi_fhead + spi_fcount++) % SIM_FRAMES;
+		memcpy(spi_frames[i], spi_frame, spi_len);
+		spi_flen[i] = spi_len;
+	    } else if (spi_len) {
+		sim_spi_bad++;
+	    }
+	    spi_len = 0;
+	    spi_esc = 0;
+	} else if (!spi_len && c == NUL) {
+	    ;					// Idle
+	} else if (spi_len < 0) {
+	    ;					// Bad, wait for END
+	} else if (spi_esc) {
+	    spi_esc = 0;
+	    if ((c != ESC_END && c != ESC_ESC) || spi_len >= SIM_FRAME_LEN)
+		spi_len = -1;
+	    else
+		spi_frame[spi_len++] = c == ESC_END ? END : ESC;
+	} else if (c == ESC) {
+	    spi_esc = 1;
+	} else if (spi_len >= SIM_FRAME_LEN) {
+	    spi_len = -1;
+	} else {
+	    spi_frame[spi_len++] = c;
+	}
+}
+
+uint8_t sim_spi(uint8_t mosi)
+// The master clocks one byte. Returns what the slave had loaded in SPDR.
+{
+	uint8_t miso = SPDR;
+
+	SPDR = mosi;
+	SPSR |= 1<<SPIF;
+	sim_dispatch();
+	spi_deframe(miso);
+	if (sim_spi_hook) sim_spi_hook(miso);
+	return miso;
+}
+
+uint8_t sim_spi_send(const uint8_t * msg, uint8_t n)
+// The master sends a message (type and data) in a frame of its own.
+// Returns the frame's sequence number.
+{
+	uint8_t frame[SIM_FRAME_LEN];
+	uint16_t crc;
+
+	frame[0] = n;
+	frame[1] = spi_txseq++;
+	memcpy(frame + 2, msg, n);
+	crc = spi_crc(frame, n + 2);
+	frame[n + 2] = crc & 0xFF;
+	frame[n + 3] = crc >> 8;
+	for (int i = 0; i < n + 4; i++)
+	{
+	    if (frame[i] == END || frame[i] == ESC)
+	    {
+		sim_spi(ESC);
+		sim_spi(frame[i] == END ? ESC_END : ESC_ESC);
+	    } else {
+		sim_spi(frame[i]);
+	    }
+	}
+	sim_spi(END);
+	return frame[1];
+}
+
+int sim_spi_recv(uint8_t * msg, uint8_t max, uint16_t clocks)
+// The next good frame from the slave, clocking up to clocks NULs for it.
+// Returns the length of its message (type and data), copied to msg as far
+// as max, or -1 if there wasn't one. sim_spi_seq is its sequence number.
+{
+	uint8_t * f;
+	int n;
+
+	while (!spi_fcount && clocks--)
+	    sim_spi(NUL);
+	if (!spi_fcount)
+	    return -1;
+	f = spi_frames[spi_fhead];
+	n = spi_flen[spi_fhead] - 4;
+	spi_fhead = (spi_fhead + 1) % SIM_FRAMES;
+	spi_fcount--;
+	sim_spi_seq = f[1];
+	memcpy(msg, f + 2, n < max ? n : max);
+	return n;
+}
+
+int16_t sim_usart(void)
+// The line has finished sending a character. Returns the next character
+// the firmware puts in UDR, or -1 if it has nothing to send.
+{
+	udre_pending = 1;
+	UCSRA |= 1<<UDRE;
+	if (sim_dispatch() && UDR) return UDR;
+	udre_pending = 0;
+	return -1;
+}
+
+void sim_run(struct sim_rates * rate, uint64_t cycles, void (*background)(void))
+// Drive the firmware for a number of CPU cycles with each event source
+// firing at its own rate. background() is the main loop body, called
+// after every wake-up just as it would be after sleep_mode() returns.
+{
+	uint64_t end = sim_cycles + cycles;
+	uint64_t next[3];
+	uint64_t period[3];
+
+	period[0] = rate->capt ? sim_hz / rate->capt : 0;
+	period[1] = rate->spi  ? sim_hz / rate->spi  : 0;
+	period[2] = rate->udre ? sim_hz / rate->udre : 0;
+	for (uint8_t i = 0; i < 3; i++)
+	    next[i] = period[i] ? sim_cycles + period[i] : end;
+
+	t0_period = rate->timer0 ? sim_hz / rate->timer0 : 0;
+	t0_pre = 0;
+
+	while (sim_cycles < end)
+	{
+	    uint8_t ev = 0;
+	    uint64_t t = end;
+
+	    for (uint8_t i = 0; i < 3; i++)
+	    {
+		if (next[i] < t)
+		{
+		    t = next[i];
+		    ev = i + 1;
+		}
+	    }
+
+	    // Timer interrupts on the way wake the background early
+	    while (sim_cycles < t)
+	    {
+		uint64_t left = t - sim_cycles;
+		advance(left > 0xFFFFFFFF ? 0xFFFFFFFF : left, 1);
+		if (sim_cycles < t && background) background();
+	    }
+
+	    switch (ev)
+	    {
+		case 1:
+		    sim_capture();
+		    break;
+		case 2:
+		    sim_spi(0);				// Master sends idle NULs
+		    break;
+		case 3:
+		    sim_usart();
+		    break;
+	    }
+	    if (ev) next[ev - 1] += period[ev - 1];
+	    if (background) background();
+	}
+	t0_period = 0;
+}
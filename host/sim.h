@@ -0,0 +1,81 @@
+/*
+ * sim.h
+ *
+ *  Created on: October 15, 2026
+ *  Peripheral model for running the firmware on a Linux host. The firmware
+ *  sources are compiled unchanged against the headers in host/avr, and this
+ *  module plays the part of Timer0, Timer1, Timer2, the SPI slave and the
+ *  USART, raising their interrupts in hardware priority order.
+ */
+
+/*
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+*/
+
+#ifndef SIM_H_
+#define SIM_H_
+
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+// Event rates for sim_run(), in events per simulated second. Zero turns
+// a source off, except timer0 where zero means "as programmed by OCR0".
+struct sim_rates {
+	uint32_t capt;				// TIMER1_CAPT (PPS edges)
+	uint32_t timer0;			// TIMER0_COMP override
+	uint32_t spi;				// SPI_STC (bytes clocked by the master)
+	uint32_t udre;				// USART_UDRE (bytes drained by the line)
+};
+
+// Event counts, by vector number
+extern uint32_t sim_count[SIM_VECTORS];
+
+extern uint32_t sim_hz;				// Simulated CPU clock
+extern uint64_t sim_cycles;			// CPU cycles since sim_init()
+
+// Timer2, for the EFC PWM, is only clocked if sim_timer2 is set
+extern uint8_t  sim_timer2;
+extern uint64_t sim_oc2_high;			// Cycles OC2 has been high
+extern uint64_t sim_oc2_cycles;			// Cycles of whole PWM periods
+
+// Optional taps on what the firmware sends
+extern void (*sim_spi_hook)(uint8_t);		// Called with each MISO byte
+extern void (*sim_usart_hook)(uint8_t);		// Called with each UDR byte
+
+// The SPI master's end of the framing in spi.c, as the Pi does it: every
+// MISO byte is deframed and the last few good frames kept for sim_spi_recv()
+extern uint8_t  sim_spi_seq;			// Sequence number of the last frame read
+extern uint16_t sim_spi_bad;			// Frames with a bad escape, length or CRC
+
+// The ADC input: called with the ADMUX channel at each conversion, returns
+// the 10 bit result (0 if not set)
+extern uint16_t (*sim_adc_hook)(uint8_t);
+
+void sim_init(uint32_t);
+uint8_t sim_dispatch(void);
+void sim_advance(uint32_t);
+void sim_capture(void);
+uint8_t sim_spi(uint8_t);
+uint8_t sim_spi_send(const uint8_t *, uint8_t);
+int sim_spi_recv(uint8_t *, uint8_t, uint16_t);
+int16_t sim_usart(void);
+void sim_run(struct sim_rates *, uint64_t, void (*)(void));
+
+#endif /* SIM_H_ */
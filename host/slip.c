@@ -0,0 +1,240 @@
+/*
+ * slip.c
+ *
+ *  Created on: October 15, 2026
+ *  SPI frame decoder for the master's side: a streaming SLIP deframer
+ *  that checks each frame and hands back its message, mostly in place,
+ *  and a decoder for the fixed layout messages. Built into libslip.so for
+ *  gpsdo.py (utility/slip.py) as well as for the tests.
+ */
+
+/*
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include <util/crc16.h>
+
+#include "spi.h"
+#include "slip.h"
+
+/*
+ The frames are spi.c's: len seq type data... crc_lo crc_hi END, SLIP
+ escaped, with NULs between them when the MCU has nothing to send.
+
+ slip_input() gives the deframer some bytes, and slip_next() is called
+ until it returns 0 for each good message in them. The bytes are looked
+ at where they are: idle NULs are skipped, the END found with memchr(),
+ and if there is no ESC before it the message is handed back as a
+ pointer into the input, copying nothing. Only a frame with an escape in
+ it, or one split between inputs, is unescaped into buf a byte at a time.
+ A message from buf is good until the next call, one from the input for
+ as long as the input is.
+
+ A frame that fails (bad escape, wrong length byte, CRC) is counted and
+ dropped; the next starts after its END.
+*/
+
+static const char * const slip_layouts[256] = {
+	// After the type byte. b/B, h/H, i/I: 1, 2, 4 bytes signed/unsigned
+	[SPICMD_PPS] = "IHi",		// CPU clock, interval, phase gained
+	[SPICMD_ADEV] = "BHII",		// log2 tau, n, ADEV, MDEV
+	[SPICMD_HOLD] = "BBIii",	// on, points, seconds, estimated, measured
+	[SPICMD_KAL] = "bbbbiii",	// R, Q0-2, phase, frequency, drift
+	[SPICMD_LOCK] = "BBIIIHH",	// state, merit, since, now, locked, changes, rms
+	[SPICMD_TEMP] = "BBHHihH",	// on, ok, reading, mean, slope, correction, n
+	[SPICMD_RESEND] = "B",		// sequence number gone
+	[SPICMD_TLM] = "BBIiiHHH",	// n, state, secs, phase, median, EFC, temp, drops
+	[SPICMD_GET] = "BBBi",		// request, status, id, value
+	[SPICMD_SET] = "BBBi",
+	[SPICMD_RESET] = "BB",		// request, status
+	[SPICMD_VERSION] = "BBBBHBI",	// request, status, major, minor, caps, longest, clock
+	[SPICMD_ERROR] = "BBB",		// request, status, type
+};
+
+void slip_init(struct slip * s)
+{
+	memset(s, 0, sizeof *s);
+}
+
+void slip_input(struct slip * s, const uint8_t * in, size_t n)
+// Bytes to deframe; slip_next() until it returns 0 before the next lot
+{
+	s->in = in;
+	s->end = in + n;
+	s->bytes += n;
+}
+
+static int slip_check(struct slip * s, const uint8_t * f, int n, struct slip_msg * m)
+// Check an unescaped frame (without END) and fill in m from it
+{
+	uint16_t crc = 0xFFFF;
+
+	if (n < 5 || f[0] != n - 4)
+	{
+	    s->bad++;
+	    return 0;
+	}
+	for (int i = 0; i < n - 2; i++)
+	    crc = _crc_ccitt_update(crc, f[i]);
+	if (crc != (f[n - 2] | f[n - 1] << 8))
+	{
+	    s->bad++;
+	    return 0;
+	}
+	m->data = f + 2;
+	m->len = f[0];
+	m->seq = f[1];
+	s->frames++;
+	return 1;
+}
+
+int slip_next(struct slip * s, struct slip_msg * m)
+// The next good message. Returns 1, or 0 when the input is used up.
+{
+	while (s->in < s->end)
+	{
+	    // Between frames, look for a whole one with no escapes in it
+	    if (!s->len && !s->esc)
+	    {
+		const uint8_t * p = s->in, * e;
+
+		while (p < s->end && *p == NUL)
+		    p++;
+		s->in = p;
+		if (p == s->end)
+		    break;
+		e = memchr(p, END, s->end - p);
+		if (e && !memchr(p, ESC, e - p))
+		{
+		    s->in = e + 1;
+		    if (e == p)
+			continue;		// END on its own
+		    m->wire = e - p + 1;
+		    if (slip_check(s, p, e - p, m))
+			return 1;
+		    continue;
+		}
+		s->wire = 0;
+	    }
+
+	    // Otherwise unescape it into buf
+	    while (s->in < s->end)
+	    {
+		uint8_t c = *(s->in++);
+
+		s->wire++;
+		if (c == END)
+		{
+		    int n = s->esc ? -1 : s->len;
+
+		    s->len = 0;
+		    s->esc = 0;
+		    m->wire = s->wire;
+		    if (n < 0)
+		    {
+			s->bad++;
+			break;
+		    }
+		    if (slip_check(s, s->buf, n, m))
+		    {
+			s->copied++;
+			return 1;
+		    }
+		    break;
+		}
+		if (s->len < 0)
+		    continue;
+		if (s->esc)
+		{
+		    s->esc = 0;
+		    if (c != ESC_END && c != ESC_ESC)
+		    {
+			s->len = -1;
+			continue;
+		    }
+		    c = c == ESC_END ? END : ESC;
+		} else if (c == ESC) {
+		    s->esc = 1;
+		    continue;
+		}
+		if (s->len >= SLIP_MAX)
+		    s->len = -1;
+		else
+		    s->buf[s->len++] = c;
+	    }
+	}
+	return 0;
+}
+
+size_t slip_drain(struct slip * s, uint8_t * out, size_t max)
+// For callers that pay for each call (gpsdo.py, through ctypes): as many
+// good messages as fit in out, each as seq, len, wire (2 bytes), type and
+// data. Returns the bytes used, 0 when the input is used up.
+{
+	struct slip_msg m;
+	size_t n = 0;
+
+	while (n + 4 + SLIP_MAX <= max && slip_next(s, &m))
+	{
+	    out[n++] = m.seq;
+	    out[n++] = m.len;
+	    out[n++] = m.wire & 0xFF;
+	    out[n++] = m.wire >> 8;
+	    memcpy(out + n, m.data, m.len);
+	    n += m.len;
+	}
+	return n;
+}
+
+const char * slip_layout(uint8_t type)
+// The fields after the type byte, or NULL if the message has no fixed layout
+{
+	return slip_layouts[type];
+}
+
+int slip_decode(const struct slip_msg * m, int64_t * out, int max)
+// Unpack a message's fields (little endian) into out. Returns how many,
+// or -1 if its type has no fixed layout or it is the wrong length.
+{
+	const char * f = m->len ? slip_layouts[m->data[0]] : NULL;
+	const uint8_t * p = m->data + 1;
+	int n = 0, len = 0;
+
+	if (!f)
+	    return -1;
+	for (const char * c = f; *c; c++)
+	    len += (*c | 0x20) == 'b' ? 1 : (*c | 0x20) == 'h' ? 2 : 4;
+	if (len != m->len - 1)
+	    return -1;
+	for (; *f && n < max; f++)
+	{
+	    switch (*f)
+	    {
+		case 'b': out[n++] = (int8_t)p[0]; p += 1; break;
+		case 'B': out[n++] = p[0]; p += 1; break;
+		case 'h': out[n++] = (int16_t)(p[0] | p[1] << 8); p += 2; break;
+		case 'H': out[n++] = (uint16_t)(p[0] | p[1] << 8); p += 2; break;
+		case 'i': out[n++] = (int32_t)(p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24); p += 4; break;
+		case 'I': out[n++] = (uint32_t)(p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24); p += 4; break;
+	    }
+	}
+	return n;
+}
@@ -0,0 +1,67 @@
+/*
+ * slip.h
+ *
+ *  Created on: October 15, 2026
+ *  SPI frame decoder for the master's side (see slip.c)
+ */
+
+/*
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+*/
+
+#ifndef SLIP_H_
+#define SLIP_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SLIP_MAX 64			// Longest frame, unescaped, without END
+
+// A good frame's message
+struct slip_msg {
+	const uint8_t * data;		// Type and data; valid until the next call
+	uint8_t  len;			// Their length
+	uint8_t  seq;			// Frame sequence number
+	uint16_t wire;			// Bytes the frame took on the wire, with END
+};
+
+struct slip {
+	// Input
+	const uint8_t * in;		// Bytes not yet looked at
+	const uint8_t * end;
+	// A frame split across inputs, or escaped, unescaped so far
+	uint8_t  buf[SLIP_MAX];
+	int      len;			// Bytes in buf (-1 = bad, wait for END)
+	uint8_t  esc;			// Last byte was ESC
+	uint16_t wire;			// Bytes of it seen on the wire
+	// Counts
+	uint64_t bytes;			// Bytes fed
+	uint32_t frames;		// Good frames
+	uint32_t bad;			// Frames with a bad escape, length or CRC
+	uint32_t copied;		// Good frames that had to be copied
+};
+
+void slip_init(struct slip *);
+void slip_input(struct slip *, const uint8_t *, size_t);
+int slip_next(struct slip *, struct slip_msg *);
+size_t slip_drain(struct slip *, uint8_t *, size_t);
+int slip_decode(const struct slip_msg *, int64_t *, int);
+const char * slip_layout(uint8_t);
+
+#endif /* SLIP_H_ */
@@ -0,0 +1,259 @@
+/*
+ * adev.c
+ *
+ *  Created on: October 15, 2026
+ *  Allan and modified Allan deviation of the CPU clock at octave taus
+ */
+
+/*
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+*/
+
+#include "config.h"
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "time.h"
+#include "spi.h"
+#include "adev.h"
+#include "cpu.h"
+
+/*
+ pps_report() passes the phase (time error, cycles) once a second. The
+ overlapping Allan variance at tau = m seconds needs the phase m and 2m
+ seconds back for every second, which even at 64 seconds is more RAM than
+ we have. Instead each tau keeps phase samples taken every m/ADEV_OVERLAP
+ seconds (every second for the shortest taus), so the estimate overlaps
+ ADEV_OVERLAP ways rather than m ways: still half the variance of the plain
+ Allan deviation for the same data, from a handful of samples per tau.
+
+ The modified Allan deviation needs the phase averaged over m seconds.
+ Each tau keeps the sums of the phase over its last three m second blocks,
+ and as taus are octaves a block is just the last two blocks of the tau
+ below (at 1 second, the phase itself), so no running total or longer
+ history is needed. That uses every second of the data, so these samples
+ are not overlapped. Phases and sums are kept modulo 2^32: the differences
+ that matter are small, so wrapping arithmetic gives them exactly, as long
+ as the averaged second difference times m fits in 31 bits (two million
+ cycles at 1024 seconds).
+
+ The sums of squares are 32 bits with a scale: when one would overflow it
+ is halved and the squares added from then on are scaled down to match,
+ which loses only bits far below the mean. The 16 bit counts halve (with
+ their sums) when full, so the results follow the last 30,000 or so
+ differences at each tau rather than the whole run.
+
+ Histories are newest first and shifted along as samples come in, and how
+ full they are follows from the seconds since they were cleared, so a tau
+ needs no ring indices. All 11 come to 506 bytes.
+
+ The deviations themselves are only worked out (in floating point) when
+ asked for; the per second work is integer adds and multiplies, for the
+ taus that take a sample that second.
+*/
+
+struct adev_level adev_level[ADEV_LEVELS];
+uint32_t adev_t;			// Seconds since the histories were cleared
+uint8_t  adev_next;			// Next tau to send to the SPI master
+
+// Send the results to the master, a tau per message as buffers allow
+static unsigned char adev_send(struct tlist *);
+
+void adev_init(void)
+// Clear the results and the histories
+{
+	for (uint8_t j = 0; j < ADEV_LEVELS; j++)
+	{
+	    adev_level[j].n = 0;
+	    adev_level[j].sum = 0;
+	    adev_level[j].sh = 0;
+	    adev_level[j].mn = 0;
+	    adev_level[j].msum = 0;
+	    adev_level[j].msh = 0;
+	};
+	adev_next = ADEV_LEVELS;
+	adev_restart();
+};
+
+void adev_restart(void)
+// Clear the histories but keep the sums. Used when the phase jumps (PPS
+// resynchronized, or an outage too long to bridge) so that no difference
+// is taken across the jump. As the histories count as filled from adev_t,
+// clearing it is enough.
+{
+	adev_t = 0;
+};
+
+static void adev_acc(uint16_t * n, uint32_t * sum, uint8_t * sh, uint64_t sq)
+// Add a square to a sum of squares scaled down by 2^sh. If the sum would
+// overflow, the scale goes up instead. A full count halves with the sum.
+{
+	sq >>= *sh;
+	while (sq > 0x7FFFFFFFUL || *sum > 0xFFFFFFFFUL - sq)
+	{
+	    (*sh)++;
+	    *sum >>= 1;
+	    sq >>= 1;
+	};
+	if (*n == 0xFFFF)
+	{
+	    *n >>= 1;
+	    *sum >>= 1;
+	};
+	(*n)++;
+	*sum += sq;
+};
+
+void adev_add(int32_t x)
+// Add the phase for the next second
+{
+	uint32_t t = adev_t;
+
+	for (uint8_t j = 0; j < ADEV_LEVELS; j++)
+	{
+	    struct adev_level * lv = &adev_level[j];
+	    uint8_t k = (1 << j) < ADEV_OVERLAP ? 1 << j : ADEV_OVERLAP;
+	    uint32_t m = 1UL << j;
+	    uint8_t phase = !(t & (m / k - 1));		// Takes a phase sample
+	    uint8_t block = !((t + 1) & (m - 1));	// An m second block ends
+
+	    // As taus are powers of 2, no longer tau samples when this one doesn't
+	    if (!phase && !block)
+	    {
+		break;
+	    };
+
+	    // Second difference of the phase, once 2m seconds are in
+	    if (phase)
+	    {
+		for (uint8_t i = ADEV_XHIST - 1; i > 0; i--)
+		{
+		    lv->x[i] = lv->x[i - 1];
+		};
+		lv->x[0] = x;
+		if (t >= 2 * m)
+		{
+		    int32_t d = x - 2 * lv->x[k] + lv->x[2 * k];
+
+		    adev_acc(&lv->n, &lv->sum, &lv->sh, (uint64_t)((int64_t)d * d));
+		};
+	    };
+
+	    // Second difference of the phase averaged over m seconds, times m,
+	    // squared and divided by m^2 with 8 fraction bits, once three
+	    // blocks are in. The tau below has just ended its second block.
+	    if (block)
+	    {
+		lv->u[2] = lv->u[1];
+		lv->u[1] = lv->u[0];
+		lv->u[0] = j ? lv[-1].u[0] + lv[-1].u[1] : (uint32_t)x;
+		if (t + 1 >= 3 * m)
+		{
+		    int64_t d = (int32_t)(lv->u[0] - 2 * lv->u[1] + lv->u[2]);
+		    uint64_t dd = (uint64_t)(d * d);
+
+		    if (j > 4)
+		    {
+			dd >>= 2 * j - 8;
+		    } else {
+			dd <<= 8 - 2 * j;
+		    };
+		    adev_acc(&lv->mn, &lv->msum, &lv->msh, dd);
+		};
+	    };
+	};
+	adev_t = t + 1;
+};
+
+void adev_result(uint8_t j, uint16_t * n, uint32_t * adev, uint32_t * mdev)
+// Number of differences, Allan and modified Allan deviation at tau = 2^j
+// seconds, in parts per 10^12. Zero until there are some differences.
+{
+	struct adev_level * lv = &adev_level[j];
+	float tau = (float)(1UL << j) * cpu_hz;
+	float a = 0, m = 0;
+
+	if (lv->n)
+	{
+	    a = sqrtf(ldexpf(lv->sum, lv->sh) / (2.0f * lv->n)) / tau * 1e12f;
+	};
+	if (lv->mn)
+	{
+	    m = sqrtf(ldexpf(lv->msum, lv->msh) / (512.0f * lv->mn)) / tau * 1e12f;
+	};
+	*n = lv->n;
+	*adev = a < 4e9f ? (uint32_t)(a + 0.5f) : 0xFFFFFFFF;
+	*mdev = m < 4e9f ? (uint32_t)(m + 0.5f) : 0xFFFFFFFF;
+};
+
+void adev_query(void)
+// SPI master asked for the results. Start (or restart) sending them.
+{
+	if (adev_next < ADEV_LEVELS)
+	{
+	    adev_next = 0;
+	    return;
+	};
+	adev_next = 0;
+	if (adev_send(0))
+	{
+	    return;
+	};
+	// Out of SPI buffers, send the rest as they come free.
+	// If no timer is free either, this query goes unanswered.
+	if (time_set(adev_send, 1, 0, 0, 1))
+	{
+	    adev_next = ADEV_LEVELS;
+	};
+};
+
+static void put32(struct spi_buf * buf, uint32_t v)
+{
+	*(buf->ptr++) = v & 0xFF;
+	*(buf->ptr++) = (v >>  8) & 0xFF;
+	*(buf->ptr++) = (v >> 16) & 0xFF;
+	*(buf->ptr++) = (v >> 24) & 0xFF;
+};
+
+static unsigned char adev_send(struct tlist * tl)
+// Message is: SPICMD_ADEV, log2 tau, differences (2 bytes), ADEV, MDEV
+// (4 bytes each, 1e-12), all little endian.
+// Returns 1 (stop the timer) when all have gone.
+{
+	struct spi_buf * buf;
+	uint16_t n;
+	uint32_t a, m;
+
+	while (adev_next < ADEV_LEVELS && (buf = spi_getbuf()))
+	{
+	    adev_result(adev_next, &n, &a, &m);
+	    *(buf->ptr++) = SPICMD_ADEV;
+	    *(buf->ptr++) = adev_next;
+	    *(buf->ptr++) = n & 0xFF;
+	    *(buf->ptr++) = n >> 8;
+	    put32(buf, a);
+	    put32(buf, m);
+	    spi_tx_queue(buf);
+	    adev_next++;
+	};
+	return adev_next >= ADEV_LEVELS;
+};
@@ -0,0 +1,57 @@
+/*
+ * adev.h
+ *
+ *  Created on: October 15, 2026
+ *  Allan and modified Allan deviation of the CPU clock at octave taus
+ */
+
+/*
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+*/
+
+#ifndef ADEV_H_
+#define ADEV_H_
+
+#include <stdint.h>
+
+#define ADEV_LEVELS 11			// Taus of 1, 2, 4 ... 1024 seconds
+#define ADEV_OVERLAP 2			// Phase samples per tau for the ADEV
+#define ADEV_XHIST (2 * ADEV_OVERLAP + 1)	// Phase samples kept per tau
+#define ADEV_UHIST 3			// Phase sums kept per tau (MDEV)
+#define ADEV_GAP 8			// Longest PPS outage (s) bridged by interpolation
+
+// Per tau history and sums, 46 bytes (506 for all 11 taus)
+struct adev_level {
+	int32_t  x[ADEV_XHIST];		// Phase every tau/ADEV_OVERLAP s, newest first, cycles (modulo 2^32)
+	uint32_t u[ADEV_UHIST];		// Sum of the phase over each of the last tau s blocks, newest first (modulo 2^32)
+	uint8_t  sh;			// sum is scaled down by 2^sh
+	uint8_t  msh;			// msum is scaled down by 2^msh
+	uint16_t n;			// Second differences of phase in sum
+	uint16_t mn;			// Averaged second differences in msum
+	uint32_t sum;			// Sum of their squares, cycles^2
+	uint32_t msum;			// Sum of their squares, cycles^2 * 2^8
+};
+
+void adev_init(void);
+void adev_restart(void);
+void adev_add(int32_t);
+void adev_result(uint8_t, uint16_t *, uint32_t *, uint32_t *);
+void adev_query(void);
+
+#endif /* ADEV_H_ */
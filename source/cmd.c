@@ -0,0 +1,319 @@
+/*
+ * cmd.c
+ *
+ *  Created on: October 15, 2026
+ *  Request/response commands from the SPI master: parameters, statistics, version
+ */
+
+/*
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+*/
+
+#include <avr/io.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "spi.h"
+#include "event.h"
+#include "pps.h"
+#include "disc.h"
+#include "hold.h"
+#include "kalman.h"
+#include "temp.h"
+#include "cpu.h"
+#include "stream.h"
+#include "cmd.h"
+
+/*
+ The Pi can inspect and tune a running unit with these, rather than
+ reflashing it. Each reply starts with the command's type, the request
+ ID, which is the sequence number of the master's frame (see spi.c) so
+ the Pi can tell which request it answers, and a status (CMD_OK or why
+ not), then:
+
+	SPICMD_GET	id			-> id, value (4 bytes)
+	SPICMD_SET	id, value (4 bytes)	-> id, value now (4 bytes)
+	SPICMD_STATS	block			-> block, its counters
+	SPICMD_RESET				-> (nothing)
+	SPICMD_VERSION				-> major, minor, capabilities
+						   (2 bytes), longest message,
+						   CPU clock (4 bytes)
+	anything else				-> SPICMD_ERROR, with the type
+
+ all little endian. The statistics blocks are:
+
+	STATS_PPS	seconds (4 bytes), missed, glitches, resyncs,
+			outliers, reacquisitions (2 bytes each)
+	STATS_SPI	frames received bad, event messages dropped (2
+			bytes each), next sequence number
+	STATS_LOOP	state, changes (2 bytes), time locked (4 bytes),
+			holdovers (2 bytes), Kalman updates (4 bytes)
+	STATS_STREAM	capture records, frames and the bytes they
+			took on the wire (4 bytes each)
+	STATS_EVENT	events lost with the ring full (2 bytes), most
+			ever waiting
+
+ SPICMD_RESET zeroes the counters in them, not the times.
+*/
+
+static void cmd_put(struct spi_buf * buf, uint32_t v, uint8_t n)
+// Add n bytes of v, little endian
+{
+	while (n--)
+	{
+	    *(buf->ptr++) = v & 0xFF;
+	    v >>= 8;
+	};
+};
+
+static uint8_t cmd_get(uint8_t id, int32_t * v)
+{
+	switch (id)
+	{
+	    case PARAM_PPS_TOL:
+		*v = pps_tol;
+		break;
+	    case PARAM_RLOG:
+		*v = pps_rlog;
+		break;
+	    case PARAM_TAU_COARSE:
+	    case PARAM_TAU_ACQ:
+	    case PARAM_TAU_TRK:
+		*v = disc_tau[id - PARAM_TAU_COARSE] + 0.5f;
+		break;
+	    case PARAM_ZETA:
+		*v = disc_zeta * 1000 + 0.5f;
+		break;
+	    case PARAM_KD:
+		*v = disc_kd_set;
+		break;
+	    case PARAM_TEMP_ON:
+		*v = temp_on;
+		break;
+	    case PARAM_CPU_HZ:
+		*v = cpu_hz;
+		break;
+	    case PARAM_STREAM:
+		*v = stream_batch;
+		break;
+	    default:
+		return CMD_EID;
+	};
+	return CMD_OK;
+};
+
+static uint8_t cmd_set(uint8_t id, int32_t v)
+{
+	float tau[3] = { disc_tau[0], disc_tau[1], disc_tau[2] };
+
+	switch (id)
+	{
+	    case PARAM_PPS_TOL:
+		if (v < 1 || v > 1000000)
+		{
+		    return CMD_ERANGE;
+		};
+		pps_tol = v;
+		pps_clock(cpu_hz);
+		break;
+	    case PARAM_RLOG:
+		if (v < OCXO_MINDELTA || v > OCXO_MAXDELTA)
+		{
+		    return CMD_ERANGE;
+		};
+		pps_rlog = v;
+		break;
+	    case PARAM_TAU_COARSE:
+	    case PARAM_TAU_ACQ:
+	    case PARAM_TAU_TRK:
+		if (v < 1 || v > 65535)
+		{
+		    return CMD_ERANGE;
+		};
+		tau[id - PARAM_TAU_COARSE] = v;
+		disc_config(tau[0], tau[1], tau[2], disc_zeta, disc_kd_set);
+		break;
+	    case PARAM_ZETA:
+		if (v < 1 || v > 10000)
+		{
+		    return CMD_ERANGE;
+		};
+		disc_config(tau[0], tau[1], tau[2], v / 1000.0f, disc_kd_set);
+		break;
+	    case PARAM_KD:
+		if (v < 0 || v > 10000000)
+		{
+		    return CMD_ERANGE;
+		};
+		disc_config(tau[0], tau[1], tau[2], disc_zeta, v);
+		break;
+	    case PARAM_TEMP_ON:
+		if (v < 0 || v > 1)
+		{
+		    return CMD_ERANGE;
+		};
+		temp_on = v;
+		if (disc_mode >= DISC_COARSE)
+		{
+		    disc_efc();
+		};
+		break;
+	    case PARAM_CPU_HZ:
+		return CMD_ERO;
+	    case PARAM_STREAM:
+		if (v < 0 || v > 255)
+		{
+		    return CMD_ERANGE;
+		};
+		stream_set(v);
+		break;
+	    default:
+		return CMD_EID;
+	};
+	return CMD_OK;
+};
+
+static uint8_t cmd_stats(struct spi_buf * buf, uint8_t block)
+{
+	switch (block)
+	{
+	    case STATS_PPS:
+		cmd_put(buf, pps_secs, 4);
+		cmd_put(buf, pps_missed, 2);
+		cmd_put(buf, pps_glitch, 2);
+		cmd_put(buf, pps_resync, 2);
+		cmd_put(buf, pps_outlier, 2);
+		cmd_put(buf, pps_reacq, 2);
+		break;
+	    case STATS_SPI:
+		cmd_put(buf, spi_crcerr, 2);
+		cmd_put(buf, spi_dropped, 2);
+		cmd_put(buf, spi_seq, 1);
+		break;
+	    case STATS_LOOP:
+		cmd_put(buf, disc_mode, 1);
+		cmd_put(buf, disc_changes, 2);
+		cmd_put(buf, disc_tlock, 4);
+		cmd_put(buf, hold_count, 2);
+		cmd_put(buf, kal_n, 4);
+		break;
+	    case STATS_STREAM:
+		cmd_put(buf, stream_records, 4);
+		cmd_put(buf, stream_frames, 4);
+		cmd_put(buf, stream_bytes, 4);
+		break;
+	    case STATS_EVENT:
+		{
+		    uint16_t lost;
+		    uint8_t peak;
+
+		    event_stats(&lost, &peak);
+		    cmd_put(buf, lost, 2);
+		    cmd_put(buf, peak, 1);
+		};
+		break;
+	    default:
+		return CMD_EID;
+	};
+	return CMD_OK;
+};
+
+void cmd_query(uint8_t type, uint8_t req, uint8_t * data, uint8_t len)
+// SPI master sent a command of this type in frame req, with len bytes of
+// data after the type
+{
+	struct spi_buf * buf;
+	uint8_t * status;
+	int32_t v;
+
+	// The master is waiting for this, so it goes before any reports
+	if (!(buf = spi_replybuf()))
+	{
+	    return;
+	};
+	*(buf->ptr++) = type;
+	*(buf->ptr++) = req;
+	status = (uint8_t *)buf->ptr++;
+	*status = CMD_OK;
+	switch (type)
+	{
+	    case SPICMD_GET:
+	    case SPICMD_SET:
+		if (len != (type == SPICMD_GET ? 1 : 5))
+		{
+		    *status = CMD_ELEN;
+		    break;
+		};
+		if (type == SPICMD_SET)
+		{
+		    *status = cmd_set(data[0], data[1] | (uint32_t)data[2] << 8 | (uint32_t)data[3] << 16 | (uint32_t)data[4] << 24);
+		};
+		v = 0;
+		if (*status != CMD_EID)
+		{
+		    uint8_t got = cmd_get(data[0], &v);
+
+		    if (type == SPICMD_GET)
+		    {
+			*status = got;
+		    };
+		};
+		*(buf->ptr++) = data[0];
+		cmd_put(buf, v, 4);
+		break;
+	    case SPICMD_STATS:
+		if (len != 1)
+		{
+		    *status = CMD_ELEN;
+		    break;
+		};
+		*(buf->ptr++) = data[0];
+		*status = cmd_stats(buf, data[0]);
+		break;
+	    case SPICMD_RESET:
+		pps_missed = 0;
+		pps_glitch = 0;
+		pps_resync = 0;
+		pps_outlier = 0;
+		pps_reacq = 0;
+		spi_crcerr = 0;
+		spi_dropped = 0;
+		disc_changes = 0;
+		hold_count = 0;
+		stream_records = 0;
+		stream_frames = 0;
+		stream_bytes = 0;
+		event_clear();
+		break;
+	    case SPICMD_VERSION:
+		*(buf->ptr++) = CMD_VERSION_MAJOR;
+		*(buf->ptr++) = CMD_VERSION_MINOR;
+		cmd_put(buf, (DISC_KALMAN ? CAP_KALMAN : 0) | (TEMP_COMP ? CAP_TEMP : 0) | (RC_TRIM ? CAP_RC : 0)
+			| (TIME_TICKLESS ? CAP_TICKLESS : 0) | (CPU_MEASURE ? CAP_CPU_MEASURE : 0), 2);
+		*(buf->ptr++) = SPIBUF_DLEN;
+		cmd_put(buf, cpu_hz, 4);
+		break;
+	    default:
+		buf->buf[0] = SPICMD_ERROR;
+		*status = CMD_ETYPE;
+		*(buf->ptr++) = type;
+		break;
+	};
+	spi_tx_queue(buf);
+};
@@ -0,0 +1,72 @@
+/*
+ * cmd.h
+ *
+ *  Created on: October 15, 2026
+ *  Request/response commands from the SPI master: parameters, statistics, version
+ */
+
+/*
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+*/
+
+#ifndef CMD_H_
+#define CMD_H_
+
+#include <stdint.h>
+
+#define CMD_VERSION_MAJOR 1
+#define CMD_VERSION_MINOR 1
+
+// Reply status
+#define CMD_OK 0
+#define CMD_EID 1			// No such parameter or block
+#define CMD_ERANGE 2			// Value out of range, not set
+#define CMD_ERO 3			// Parameter is read only
+#define CMD_ELEN 4			// Command the wrong length
+#define CMD_ETYPE 5			// No such command
+
+// Parameters, 4 byte values
+#define PARAM_PPS_TOL 1			// PPS tolerance, ppm
+#define PARAM_RLOG 2			// Log 2 of the reporting interval, now
+#define PARAM_TAU_COARSE 3		// Loop time constants, seconds
+#define PARAM_TAU_ACQ 4
+#define PARAM_TAU_TRK 5
+#define PARAM_ZETA 6			// Damping, thousandths
+#define PARAM_KD 7			// Derivative gain, codes per Hz
+#define PARAM_TEMP_ON 8			// Temperature correction on
+#define PARAM_CPU_HZ 9			// CPU clock, Hz (read only)
+#define PARAM_STREAM 10			// Capture records per frame (0 = off)
+
+// Statistics blocks
+#define STATS_PPS 0
+#define STATS_SPI 1
+#define STATS_LOOP 2
+#define STATS_STREAM 3
+#define STATS_EVENT 4
+
+// Capabilities, in the version reply
+#define CAP_KALMAN 0x01			// Steering from the Kalman filter
+#define CAP_TEMP 0x02			// Temperature correction
+#define CAP_RC 0x04			// Trimming the RC oscillator
+#define CAP_TICKLESS 0x08		// Tickless timer
+#define CAP_CPU_MEASURE 0x10		// CPU clock measured at boot
+
+void cmd_query(uint8_t, uint8_t, uint8_t *, uint8_t);
+
+#endif /* CMD_H_ */
@@ -38,6 +38,34 @@
 #define F_CPU 4000000				// Old crystal - 4.000445 MHz
 //#define F_CPU 7023000				// Crystal from Pixie Transceiver
 
+// The CPU clock is measured from PPS at boot (cpu.c), so F_CPU above need only be near enough to
+// start the timers and serial port. CPU_CAL intervals in a row that agree to 1 part in CPU_AGREE
+// and are between CPU_MIN and CPU_MAX cycles set it, rounded to CPU_ROUND Hz. CPU_MEASURE 0 uses F_CPU.
+#define CPU_MEASURE 1
+#define CPU_CAL 4				// Intervals that agree
+#define CPU_AGREE 10000				// 100ppm
+#define CPU_MIN 100000				// Slowest clock, Hz
+#define CPU_MAX 20000000			// Fastest, Hz
+#define CPU_ROUND 1000				// Nominal clocks are whole kHz
+
+// Internal RC oscillator (rc.c). On a board with no crystal, RC_TRIM 1 trims OSCCAL from PPS so the
+// CPU runs at RC_HZ on average: a search at boot from the factory OSCCAL, then switching between two
+// adjacent steps. If a step gains or loses the wrong way RC_RUN seconds in a row, the pair moves.
+// There is no EFC to steer on such a board, so disciplining and temperature compensation are left out.
+#define RC_TRIM 0
+#define RC_HZ 8000000				// Frequency to trim to
+#define RC_RUN 3				// Seconds a step goes the wrong way before the pair moves
+#define RC_STEP 2				// Most OSCCAL steps (about 0.5% each) the search moves in a second
+
+// SPI data ready. SPI_DRDY 1 drives PB3 (pin 4) high while the MCU has frames to send, for the Pi
+// to wait on (a GPIO input, e.g. GPIO25) instead of polling.
+#define SPI_DRDY 1
+
+// Capture stream (stream.c). With STREAM_BATCH above 0, every pulse's raw error (cycles +/- the
+// whole seconds) goes to the SPI master, up to STREAM_BATCH of them delta and zigzag varint coded
+// in one frame. SPI command PARAM_STREAM changes it.
+#define STREAM_BATCH 0
+
 /*
  * Oven controlled oscillator parameters. Warmup time is from system boot and no adjustments will be made until that time has passed unless
  * the software has been signalled somehow (e.g. by a switch attached to a processor pin) that the oscillator is already warm. OCXO_MINDELTA
@@ -59,6 +87,46 @@
 
 #define OCXO_TIMER 1				// Use timer 1 for OCXO control
 
+// Disciplining loop (disc.c). The EFC is a 16 bit code from the PWM DAC on Timer 2; DISC_KV is the
+// frequency change per code, from OCXO_RANGE (sign: a higher code raises the frequency). The loop is
+// a second order PLL on the phase with time constant DISC_TAU_* seconds and damping DISC_ZETA.
+// DISC_KD is an optional derivative (frequency) gain, codes per Hz. After OCXO_WARMUP it acquires
+// coarse then fine, and is locked once the phase error stays inside DISC_LOCKED; it drops back a
+// state when the error grows past DISC_HYST times a threshold.
+#define DISC_KV (2.0 * OCXO_RANGE / 65536)	// Hz per EFC code
+#define DISC_TAU_COARSE 16			// Time constant for coarse acquisition, seconds
+#define DISC_TAU_ACQ 64				// Time constant while acquiring, seconds
+#define DISC_TAU_TRK 512			// Time constant once locked, seconds
+#define DISC_ZETA 0.707				// Damping
+#define DISC_KD 0				// Derivative gain, codes per Hz
+#define DISC_LOCKED (4 * OCXO_JITTER)		// Phase error (cycles) for tracking gains
+#define DISC_LOCK_N 8				// after this many updates
+#define DISC_ACQUIRED (4 * DISC_LOCKED)		// Phase error (cycles) for fine acquisition
+#define DISC_HYST 4				// Drop back outside this times the threshold
+
+// Kalman filter on the PPS phase (kalman.c). Noise parameters are log 2 in half steps: L means
+// 2^(L/2), in cycles^2 for the measurement and cycles^2, (cycles/s)^2 and (cycles/s^2)^2 per
+// second for the phase, frequency and drift. DISC_KALMAN 1 steers from its phase instead of pps_phase.
+#define KAL_TLOG 10				// Log 2 of its time unit, seconds
+#define KAL_GAP 64				// Longest gap (seconds) it carries on over
+#define KAL_R 4					// 4 cycles^2, 2 cycles rms
+#define KAL_Q0 (-58)				// White FM, 1e-11 at 4MHz
+#define KAL_Q1 (-85)				// Random walk FM
+#define KAL_Q2 (-120)				// Drift
+#define DISC_KALMAN 0
+
+// Temperature compensation (temp.c). A thermistor divider on ADC channel TEMP_MUX is read against AVcc
+// 4^TEMP_OVS times, on each Timer 1 overflow, for a reading of 10 + TEMP_OVS bits. While locked the EFC
+// code is regressed on it over TEMP_TAU seconds, and once there have been TEMP_MIN_N updates and the
+// reading has varied by more than TEMP_MINVAR (mean square, reading steps), TEMP_COMP 1 corrects the
+// EFC for the temperature.
+#define TEMP_MUX 7				// ADC7, PA7 (pin 33)
+#define TEMP_OVS 3				// 64 conversions, 13 bits
+#define TEMP_TAU 16384				// Regression time constant, seconds
+#define TEMP_MIN_N 16				// Updates before the slope is used
+#define TEMP_MINVAR 64				// Spread of readings (8 steps rms) before it is used
+#define TEMP_COMP 1
+
 // Define some LEDs to play with
 #define LED_port PORTA				// This for testing
 #define LED_ddr  DDRA				// This direction
@@ -71,6 +139,10 @@
 
 #define LED_pinr PINA				// Pin input (on 1284P, inverts data bit)
 
+// Scheduler. In tickless mode Timer0 is only asked to interrupt when the next timer
+// is due (or when the 8 bit counter can go no further), instead of every 10ms tick.
+#define TIME_TICKLESS 1
+
 // Serial port requirements
 #define NUM_USARTS 1				// Number of serial ports used (varies by processor)
 #define USART1_BPS 4800
@@ -0,0 +1,109 @@
+/*
+ * cpu.c
+ *
+ *  Created on: October 15, 2026
+ *  The CPU clock, measured from PPS at boot
+ */
+
+/*
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+*/
+
+#include <avr/io.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "time.h"
+#include "serial.h"
+#include "pps.h"
+#include "temp.h"
+#include "cpu.h"
+
+/*
+ Everything that counts CPU cycles needs to know how many there are in a
+ second: the Timer0 prescaler and compare intervals for the 10ms tick, the
+ USART baud rate divisor, the ADC clock prescaler, and the PPS tolerance
+ and the nominal count each interval is measured against. Rather than
+ build an image for each crystal, the clock is measured from the first PPS
+ seconds after boot and they are all set up from that.
+
+ Until then the firmware runs on F_CPU from config.h, which only has to
+ be near enough for the timers and serial port to be usable. pps.c passes
+ the cycles between each pulse and the last here (cpu_measure()) instead
+ of measuring phase. CPU_CAL intervals in a row that agree to within 1
+ part in CPU_AGREE, and are in the range the part can run at, set the
+ clock: their mean, rounded to the nearest CPU_ROUND Hz, as the clock is
+ meant to be disciplined to its nominal frequency, not to where it
+ happens to be. A missed or doubled pulse just starts the count again.
+ cpu_set() then sets up each module for the new clock, and the PPS
+ measurements start from the last pulse.
+
+ CPU_MEASURE 0 in config.h keeps the old behaviour of trusting F_CPU.
+*/
+
+uint32_t cpu_hz = F_CPU;		// CPU clock, Hz
+uint8_t  cpu_known = 1;			// cpu_hz has been measured (or was given)
+
+static uint32_t cpu_prev;		// Last interval, cycles
+static uint32_t cpu_sum;		// Sum of the intervals that agree
+static uint8_t  cpu_n;			// and how many
+
+void cpu_init(uint32_t hz)
+// Run at hz, or if 0, at F_CPU until the clock has been measured
+{
+	cpu_hz = hz ? hz : F_CPU;
+	cpu_known = hz != 0;
+	cpu_n = 0;
+};
+
+uint8_t cpu_measure(uint32_t delta)
+// Called by pps_report() with the cycles since the last pulse, until the
+// clock is known. Returns 1 once it is.
+{
+	if (delta < CPU_MIN || delta > CPU_MAX)
+	{
+	    cpu_n = 0;
+	    return 0;
+	};
+	if (!cpu_n || delta > cpu_prev + cpu_prev / CPU_AGREE || delta < cpu_prev - cpu_prev / CPU_AGREE)
+	{
+	    cpu_sum = 0;
+	    cpu_n = 0;
+	};
+	cpu_prev = delta;
+	cpu_sum += delta;
+	if (++cpu_n < CPU_CAL)
+	{
+	    return 0;
+	};
+	cpu_set((cpu_sum / CPU_CAL + CPU_ROUND / 2) / CPU_ROUND * CPU_ROUND);
+	return 1;
+};
+
+void cpu_set(uint32_t hz)
+// The clock is hz: set up everything that depends on it
+{
+	cpu_hz = hz;
+	cpu_known = 1;
+	cpu_n = 0;
+	time_clock(hz);
+	serial_clock(hz);
+	pps_clock(hz);
+	temp_clock(hz);
+};
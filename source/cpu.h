@@ -0,0 +1,40 @@
+/*
+ * cpu.h
+ *
+ *  Created on: October 15, 2026
+ *  The CPU clock, measured from PPS at boot
+ */
+
+/*
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+*/
+
+#ifndef CPU_H_
+#define CPU_H_
+
+#include <stdint.h>
+
+extern uint32_t cpu_hz;			// CPU clock, Hz
+extern uint8_t  cpu_known;		// cpu_hz has been measured (or was given)
+
+void cpu_init(uint32_t);
+uint8_t cpu_measure(uint32_t);
+void cpu_set(uint32_t);
+
+#endif /* CPU_H_ */
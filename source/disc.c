@@ -0,0 +1,336 @@
+/*
+ * disc.c
+ *
+ *  Created on: October 15, 2026
+ *  Disciplining the oscillator to GPS: PI(D) control of the EFC
+ */
+
+/*
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+*/
+
+#include "config.h"
+
+#include <avr/io.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "pps.h"
+#include "spi.h"
+#include "efc.h"
+#include "disc.h"
+#include "hold.h"
+#include "temp.h"
+
+/*
+ The CPU runs from the oscillator, so the PPS phase (pps_phase, cycles) is
+ the oscillator's time error, and the frequency error is its slope.
+ Changing the EFC code u by one changes the frequency by DISC_KV Hz, so the
+ loop is the usual second order PLL:
+
+	dx/dt = y0 + Kv.u,	u = -(Kp.x + Ki.integral(x) + Kd.y)
+
+ which with Kp = 2.zeta/(tau.Kv) and Ki = 1/(tau^2.Kv) has natural
+ frequency 1/tau and damping zeta. It is run in velocity form: each update
+ adds the change in the controller output to u,
+
+	u += -Kp.(x - x') - Ki.T.x - Kd.(y - y')
+
+ and u is clamped to the range of the DAC. Gains can change between
+ updates without a bump. The integrator here is u itself, which is clamped,
+ plus the phase, which the oscillator integrates: while u is held at a
+ limit and the phase is still moving the wrong way, the phase reference
+ moves with it, so that an oscillator
+ that was out of range doesn't come back with a large phase error to be
+ paid back by swinging to the other side (no windup).
+
+ The loop is updated every T = 2^n seconds, the PPS reporting interval or
+ tau/8 if that is shorter, so it is well sampled. The phase is measured
+ from where it was when the loop started, or restarted after PPS had to
+ resync.
+
+ Lock states. The loop goes through:
+
+	DISC_WARM	the EFC is held while the oscillator warms up, for
+			the first OCXO_WARMUP seconds of PPS
+	DISC_COARSE	acquiring with the short DISC_TAU_COARSE gains
+			(updates every 2s), to pull in a large offset fast
+	DISC_ACQ	fine acquisition with the DISC_TAU_ACQ gains
+	DISC_TRK	locked, DISC_TAU_TRK gains (updates every 64s)
+	DISC_HOLD	no PPS, steered by hold.c
+
+ Each of COARSE and ACQ is left for the next once the phase error has
+ been inside its threshold (DISC_ACQUIRED, DISC_LOCKED) for DISC_LOCK_N
+ updates in a row, and ACQ and TRK drop back a state if it grows to
+ DISC_HYST times the threshold of the one below, so the state doesn't
+ chatter at a boundary. While locked, the code is also passed to hold.c,
+ which steers in its place if the pulses stop, and to temp.c, which
+ learns how it follows the temperature and adds a correction for it to
+ what is put out. When they come back the
+ phase error built up in holdover is left behind: the loop starts
+ measuring afresh, locked unless the error was large.
+
+ The pps_secs each state was last entered is kept, and the first time
+ the loop locked, which is the time to lock from power up (near enough:
+ pps_secs starts with the first pulse). Each change is sent to the SPI
+ master (SPICMD_LOCK), with a figure of merit for the lock from 0 (not
+ steering) to 100: up to 50 while acquiring or in holdover, and 50 to
+ 100 when locked, less as the rms phase error nears DISC_LOCKED.
+*/
+
+uint8_t disc_mode;			// DISC_OFF ... DISC_HOLD
+uint32_t disc_at[DISC_MODES];		// pps_secs each state was last entered
+uint32_t disc_tlock;			// pps_secs it first locked (0 = not yet)
+uint16_t disc_changes;			// State changes
+uint16_t disc_warm;			// Warm up time, seconds
+float   disc_xvar;			// Mean square phase error, cycles^2
+int32_t disc_x;				// Phase error at the last update, cycles
+float   disc_y;				// Frequency error over it, Hz
+float   disc_u;				// EFC code, before rounding
+int64_t disc_x0;			// pps_phase for zero phase error
+uint32_t disc_secs;			// pps_secs at the last update
+uint8_t disc_valid;			// disc_x0, disc_secs have been set
+uint8_t disc_tlog;			// Log 2 of the longest update interval
+uint8_t disc_good;			// Updates in a row inside the threshold
+float   disc_kp;			// Gains, codes per cycle
+float   disc_ki;			// codes per cycle second
+float   disc_kd;			// codes per Hz
+
+// Loop settings, DISC_* from config.h unless changed by disc_config()
+float   disc_tau[3];			// Time constants: coarse, fine, locked, seconds
+float   disc_zeta;			// Damping
+float   disc_kd_set;			// Derivative gain, codes per Hz
+
+// Thresholds for leaving DISC_COARSE and DISC_ACQ upwards, cycles
+static const int32_t disc_lim[2] = { DISC_ACQUIRED, DISC_LOCKED };
+
+static void disc_gains(void);
+
+void disc_init(uint16_t code, uint16_t warm)
+// Start steering from EFC code, after warm seconds of PPS
+{
+	disc_u = code;
+	efc_init(code);
+	disc_warm = warm;
+	disc_tlock = 0;
+	disc_changes = 0;
+	disc_xvar = 0;
+	disc_config(DISC_TAU_COARSE, DISC_TAU_ACQ, DISC_TAU_TRK, DISC_ZETA, DISC_KD);
+	disc_enter(warm ? DISC_WARM : DISC_COARSE, 0);
+	disc_restart();
+	hold_init();
+};
+
+void disc_config(float tau_coarse, float tau_acq, float tau_trk, float zeta, float kd)
+// Set the time constants (seconds), damping and derivative gain
+{
+	disc_tau[0] = tau_coarse;
+	disc_tau[1] = tau_acq;
+	disc_tau[2] = tau_trk;
+	disc_zeta = zeta;
+	disc_kd_set = kd;
+	disc_gains();
+};
+
+void disc_enter(uint8_t mode, uint32_t secs)
+// Change state at pps_secs secs
+{
+	disc_mode = mode;
+	disc_at[mode] = secs;
+	disc_good = 0;
+	if (mode == DISC_TRK && !disc_tlock)
+	{
+	    disc_tlock = secs ? secs : 1;
+	};
+	disc_changes++;
+	disc_gains();
+	disc_report();
+};
+
+uint8_t disc_quality(void)
+// Figure of merit for the lock, 0 to 100
+{
+	float r;
+
+	switch (disc_mode)
+	{
+	    case DISC_COARSE:
+		return 10;
+	    case DISC_ACQ:
+		return 30;
+	    case DISC_TRK:
+		r = disc_xvar / ((float)DISC_LOCKED * DISC_LOCKED);
+		return r < 1 ? 100 - 50 * r : 50;
+	    case DISC_HOLD:
+		r = hold_te / DISC_LOCKED;
+		return r < 1 ? 50 - 50 * r : 0;
+	};
+	return 0;
+};
+
+void disc_report(void)
+// Message is: SPICMD_LOCK, state, figure of merit, pps_secs the state was
+// entered, pps_secs now, pps_secs it first locked (0 = not yet), all 4
+// bytes, state changes (2 bytes), rms phase error (cycles, 2 bytes), all
+// little endian. Also sent when asked (SPICMD_LOCK).
+{
+	struct spi_buf * buf;
+	uint32_t v[3];
+	float r = sqrtf(disc_xvar);
+
+	if (!(buf = spi_evbuf()))
+	{
+	    return;
+	};
+	v[0] = disc_at[disc_mode];
+	v[1] = pps_secs;
+	v[2] = disc_tlock;
+	*(buf->ptr++) = SPICMD_LOCK;
+	*(buf->ptr++) = disc_mode;
+	*(buf->ptr++) = disc_quality();
+	for (uint8_t i = 0; i < 3; i++)
+	{
+	    *(buf->ptr++) = v[i] & 0xFF;
+	    *(buf->ptr++) = (v[i] >>  8) & 0xFF;
+	    *(buf->ptr++) = (v[i] >> 16) & 0xFF;
+	    *(buf->ptr++) = (v[i] >> 24) & 0xFF;
+	};
+	*(buf->ptr++) = disc_changes & 0xFF;
+	*(buf->ptr++) = disc_changes >> 8;
+	v[0] = r < 0xFFFF ? r + 0.5f : 0xFFFF;
+	*(buf->ptr++) = v[0] & 0xFF;
+	*(buf->ptr++) = v[0] >> 8;
+	spi_tx_queue(buf);
+};
+
+void disc_efc(void)
+// Put out the loop's code, corrected for the temperature
+{
+	float u = disc_u + temp_ff();
+
+	efc_set(u < 0 ? 0 : u > 0xFFFF ? 0xFFFF : u + 0.5f);
+};
+
+static void disc_gains(void)
+// Gains and update interval for the time constant of the current state
+{
+	float tau = disc_tau[disc_mode <= DISC_COARSE ? 0 : disc_mode >= DISC_TRK ? 2 : 1];
+
+	disc_kp = 2 * disc_zeta / (tau * DISC_KV);
+	disc_ki = 1 / (tau * tau * DISC_KV);
+	disc_kd = disc_kd_set;
+	for (disc_tlog = 0; (2UL << disc_tlog) <= tau / 8; disc_tlog++)
+	    ;
+};
+
+void disc_restart(void)
+// Measure the phase afresh from the next pulse. The EFC stays as it is.
+{
+	disc_valid = 0;
+	disc_good = 0;
+};
+
+void disc_pps(int64_t phase, uint32_t secs)
+// Called by pps_report() with the phase and seconds after each good pulse
+{
+	uint8_t tlog = pps_rlog < disc_tlog ? pps_rlog : disc_tlog;
+	uint32_t t;
+	int32_t x;
+	int64_t te;
+	uint8_t m;
+	float y;
+
+	if (!disc_mode)
+	{
+	    return;
+	};
+	if (disc_mode == DISC_HOLD)
+	{
+	    te = phase - disc_x0 - disc_x;
+	    disc_enter(hold_end(te > 0x7FFFFFFF ? 0x7FFFFFFF : te < -0x7FFFFFFF ? -0x7FFFFFFF : te)
+		? DISC_ACQ : DISC_TRK, secs);
+	    disc_restart();
+	};
+	if (disc_mode == DISC_WARM)
+	{
+	    if (secs < disc_warm)
+	    {
+		return;
+	    };
+	    disc_enter(DISC_COARSE, secs);
+	    disc_restart();
+	};
+	if (!disc_valid)
+	{
+	    disc_x0 = phase;
+	    disc_secs = secs;
+	    disc_x = 0;
+	    disc_y = 0;
+	    disc_valid = 1;
+	    return;
+	};
+	t = secs - disc_secs;
+	if (t < 1UL << tlog)
+	{
+	    return;
+	};
+	phase -= disc_x0;
+	x = phase > 0x40000000 ? 0x40000000 : phase < -0x40000000 ? -0x40000000 : phase;
+	y = (float)(x - disc_x) / t;
+	if (disc_mode == DISC_TRK)
+	{
+	    hold_lock(disc_u, secs, t);
+	    temp_lock(disc_u, t);
+	};
+
+	// At a limit of the DAC with the phase still going the wrong way, the
+	// oscillator is out of range: stop the phase error building up for
+	// when it comes back
+	disc_u -= disc_kp * (x - disc_x) + disc_ki * t * x + disc_kd * (y - disc_y);
+	if (disc_u < 0 || disc_u > 0xFFFF)
+	{
+	    if (disc_u < 0 ? x > disc_x : x < disc_x)
+	    {
+		disc_x0 += x - disc_x;
+		x = disc_x;
+	    };
+	    disc_u = disc_u < 0 ? 0 : 0xFFFF;
+	};
+	disc_efc();
+	disc_x = x;
+	disc_y = y;
+	disc_secs = secs;
+
+	disc_xvar += ((float)x * x - disc_xvar) / 8;
+
+	// Up a state after DISC_LOCK_N updates inside its threshold, down
+	// one if outside DISC_HYST times the threshold of the one below
+	m = disc_mode - DISC_COARSE;
+	if (m && (x > DISC_HYST * disc_lim[m - 1] || x < -DISC_HYST * disc_lim[m - 1]))
+	{
+	    disc_enter(disc_mode - 1, secs);
+	} else if (m < 2 && x <= disc_lim[m] && x >= -disc_lim[m]) {
+	    if (++disc_good >= DISC_LOCK_N)
+	    {
+		disc_enter(disc_mode + 1, secs);
+	    };
+	} else {
+	    disc_good = 0;
+	};
+};
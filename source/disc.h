@@ -0,0 +1,62 @@
+/*
+ * disc.h
+ *
+ *  Created on: October 15, 2026
+ *  Disciplining the oscillator to GPS: PI(D) control of the EFC
+ */
+
+/*
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+*/
+
+#ifndef DISC_H_
+#define DISC_H_
+
+#include <stdint.h>
+
+// Lock states, in order
+#define DISC_OFF 0			// Not steering
+#define DISC_WARM 1			// Warming up, EFC held
+#define DISC_COARSE 2			// Coarse acquisition, DISC_TAU_COARSE gains
+#define DISC_ACQ 3			// Fine acquisition, DISC_TAU_ACQ gains
+#define DISC_TRK 4			// Locked, DISC_TAU_TRK gains
+#define DISC_HOLD 5			// No PPS, steered by hold.c
+#define DISC_MODES 6
+
+extern uint8_t disc_mode;
+extern uint32_t disc_at[DISC_MODES];	// pps_secs each state was last entered
+extern uint32_t disc_tlock;		// pps_secs it first locked (0 = not yet)
+extern uint16_t disc_changes;		// State changes
+extern int32_t disc_x;			// Phase error at the last update, cycles
+extern float   disc_y;			// Frequency error over it, Hz
+extern float   disc_u;			// EFC code, before rounding
+extern float   disc_tau[3];		// Time constants: coarse, fine, locked, seconds
+extern float   disc_zeta;		// Damping
+extern float   disc_kd_set;		// Derivative gain, codes per Hz
+
+void disc_init(uint16_t, uint16_t);
+void disc_config(float, float, float, float, float);
+void disc_enter(uint8_t, uint32_t);
+uint8_t disc_quality(void);
+void disc_report(void);
+void disc_efc(void);
+void disc_restart(void);
+void disc_pps(int64_t, uint32_t);
+
+#endif /* DISC_H_ */
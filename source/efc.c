@@ -0,0 +1,100 @@
+/*
+ * efc.c
+ *
+ *  Created on: October 15, 2026
+ *  Electronic frequency control (EFC) output to the oscillator
+ */
+
+/*
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+*/
+
+#include "config.h"
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <stdint.h>
+
+#include "gpsdo.h"
+#include "efc.h"
+
+/*
+ The EFC voltage comes from Timer 2 in fast PWM mode on OC2, smoothed by an
+ RC filter. 8 bits of PWM alone would move the frequency in steps of
+ 2 * OCXO_RANGE / 256 (0.02Hz, 5 parts in 10^9 at 4MHz), so the code is 16
+ bits: the top 8 set the duty cycle and the low 8 are added up by a first
+ order sigma-delta modulator, one step per PWM period, each carry lengthening
+ that period's pulse by one count. Over any 256 periods the average is then
+ exactly code/65536 of the supply. The pattern repeats at least every
+ 256 periods, F_CPU/8/256/256 (7.6Hz at 4MHz), well above what an RC filter
+ of a second or more passes. The overflow interrupt that runs the modulator
+ costs a few dozen cycles every 2048, about 2% of the CPU. It leaves the
+ background nothing to do, so the main loop goes straight back to sleep
+ (gpsdo.c) rather than running the dispatchers 1950 times a second at
+ 4MHz.
+
+ OC2 is inverted (set on compare match, cleared at BOTTOM) so that
+ OCR2 = 255 - n gives a duty cycle of exactly n/256, from 0 to 255/256.
+ The one code that would need a carry into 256/256 (0xFF00 and up with a
+ carry) loses it, so codes above 0xFF00 all give 0xFF00.
+*/
+
+volatile uint8_t efc_hi;		// Duty cycle, 256ths
+volatile uint8_t efc_lo;		// Fraction added each period
+uint8_t efc_acc;			// Modulator accumulator
+
+void efc_init(uint16_t code)
+// Start the PWM at code
+{
+	efc_set(code);
+	efc_acc = 0;
+	OCR2 = ~efc_hi;
+	// Fast PWM, inverted output, clock F_CPU/8
+	TCCR2 = 1<<WGM20 | 1<<WGM21 | 1<<COM21 | 1<<COM20 | 1<<CS21;
+	DDRD |= 1<<EFC_PIN;
+	sbi(TIMSK, TOIE2);
+};
+
+void efc_set(uint16_t code)
+{
+	cbi(TIMSK, TOIE2);
+	efc_hi = code >> 8;
+	efc_lo = code;
+	sbi(TIMSK, TOIE2);
+};
+
+uint16_t efc_get(void)
+// The code the output actually gives, on average
+{
+	return efc_hi == 0xFF ? 0xFF00 : efc_hi << 8 | efc_lo;
+};
+
+ISR(TIMER2_OVF_vect)
+// Start of a PWM period: the OCR2 written now is used for the next one
+{
+	uint8_t n = efc_hi;
+	uint8_t acc = efc_acc + efc_lo;
+
+	if (acc < efc_acc && n != 0xFF)
+	{
+	    n++;
+	};
+	efc_acc = acc;
+	OCR2 = ~n;
+}
@@ -0,0 +1,40 @@
+/*
+ * efc.h
+ *
+ *  Created on: October 15, 2026
+ *  Electronic frequency control (EFC) output to the oscillator
+ */
+
+/*
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+*/
+
+#ifndef EFC_H_
+#define EFC_H_
+
+#include <stdint.h>
+
+#define EFC_PIN PORTD7			// OC2, to the EFC through an RC filter
+#define EFC_MID 0x8000			// Code for the middle of the range
+
+void efc_init(uint16_t);
+void efc_set(uint16_t);
+uint16_t efc_get(void);
+
+#endif /* EFC_H_ */
@@ -0,0 +1,143 @@
+/*
+ * event.c
+ *
+ *  Created on: October 15, 2026
+ *  Hands events from interrupt handlers to the background in the order
+ *  they happened.
+ */
+
+/*
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+*/
+
+#include "config.h"
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <stdint.h>
+#include "gpsdo.h"
+#include "event.h"
+
+/* Event Ring
+
+	isr_fork() in time.c borrows from the timer pool, so an ISR that
+	forks while the timers are busy loses its event. The event ring is
+	a fixed array of EVENT_NUM slots for ISRs alone.
+
+	Only ISRs add events and only the background removes them, so each
+	index has a single writer. event_head is moved on by the ISR once the
+	slot is filled in, and event_tail by the background once the callback
+	has returned. Both are single bytes, which the AVR reads and writes
+	in one instruction, so neither side needs to disable interrupts and
+	the background never holds off a capture. The indexes run freely and
+	are masked when used, so head - tail is the number of events waiting.
+
+	When the ring is full the event is counted in event_lost rather
+	than silently dropped, and event_peak records the most events ever
+	waiting, to show how close the ring has come to filling.
+
+	Producer (ISR, interrupts disabled):
+
+		if (ev = event_alloc())
+		{
+		    ev->ev_ufn = ...;
+		    ...
+		    event_post();
+		}
+*/
+
+// Compiler barrier: the slot must be written before the index says so
+#define barrier() __asm__ __volatile__ ("" ::: "memory")
+
+	 struct event event_ring[EVENT_NUM];
+
+volatile uint8_t event_head;
+volatile uint8_t event_tail;
+
+volatile uint16_t event_lost;			// Events dropped, ring full
+volatile uint8_t event_peak;			// Most events ever waiting
+
+struct event * event_alloc(void)
+// Called from an ISR. Returns the slot to fill in, or 0 if the ring is full.
+// Nothing is passed to the background until event_post() is called.
+{
+	uint8_t used = event_head - event_tail;
+
+	if (used >= EVENT_NUM)
+	{
+	    if (event_lost != 0xFFFF)
+	    {
+		event_lost++;
+	    };
+	    return 0;
+	};
+	if (used >= event_peak)
+	{
+	    event_peak = used + 1;
+	};
+	return &event_ring[event_head & (EVENT_NUM - 1)];
+};
+
+void event_post(void)
+// Called from an ISR after event_alloc() to pass the slot to the background
+{
+	barrier();
+	event_head++;
+};
+
+void event_xeq(void)
+// Called in the background to run the callback of every waiting event, in
+// the order they were posted. The slot is only given back once the callback
+// has returned, so the callback may use the event data in place.
+{
+	uint8_t tail = event_tail;
+
+	while (tail != event_head)
+	{
+	    struct event *ev = &event_ring[tail & (EVENT_NUM - 1)];
+
+	    barrier();
+	    ev->ev_ufn(ev);
+	    event_tail = ++tail;
+	};
+};
+
+uint8_t event_pending(void)
+// Whether event_xeq() has anything to run
+{
+	return event_tail != event_head;
+};
+
+void event_stats(uint16_t *lost, uint8_t *peak)
+// Read (and keep) the overflow counters
+{
+	cli();
+	*lost = event_lost;
+	*peak = event_peak;
+	sei();
+};
+
+void event_clear(void)
+// Zero the overflow counters
+{
+	cli();
+	event_lost = 0;
+	event_peak = 0;
+	sei();
+};
@@ -0,0 +1,60 @@
+/*
+ * event.h
+ *
+ *  Created on: October 15, 2026
+ *  Single producer, single consumer ring for handing events from an ISR to
+ *  the background.
+ */
+
+/*
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+*/
+
+#ifndef EVENT_H_
+#define EVENT_H_
+
+#include <stdint.h>
+
+// Ring size, must be a power of 2 no greater than 128
+#define EVENT_NUM 8
+
+struct event {
+	void (*ev_ufn)(struct event *);		// Background callback
+	uint8_t ev_context;			// Event context (so callback can handle >1 source)
+	union {
+	    uint8_t bytes[4];			// 4 bytes of event data
+	    uint16_t words[2];			// Or two 16 bit integers
+	    uint32_t longs;
+	    void * ptr;				// Or a pointer
+	} ev_data;
+};
+
+extern volatile uint8_t event_head;		// Next slot to fill (ISR only)
+extern volatile uint8_t event_tail;		// Next slot to run (background only)
+extern volatile uint16_t event_lost;		// Events dropped, ring full
+extern volatile uint8_t event_peak;		// Most events ever waiting
+
+struct event * event_alloc(void);
+void event_post(void);
+void event_xeq(void);
+uint8_t event_pending(void);
+void event_stats(uint16_t *, uint8_t *);
+void event_clear(void);
+
+#endif /* EVENT_H_ */
@@ -32,6 +32,12 @@
 #include "serial.h"
 #include "pps.h"
 #include "spi.h"
+#include "event.h"
+#include "efc.h"
+#include "disc.h"
+#include "temp.h"
+#include "cpu.h"
+#include "rc.h"
 #include "gpsdo.h"
 
 unsigned char flasher(struct tlist *);
@@ -44,7 +50,7 @@ $002	INT0		N/A
 $004	INT1		N/A
 $006	INT2		External switch on pin 3
 $008	TIMER2 COMP	N/A
-$00A	TIMER2 OVF	N/A
+$00A	TIMER2 OVF	In efc.c to step the sigma-delta EFC output
 $00C	TIMER1 CAPT	1PPS input from GPS on pin 19
 $00E	TIMER1 COMPA	N/A
 $010	TIMER1 COMPB	N/A
@@ -55,7 +61,7 @@ $018	SPI, STC	In spi.c to indicate ready to accept new byte
 $01A	USART, RXC	N/A (will be used for input at some stage)
 $01C	USART, URDE	Data register empty - used in serial.c output
 $01E	USART, TCX	N/A
-$020	ADC		N/A
+$020	ADC		Temperature (temp.c)
 $022	EE_RDY		N/A
 $024	ANA_COMP	N/A
 $026	TWI		N/A
@@ -78,12 +84,16 @@ int main(void)
 {
 	sei();
 
+	// Run on F_CPU until the clock has been measured from PPS, or
+	// at RC_HZ if the internal RC oscillator is to be trimmed to it
+	cpu_init(RC_TRIM ? RC_HZ : CPU_MEASURE ? 0 : F_CPU);
+
 	// Initialize LEDs for output, initially off
 	led_init();
 
 	// Initialize serial output, clear screen, print banner
 	serial_init(1);
-	serial_printf("%c[2JGPSDO V0\r\n\n", 27);
+	serial_printf_P(PSTR("%c[2JGPSDO V0\r\n\n"), 27);
 
 	// Initialize timer
 	time_init();
@@ -91,20 +101,31 @@ int main(void)
 	// Start counting CPU cycles between PPS pulses
 	// TBA - tolerance (in ppm) should be adjusted depending on the clock type
 	pps_init(150000);
+#if RC_TRIM
+	rc_init();
+#endif
 
 	// Initialize serial peripheral interface to communicate to Pi
 	spi_init();
+
+#if !RC_TRIM
+	// Steer the oscillator from the middle of its range once it is warm
+	disc_init(EFC_MID, OCXO_WARMUP);
+
+	// Read the oscillator's temperature and correct for it
+	temp_init();
+#endif
 	
 	// Start uptime counter (to be moved to LCD when ready)
-	// serial_printf("Setting 2 second clock output\r\n");
+	// serial_printf_P(PSTR("Setting 2 second clock output\r\n"));
 	clock_data.seconds = 0;
 	time_set(clock, 200, 2, clock_data.bytes, 1);
 
 	// Flash LED once/sec during development
-	// serial_printf("Setting LED 1 flash/sec\r\n");
+	// serial_printf_P(PSTR("Setting LED 1 flash/sec\r\n"));
 	time_set(flasher, 50, 0, 0, 1);
 
-	serial_printf("Entering main loop\r\n");
+	serial_printf_P(PSTR("Entering main loop\r\n"));
 
 
 	// We sleep as much as possible, waiting for interrup
@@ -112,12 +133,28 @@ int main(void)
 
         while (1)
         {
-            sleep_mode();               // Go to sleep until interrupted
+	    // Go back to sleep unless an interrupt has left the background
+	    // something to do. Most wake-ups leave nothing: Timer2 runs the
+	    // EFC modulator every 2048 cycles, and Timer0, SPI and the USART
+	    // interrupt between ticks and bytes. The instruction after sei()
+	    // runs before any interrupt, so one that comes in after the check
+	    // still ends the sleep.
+	    cli();
+	    if (!time_pending() && !event_pending() && !spi_pending())
+	    {
+		sleep_enable();
+		sei();
+		sleep_cpu();
+		sleep_disable();
+		continue;
+	    };
+	    sei();
             // ocxo_gps_sync();         // First up, check for GPS pulse & process
 	    // switch_xeq();		// Respond to a switch press	
 	    proc_timer();		// Background process for timer interrupts
+	    event_xeq();		// Run events passed from ISRs (PPS)
+	    spi_xeq();			// SPI commands in, buffers and DRDY
             time_xeq();                 // Dispatch any timers which have expired
-            spi_cmd();			// Execute any commands from SPI
         };
 };
 
@@ -130,8 +167,8 @@ unsigned char flasher(struct tlist * tl)
 
 unsigned char clock(struct tlist * tl)
 // Log the time. Call to time set includes the # of seconds to increment on each call
-// (context) and the current timer state (udata). In its present implementation the
-// clock will run about 1% slow, or more if the CPU is overloaded.
+// (context) and the current timer state (udata). Timer0 drift is corrected, so
+// the clock keeps time with the CPU clock unless the CPU is overloaded.
 {
 	uint32_t s;
 	uint16_t dd; 
@@ -148,7 +185,7 @@ unsigned char clock(struct tlist * tl)
 	s -= mm * (uint16_t) 60;
 	ss = s;
 
-	serial_printf("%3id %02i:%02i:%02i\r\n", dd, hh, mm, ss);
+	serial_printf_P(PSTR("%3id %02i:%02i:%02i\r\n"), dd, hh, mm, ss);
 	return 0;
 }
 
@@ -156,5 +193,5 @@ unsigned char clock(struct tlist * tl)
 // Very simple acknowledgement of receiving a message over the spi
 void msg1(struct spi_buf * buf)
 {
-        serial_printf("Received message 1\r\n");
+        serial_printf_P(PSTR("Received message 1\r\n"));
 }
@@ -0,0 +1,312 @@
+/*
+ * hold.c
+ *
+ *  Created on: October 15, 2026
+ *  Holdover: keep steering the EFC from what was learned while locked
+ */
+
+/*
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+*/
+
+#include "config.h"
+
+#include <avr/io.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "time.h"
+#include "pps.h"
+#include "spi.h"
+#include "efc.h"
+#include "disc.h"
+#include "hold.h"
+#include "tlm.h"
+
+/*
+ While the loop is tracking, the EFC code it settles on is what it takes to
+ hold the oscillator on frequency, so its history is a record of the
+ oscillator's own frequency: an offset, a linear aging and sometimes a
+ change in that (drift). The code in force between loop updates is
+ averaged over HOLD_SPAN seconds into each of the last HOLD_PTS points.
+
+ If no good pulse has come for HOLD_WAIT seconds while tracking, a
+ polynomial is fitted to the points by least squares:
+
+	u(x) = c0 + c1.x + c2.x^2,	x in spans from the centre of the points
+
+ The drift term c2 is only kept if it stands out of the noise (HOLD_SIG
+ standard errors), otherwise the fit is a straight line; with one or two
+ points it is just the last code. Once a second the EFC is then set from
+ the fit for the time now, measured by Timer 1 from the last pulse.
+
+ The fit predicts a frequency error of zero, so what is reported is how
+ far off it could be: the standard error of the fitted code at x,
+
+	s.sqrt(1/N + x^2/Sxx)
+
+ (s the scatter of the points about the fit), is a frequency error of
+ DISC_KV Hz (cycles per second) per code, and adding it up each second
+ gives the time error to expect, hold_te. When PPS comes back the real
+ time error is measured by the loop (hold_meas) before it starts again.
+*/
+
+float    hold_pu[HOLD_PTS];		// EFC code averaged over each span
+uint16_t hold_pt[HOLD_PTS];		// Its span number, pps_secs / HOLD_SPAN
+uint8_t  hold_head;			// Next slot in hold_pu, hold_pt
+uint8_t  hold_fill;			// Points in them
+float    hold_base;			// Code the current span is measured from
+float    hold_acc;			// Code x seconds in it, from hold_base
+uint16_t hold_accn;			// Seconds in it
+uint16_t hold_span;			// Its span number
+uint32_t hold_lsecs;			// pps_secs at the end of it so far
+
+uint8_t  hold_on;			// In holdover
+uint8_t  hold_n;			// Points the model was fitted to
+float    hold_c0;			// Model: code at x = 0,
+float    hold_c1;			// codes per span,
+float    hold_c2;			// codes per span^2
+float    hold_xm;			// x = 0, in spans after span hold_span
+float    hold_s;			// Scatter of the points about the fit, codes
+float    hold_sxx;			// Sum of x^2 of the points
+uint32_t hold_begin;			// pps_secs at the last pulse before holdover
+uint32_t hold_secs;			// Seconds since the last pulse, this (or the last) holdover
+float    hold_te;			// Estimated time error in it, cycles
+int32_t  hold_meas;			// Time error found when PPS came back, cycles
+uint16_t hold_count;			// Holdovers
+
+static unsigned char hold_tick(struct tlist *);
+static void hold_fit(void);
+static void hold_point(uint8_t, float *, float *);
+static void hold_send(uint8_t);
+
+void hold_init(void)
+// Forget what was learned and start checking for PPS once a second
+{
+	hold_fill = 0;
+	hold_head = 0;
+	hold_accn = 0;
+	hold_on = 0;
+	hold_secs = 0;
+	hold_te = 0;
+	hold_meas = 0;
+	hold_count = 0;
+	time_set(hold_tick, 100, 0, 0, 1);
+};
+
+void hold_lock(float u, uint32_t secs, uint32_t t)
+// Called by the loop while tracking: code u has been in force for the t
+// seconds up to pps_secs secs
+{
+	uint16_t span = secs / HOLD_SPAN;
+
+	if (span != hold_span || !hold_accn)
+	{
+	    // Only keep a point that covers at least half a span
+	    if (hold_accn >= HOLD_SPAN / 2)
+	    {
+		hold_pu[hold_head] = hold_base + hold_acc / hold_accn;
+		hold_pt[hold_head] = hold_span;
+		hold_head = (hold_head + 1) % HOLD_PTS;
+		if (hold_fill < HOLD_PTS)
+		{
+		    hold_fill++;
+		};
+	    };
+	    hold_span = span;
+	    hold_base = u;
+	    hold_acc = 0;
+	    hold_accn = 0;
+	};
+	hold_acc += (u - hold_base) * t;
+	hold_accn += t;
+	hold_lsecs = secs;
+};
+
+uint8_t hold_end(int32_t x)
+// PPS is back, with the loop's phase error at x cycles. Returns 1 if
+// that is too far out to carry on with the tracking gains.
+{
+	hold_on = 0;
+	hold_meas = x;
+	hold_send(0);
+	return x > 4 * DISC_LOCKED || x < -4 * DISC_LOCKED;
+};
+
+static void hold_point(uint8_t k, float * x, float * u)
+// Point k, oldest first, with the current span (if it has enough) last.
+// x is in spans after the start of span hold_span.
+{
+	uint8_t i;
+
+	if (k < hold_fill)
+	{
+	    i = (hold_head + HOLD_PTS - hold_fill + k) % HOLD_PTS;
+	    *x = (int16_t)(hold_pt[i] - hold_span) + 0.5f;
+	    *u = hold_pu[i];
+	} else {
+	    *x = ((int32_t)(hold_lsecs - (uint32_t)hold_span * HOLD_SPAN) - hold_accn / 2) / (float)HOLD_SPAN;
+	    *u = hold_base + hold_acc / hold_accn;
+	};
+};
+
+static void hold_fit(void)
+// Fit the model to the points
+{
+	uint8_t n = hold_fill + (hold_accn >= HOLD_SPAN / 4);
+	float x, u, um = 0, s2 = 0, s3 = 0, s4 = 0, sxu = 0, sxxu = 0;
+	float a, b, bq, c, d, r, rl = 0, rq = 0;
+	uint8_t k;
+
+	hold_n = n;
+	hold_c0 = disc_u;
+	hold_c1 = 0;
+	hold_c2 = 0;
+	hold_xm = 0;
+	hold_s = 0;
+	hold_sxx = 1;
+	if (n < 3)
+	{
+	    return;
+	};
+
+	// Centre the points, x and u
+	for (k = 0; k < n; k++)
+	{
+	    hold_point(k, &x, &u);
+	    hold_xm += x;
+	    um += u;
+	};
+	hold_xm /= n;
+	um /= n;
+	for (k = 0; k < n; k++)
+	{
+	    hold_point(k, &x, &u);
+	    x -= hold_xm;
+	    u -= um;
+	    s2 += x * x;
+	    s3 += x * x * x;
+	    s4 += x * x * x * x;
+	    sxu += x * u;
+	    sxxu += x * x * u;
+	};
+
+	// Straight line, and (with enough points) the quadratic, whose drift
+	// has a standard error of sqrt(n.s2/d) times its scatter
+	b = sxu / s2;
+	a = bq = c = 0;
+	d = n * (s2 * s4 - s3 * s3) - s2 * s2 * s2;
+	if (n >= 5 && d > 0)
+	{
+	    a = s2 * (sxu * s3 - s2 * sxxu) / d;
+	    bq = (n * (sxu * s4 - s3 * sxxu) - s2 * s2 * sxu) / d;
+	    c = n * (s2 * sxxu - s3 * sxu) / d;
+	};
+	for (k = 0; k < n; k++)
+	{
+	    hold_point(k, &x, &u);
+	    x -= hold_xm;
+	    u -= um;
+	    r = u - b * x;
+	    rl += r * r;
+	    r = u - a - bq * x - c * x * x;
+	    rq += r * r;
+	};
+	hold_sxx = s2;
+	if (c != 0 && c * c * d > HOLD_SIG * HOLD_SIG * rq / (n - 3) * n * s2)
+	{
+	    hold_c0 = um + a;
+	    hold_c1 = bq;
+	    hold_c2 = c;
+	    hold_s = sqrtf(rq / (n - 3));
+	} else {
+	    hold_c0 = um;
+	    hold_c1 = b;
+	    hold_s = sqrtf(rl / (n - 2));
+	};
+};
+
+static unsigned char hold_tick(struct tlist * tl)
+// Once a second: go into holdover if PPS has stopped while tracking, and
+// steer from the model while in it
+{
+	uint32_t quiet = pps_quiet();
+	float x, u;
+
+	if (!hold_on)
+	{
+	    if (quiet < HOLD_WAIT || disc_mode != DISC_TRK)
+	    {
+		return 0;
+	    };
+	    hold_fit();
+	    hold_on = 1;
+	    hold_begin = pps_secs;
+	    hold_secs = 0;
+	    hold_te = 0;
+	    hold_meas = 0;
+	    hold_count++;
+	    disc_enter(DISC_HOLD, pps_secs + quiet);
+	};
+
+	// Add up the expected time error since the last tick, then steer
+	x = ((int32_t)(pps_secs + quiet - (uint32_t)hold_span * HOLD_SPAN)) / (float)HOLD_SPAN - hold_xm;
+	if (hold_n >= 3)
+	{
+	    hold_te += DISC_KV * hold_s * sqrtf(1.0f / hold_n + x * x / hold_sxx) * (pps_secs + quiet - hold_begin - hold_secs);
+	};
+	hold_secs = pps_secs + quiet - hold_begin;
+	u = hold_c0 + x * (hold_c1 + x * hold_c2);
+	disc_u = u < 0 ? 0 : u > 0xFFFF ? 0xFFFF : u;
+	disc_efc();
+	tlm_update();
+	if (!(hold_secs % HOLD_REPORT))
+	{
+	    hold_send(1);
+	};
+	return 0;
+};
+
+static void hold_send(uint8_t on)
+// Message is: SPICMD_HOLD, in holdover (1) or just out (0), points in the
+// model, seconds (4 bytes), estimated and measured time errors (cycles,
+// 4 bytes each, measured 0 until PPS is back), all little endian.
+{
+	struct spi_buf * buf;
+	uint32_t v[3];
+
+	if (!(buf = spi_evbuf()))
+	{
+	    return;
+	};
+	v[0] = hold_secs;
+	v[1] = hold_te < 2e9f ? (int32_t)(hold_te + 0.5f) : 0x7FFFFFFF;
+	v[2] = hold_meas;
+	*(buf->ptr++) = SPICMD_HOLD;
+	*(buf->ptr++) = on;
+	*(buf->ptr++) = hold_n;
+	for (uint8_t i = 0; i < 3; i++)
+	{
+	    *(buf->ptr++) = v[i] & 0xFF;
+	    *(buf->ptr++) = (v[i] >>  8) & 0xFF;
+	    *(buf->ptr++) = (v[i] >> 16) & 0xFF;
+	    *(buf->ptr++) = (v[i] >> 24) & 0xFF;
+	};
+	spi_tx_queue(buf);
+};
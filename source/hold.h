@@ -0,0 +1,53 @@
+/*
+ * hold.h
+ *
+ *  Created on: October 15, 2026
+ *  Holdover: keep steering the EFC from what was learned while locked
+ */
+
+/*
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+*/
+
+#ifndef HOLD_H_
+#define HOLD_H_
+
+#include <stdint.h>
+
+#define HOLD_SPAN 512			// Seconds of tracking averaged into each point
+#define HOLD_PTS 16			// Points kept (HOLD_PTS * HOLD_SPAN seconds)
+#define HOLD_WAIT 4			// Seconds without a good pulse before holdover
+#define HOLD_SIG 3			// Drift only used if this many standard errors
+#define HOLD_REPORT 64			// Seconds between reports in holdover
+
+extern uint8_t  hold_on;		// In holdover
+extern uint8_t  hold_n;			// Points the model was fitted to
+extern float    hold_c0;		// Model: EFC code at the centre of the points,
+extern float    hold_c1;		// aging, codes per span,
+extern float    hold_c2;		// drift, codes per span^2
+extern uint32_t hold_secs;		// Seconds since the last pulse, this (or the last) holdover
+extern float    hold_te;		// Estimated time error in it, cycles
+extern int32_t  hold_meas;		// Time error found when PPS came back, cycles
+extern uint16_t hold_count;		// Holdovers
+
+void hold_init(void);
+void hold_lock(float, uint32_t, uint32_t);
+uint8_t hold_end(int32_t);
+
+#endif /* HOLD_H_ */
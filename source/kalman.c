@@ -0,0 +1,329 @@
+/*
+ * kalman.c
+ *
+ *  Created on: October 15, 2026
+ *  Fixed point Kalman filter for the phase, frequency and drift of the clock
+ */
+
+/*
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+*/
+
+#include "config.h"
+
+#include <avr/io.h>
+#include <stdint.h>
+
+#include "spi.h"
+#include "kalman.h"
+
+/*
+ A three state Kalman filter on the PPS phase: phase x (cycles), frequency
+ y (cycles/s, i.e. Hz of CPU clock error) and drift d (cycles/s^2), with
+ one second steps
+
+	x' = x + y + d/2,	y' = y + d,	d' = d
+
+ each driven by its own white noise (variances q0, q1, q2 per second; a
+ diagonal Q), and the PPS phase measured with variance r. It is given the
+ cycles gained over each accepted interval by pps_report().
+
+ It is all integer arithmetic: one update is 18 multiplies of 32 x 32
+ bits and 3 64 bit divides, and a gap of n seconds adds n predictions of
+ shifts and adds (n <= KAL_GAP, after which it starts again). The AVR
+ has no 64 bit instructions, so avr-gcc calls libgcc for the shifts,
+ multiplies and divides. Counted from those routines, not measured, the
+ worst cases in cycles are:
+
+	kal_predict()	15 shifts of 10 or 21 bits (__ashrdi3, about
+			60 and 105), 18 adds, and the loads, stores and
+			spills of the 64 bit values		< 2,500
+	kal_gain()	up to 32 halvings of d and p, 28 tries for the
+			binary point (a variable shift each) and a 64
+			bit divide (__divdi3, about 3,000)	< 11,000
+	kal_mul()	two 64 bit multiplies (__muldi3) and two
+			variable shifts				< 900
+
+ so an update, with its 3 gains and 9 multiplies, is under 42,000
+ cycles, and with the KAL_GAP predictions of the longest gap it carries
+ over, under 42,000 + 64 x 2,500 = 202,000: 51ms at 4MHz, in the
+ background. A pulse a second after the last is under 45,000 (11ms),
+ and a restart, with kal_freq0()'s three divides, under 10,000. To keep
+ the numbers in range:
+
+ - time is counted in units of T = 2^KAL_TLOG seconds for the frequency
+   and drift, so that once the filter has settled the three variances,
+   which are otherwise many decades apart, are of similar size. The
+   steps of 1/T then become shifts.
+ - the phase is kept relative to the latest measurement: each step
+   subtracts the cycles measured, so the state is always small, whatever
+   pps_phase has grown to.
+ - the state and the covariance P are Q32 (int64_t). The gains
+   K = P.H'/(P00 + r) are 32 bit with their own binary point, as far
+   up as Q28 for the small ones they settle to, and multiply the 64 bit
+   values in two halves.
+
+ The noise parameters are powers of 2 in half steps: a value L means
+ 2^(L/2) (in the units above, per second), which is as fine as they
+ need to be set. They are changed over SPI (SPICMD_KAL) and start from
+ KAL_R and KAL_Q* in config.h.
+*/
+
+#define KAL_G 28			// Gains are at most Q28
+
+int8_t  kal_lr;				// Measurement noise, log 2 in half steps
+int8_t  kal_lq[3];			// Process noise, phase, frequency, drift
+int64_t kal_x[3];			// State, Q32
+int64_t kal_p[6];			// Covariance P00 P01 P02 P11 P12 P22, Q32
+int64_t kal_r;				// r, Q32
+int64_t kal_q[3];			// Diagonal of Q, Q32, scaled by T
+uint32_t kal_n;				// Updates since it started
+
+static void kal_predict(void);
+static int64_t kal_pow(int8_t, int8_t);
+static int32_t kal_gain(int64_t, int64_t, uint8_t *);
+static int64_t kal_mul(int64_t, int32_t, uint8_t);
+static int64_t kal_freq0(int32_t, uint32_t);
+
+void kal_init(void)
+{
+	kal_config(KAL_R, KAL_Q0, KAL_Q1, KAL_Q2);
+	kal_restart();
+};
+
+void kal_restart(void)
+// Start afresh from the next measurement
+{
+	kal_n = 0;
+};
+
+void kal_config(int8_t lr, int8_t lq0, int8_t lq1, int8_t lq2)
+// Set the noise parameters (KAL_KEEP leaves one as it is)
+{
+	if (lr != KAL_KEEP)
+	{
+	    kal_lr = lr > 16 ? 16 : lr;
+	};
+	if (lq0 != KAL_KEEP)
+	{
+	    kal_lq[0] = lq0;
+	};
+	if (lq1 != KAL_KEEP)
+	{
+	    kal_lq[1] = lq1;
+	};
+	if (lq2 != KAL_KEEP)
+	{
+	    kal_lq[2] = lq2;
+	};
+	kal_r = kal_pow(kal_lr, 0);
+	for (uint8_t i = 0; i < 3; i++)
+	{
+	    kal_q[i] = kal_pow(kal_lq[i], 2 * i * KAL_TLOG);
+	};
+};
+
+static int64_t kal_pow(int8_t l, int8_t sh)
+// 2^(l/2 + sh), Q32, saturated
+{
+	int16_t e = l + 2 * (sh + 32);
+	int64_t m = e & 1 ? 3037000500LL : 1LL << 31;	// 2^31 or sqrt(2).2^31
+
+	e = (e >> 1) - 31;
+	if (e > 31)
+	{
+	    return 0x7FFFFFFFFFFFFFFFLL;
+	};
+	return e >= 0 ? m << e : e > -63 ? m >> -e : 0;
+};
+
+static int32_t kal_gain(int64_t p, int64_t d, uint8_t * sh)
+// p/d, with as many fraction bits (*sh) as fit in 31. d is cut down to 30
+// bits first, and p with it, so the divide keeps its precision.
+{
+	uint8_t s = KAL_G;
+
+	while (d >= 1L << 30)
+	{
+	    d >>= 1;
+	    p >>= 1;
+	};
+	if (d < 1)
+	{
+	    d = 1;
+	};
+	while (s && (p < 0 ? -p : p) >= d << (30 - s))
+	{
+	    s--;
+	};
+	*sh = s;
+	if ((p < 0 ? -p : p) >= d << 30)
+	{
+	    return p < 0 ? -0x40000000L : 0x40000000L;
+	};
+	return (p << s) / d;
+};
+
+static int64_t kal_mul(int64_t a, int32_t g, uint8_t sh)
+// a.g / 2^sh, as two 32 x 32 bit multiplies
+{
+	return ((int64_t)(int32_t)(a >> 32) * g << (32 - sh)) + ((int64_t)(uint32_t)a * g >> sh);
+};
+
+static int64_t kal_freq0(int32_t err, uint32_t n)
+// err/n as Q32 cycles per T. After a long gap both can be anything, so
+// this divides first, then shifts the quotient and the fraction (Q31)
+// separately, saturating a quotient that would not fit.
+{
+	int64_t q = err / (int64_t)n;
+	int64_t r = err % (int64_t)n;
+
+	if (q >= 1L << (31 - KAL_TLOG) || q <= -(1L << (31 - KAL_TLOG)))
+	{
+	    return q < 0 ? -(1LL << 62) : 1LL << 62;
+	};
+	return (q << (32 + KAL_TLOG)) + ((r << 31) / (int64_t)n << (1 + KAL_TLOG));
+};
+
+static void kal_predict(void)
+// One second on: x = F.x, P = F.P.F' + Q
+{
+	int64_t *p = kal_p;
+	int64_t a00, a01, a02, a11, a12;
+
+	kal_x[0] += (kal_x[1] >> KAL_TLOG) + (kal_x[2] >> (2 * KAL_TLOG + 1));
+	kal_x[1] += kal_x[2] >> KAL_TLOG;
+
+	a00 = p[0] + (p[1] >> KAL_TLOG) + (p[2] >> (2 * KAL_TLOG + 1));
+	a01 = p[1] + (p[3] >> KAL_TLOG) + (p[4] >> (2 * KAL_TLOG + 1));
+	a02 = p[2] + (p[4] >> KAL_TLOG) + (p[5] >> (2 * KAL_TLOG + 1));
+	a11 = p[3] + (p[4] >> KAL_TLOG);
+	a12 = p[4] + (p[5] >> KAL_TLOG);
+	p[0] = a00 + (a01 >> KAL_TLOG) + (a02 >> (2 * KAL_TLOG + 1)) + kal_q[0];
+	p[1] = a01 + (a02 >> KAL_TLOG);
+	p[2] = a02;
+	p[3] = a11 + (a12 >> KAL_TLOG) + kal_q[1];
+	p[4] = a12;
+	p[5] += kal_q[2];
+};
+
+void kal_pps(int32_t err, uint32_t n)
+// Called by pps_report() with the cycles gained over the n seconds since
+// the last accepted pulse
+{
+	int64_t *p = kal_p;
+	int64_t v, d, p00, p01, p02;
+	int32_t g[3];
+	uint8_t sh[3];
+
+	if (n > KAL_GAP)
+	{
+	    kal_n = 0;
+	};
+	if (!kal_n)
+	{
+	    // Phase from this pulse, frequency from this interval, no drift
+	    kal_x[0] = 0;
+	    kal_x[1] = kal_freq0(err, n);
+	    kal_x[2] = 0;
+	    p[0] = kal_r;
+	    p[1] = 0;
+	    p[2] = 0;
+	    p[3] = 2 * kal_r << 2 * KAL_TLOG;
+	    p[4] = 0;
+	    p[5] = 1LL << (32 + 4 * KAL_TLOG - 20);	// (2^-10 cycles/s^2)^2
+	    kal_n = 1;
+	    return;
+	};
+	while (n--)
+	{
+	    kal_predict();
+	};
+
+	// Innovation: the phase measured less that predicted, then the
+	// phase is measured from here
+	v = -(kal_x[0] - ((int64_t)err << 32));
+	kal_x[0] -= (int64_t)err << 32;
+
+	d = p[0] + kal_r;
+	p00 = p[0];
+	p01 = p[1];
+	p02 = p[2];
+	g[0] = kal_gain(p00, d, &sh[0]);
+	g[1] = kal_gain(p01, d, &sh[1]);
+	g[2] = kal_gain(p02, d, &sh[2]);
+	for (uint8_t i = 0; i < 3; i++)
+	{
+	    kal_x[i] += kal_mul(v, g[i], sh[i]);
+	};
+	p[0] -= kal_mul(p00, g[0], sh[0]);
+	p[1] -= kal_mul(p01, g[0], sh[0]);
+	p[2] -= kal_mul(p02, g[0], sh[0]);
+	p[3] -= kal_mul(p01, g[1], sh[1]);
+	p[4] -= kal_mul(p02, g[1], sh[1]);
+	p[5] -= kal_mul(p02, g[2], sh[2]);
+	kal_n++;
+};
+
+int32_t kal_phase(void)
+// Filtered phase, cycles, relative to pps_phase
+{
+	return (kal_x[0] + (1LL << 31)) >> 32;
+};
+
+float kal_freq(void)
+// Filtered frequency error, Hz
+{
+	return kal_x[1] * (1.0f / 4294967296.0f / (1UL << KAL_TLOG));
+};
+
+void kal_query(uint8_t * set, uint8_t len)
+// SPI master sent SPICMD_KAL, with new noise parameters if len is 4
+// (KAL_KEEP for any to stay as they are). The reply is: SPICMD_KAL,
+// the 4 parameters, phase (1/256 cycles), frequency (2^-16 cycles/s) and
+// drift (2^-32 cycles/s^2), 4 bytes each, little endian.
+{
+	struct spi_buf * buf;
+	int32_t v[3];
+
+	if (len == 4)
+	{
+	    kal_config(set[0], set[1], set[2], set[3]);
+	};
+	if (!(buf = spi_getbuf()))
+	{
+	    return;
+	};
+	v[0] = kal_x[0] >> 24;
+	v[1] = kal_x[1] >> (16 + KAL_TLOG);
+	v[2] = kal_x[2] >> (2 * KAL_TLOG);
+	*(buf->ptr++) = SPICMD_KAL;
+	*(buf->ptr++) = kal_lr;
+	*(buf->ptr++) = kal_lq[0];
+	*(buf->ptr++) = kal_lq[1];
+	*(buf->ptr++) = kal_lq[2];
+	for (uint8_t i = 0; i < 3; i++)
+	{
+	    *(buf->ptr++) = v[i] & 0xFF;
+	    *(buf->ptr++) = (v[i] >>  8) & 0xFF;
+	    *(buf->ptr++) = (v[i] >> 16) & 0xFF;
+	    *(buf->ptr++) = (v[i] >> 24) & 0xFF;
+	};
+	spi_tx_queue(buf);
+};
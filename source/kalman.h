@@ -0,0 +1,52 @@
+/*
+ * kalman.h
+ *
+ *  Created on: October 15, 2026
+ *  Fixed point Kalman filter for the phase, frequency and drift of the clock
+ */
+
+/*
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+*/
+
+#ifndef KALMAN_H_
+#define KALMAN_H_
+
+#include <stdint.h>
+
+#define KAL_KEEP (-128)			// Noise parameter left as it is
+
+// Noise parameters, log 2 in half steps (see kalman.c)
+extern int8_t  kal_lr;			// Measurement, cycles^2
+extern int8_t  kal_lq[3];		// Process: phase, frequency, drift
+
+// State, Q32, in units of cycles, cycles per 2^KAL_TLOG seconds and
+// cycles per (2^KAL_TLOG seconds)^2, the phase relative to pps_phase
+extern int64_t kal_x[3];
+extern uint32_t kal_n;			// Updates since it started
+
+void kal_init(void);
+void kal_restart(void);
+void kal_config(int8_t, int8_t, int8_t, int8_t);
+void kal_pps(int32_t, uint32_t);
+int32_t kal_phase(void);
+float kal_freq(void);
+void kal_query(uint8_t *, uint8_t);
+
+#endif /* KALMAN_H_ */
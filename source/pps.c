@@ -29,39 +29,117 @@
 #include "pps.h"
 #include "led.h"
 #include "spi.h"
+#include "event.h"
+#include "adev.h"
+#include "disc.h"
+#include "kalman.h"
+#include "cpu.h"
+#include "rc.h"
+#include "tlm.h"
+#include "stream.h"
 
 
-// pps_count:
-// 	pps_bytes: to pass data to the fork function
-//	pps_words: to count overflow & pin interrupt separately
-//	    Note: Little endian, so [0] is low order [1] is high order
-//	pps_long:  for overall count of processor cycles between pin interruprs
+// pps_ovf:
+//	Timer 1 overflows, never reset. Together with ICR1 it makes a 40 bit
+//	timestamp for each capture (pps_ovfh is the top byte), so no cycle is
+//	ever lost between one PPS pulse and the next, whatever happens to the
+//	pulses or to the reports in between. At 16MHz it wraps after 19 hours.
 
-union {
-	uint8_t  pps_bytes[4];
-	uint16_t pps_words[2];
-	int32_t pps_long;
-} pps_count;
+volatile uint16_t pps_ovf;
+volatile uint8_t  pps_ovfh;
 
-// Report variance to F_CPU every <interval> seconds
-#define INTERVAL 16
+#define PPS_TS_MASK 0xFFFFFFFFFFULL		// 40 bit timestamps
+
+/*
+ Reporting interval: phase gained is reported every 2^pps_rlog seconds,
+ starting at 2^OCXO_MINDELTA. At the end of each interval its phase gain
+ is compared with the last one (scaled to the same length). While they
+ agree to within the GPS noise (2 * OCXO_JITTER) the interval doubles, up
+ to 2^OCXO_MAXDELTA: with white phase noise the frequency resolution goes
+ up with the interval, so there is nothing to lose. Once the oscillator's
+ own wander shows (the Allan deviation floor) it stops growing. A change
+ of more than PPS_RDROP * OCXO_JITTER, a PPS outage or a restart of the
+ outlier filter is a disturbance, and the interval drops back to the
+ minimum so a new frequency is measured quickly.
+*/
+#define PPS_RGROW 2
+#define PPS_RDROP 8
+
+// After this many rejected pulses in a row, start measuring afresh
+#define PPS_RESYNC 4
+
+// Robust filter: window of per second errors, the number needed before it
+// is used, and the narrowest gate, cycles (1us and a count either way)
+#define PPS_WIN 9
+#define PPS_WMIN 5
+#define PPS_GATE_MIN ((int32_t)(cpu_hz / 1000000) + 2)
+
+/*
+ Phase accumulation: each accepted pulse is rounded to the nearest whole
+ number of seconds since the last accepted pulse, and the cycles over or
+ under that many seconds of cpu_hz are added to pps_phase. pps_phase is thus
+ the time error of the CPU clock in cycles since measuring began, and the
+ frequency error over any tau is the difference between two readings of it
+ divided by the seconds between them. Nothing is thrown away: a missing
+ pulse just makes the next interval 2 seconds, and a doubled pulse (or one
+ outside the tolerance) is ignored so that the next interval is measured
+ from the last good one.
+*/
+
+int64_t  pps_phase;			// Accumulated time error, cycles (+ = CPU fast)
+uint32_t pps_secs;			// Seconds since measuring began
+uint64_t pps_last;			// Timestamp of the last accepted pulse
+uint8_t  pps_valid;			// pps_last has been set
+uint8_t  pps_bad;			// Pulses rejected in a row
+
+uint16_t pps_missed;			// Seconds with no pulse
+uint16_t pps_glitch;			// Pulses ignored (doubled, out of tolerance)
+uint16_t pps_resync;			// Times measuring started afresh
+uint16_t pps_outlier;			// Pulses ignored by the robust filter
+uint16_t pps_reacq;			// Times the robust filter started afresh
+
+/*
+ Outlier filter: within ppserr_max, which only catches pulses that can't
+ be right for the type of clock, each interval is compared with the median
+ of the last PPS_WIN per second errors. If it is further from n times the
+ median than n times the gate, the pulse is ignored, just as one out of
+ tolerance is. The gate is 4.5 times the median absolute deviation of the
+ window (3 sigma for Gaussian noise) but not less than PPS_GATE_MIN, so it
+ closes in as the oscillator settles and GPS sawtooth or half glitches that
+ the fixed tolerance let through are left out of the phase. Until the
+ window has PPS_WMIN errors only ppserr_max applies. A run of PPS_RESYNC
+ outliers means the frequency really has moved: the window is emptied,
+ which opens the gate again, and the pulse is taken.
+*/
+
+int32_t  pps_win[PPS_WIN];		// Recent per second errors, cycles
+uint8_t  pps_whead;			// Next slot in pps_win
+uint8_t  pps_wfill;			// Errors in pps_win
+int32_t  pps_med;			// Median of pps_win
+int32_t  pps_gate;			// Current gate, cycles/second (0 = open)
 
-int32_t ppserr;
 int32_t ppserr_max;
-int8_t  ppsint;
+uint32_t pps_tol;			// Tolerance, ppm
+
+// Start of the current reporting interval
+int64_t  pps_rphase;
+uint32_t pps_rsecs;
 
-// Time can't be reset while running, so we
-// need to know where we are starting from
-volatile uint16_t pps_start;
+uint8_t  pps_rlog;			// Log 2 of the reporting interval
+int32_t  pps_rlast;			// Phase gained over the last interval
+uint32_t pps_rlen;			// Its length, seconds (0 = none to compare)
 
 // Print pps count function
-static unsigned char pps_report(struct tlist *);
+static void pps_report(struct event *);
+static uint8_t pps_outside(int32_t, uint32_t);
+static void pps_filter(int32_t);
+static void pps_interval(int32_t, uint32_t);
 
 uint8_t pps_init(uint32_t tolerance)
 /*
  Count processor cycles between PPS interrupts. An exact count is needed so
  no prescaler is used. After 2^16 cycles, an interrupt will occur which is
- counted in the high order word of the 32-bit count value.
+ counted in pps_ovf, the high order bits of the capture timestamp.
  Uses 16 bit Timer 1.
 	At 1MHz,  count will be 0x 00:0f:42:40
  	At 10MHz, count will be 0x 00:98:96:80
@@ -69,21 +147,37 @@ uint8_t pps_init(uint32_t tolerance)
  PPS signal should connect to pin ICP1.
 */
 {
-	// Set up reporting
-	ppsint = 0;
-	ppserr = 0;
-	// Translate tolerance into cycles, being careful about integer overflow
-        ppserr_max = (tolerance + 99) / 100 * (F_CPU / 100) / 100;
+	// Set up measuring & reporting
+	pps_phase = 0;
+	pps_secs = 0;
+	pps_valid = 0;
+	pps_bad = 0;
+	pps_missed = 0;
+	pps_glitch = 0;
+	pps_resync = 0;
+	pps_rphase = 0;
+	pps_rsecs = 0;
+	pps_rlog = OCXO_MINDELTA;
+	pps_rlen = 0;
+	pps_outlier = 0;
+	pps_reacq = 0;
+	pps_wfill = 0;
+	pps_gate = 0;
+	adev_init();
+	kal_init();
+	pps_tol = tolerance;
+	pps_clock(cpu_hz);
 
 	// Normal port operation
 	TCCR1A = 0;
 	// Noise cancellation, PPS rising edge, system clock w/out prescaling
 	TCCR1B = 1<<ICNC1 | 1<<ICES1 | 1<<CS10;
 	// Initialize cycle counters
-	pps_start = 0;
-	pps_count.pps_long = 0;
+	pps_ovf = 0;
+	pps_ovfh = 0;
 	// Enable input capture & overflow interrupts
 	TIMSK |= 1<<TICIE1 | 1<<TOIE1;
+	return 0;
 };
 
 /*
@@ -137,78 +231,342 @@ void loop(void)
 }
 
 
+void pps_clock(uint32_t hz)
+// The CPU clock is hz: set the tolerance in cycles, and measure afresh
+// from the last pulse
+{
+	// Translate tolerance into cycles, being careful about integer overflow
+        ppserr_max = (pps_tol + 99) / 100 * (hz / 100) / 100;
+	pps_bad = 0;
+	pps_wfill = 0;
+	pps_gate = 0;
+	pps_rlog = OCXO_MINDELTA;
+	pps_rlen = 0;
+};
+
+uint32_t pps_quiet(void)
+// Whole seconds since the last accepted pulse (0 before the first), read
+// from Timer 1 the same way the capture ISR does
+{
+	uint16_t tcnt, ovf;
+	uint8_t ovfh;
+	uint64_t now;
+
+	if (!pps_valid)
+	{
+	    return 0;
+	};
+	cli();
+	tcnt = TCNT1;
+	ovf = pps_ovf;
+	ovfh = pps_ovfh;
+	if ((TIFR & 1<<TOV1) && tcnt < 0x8000)
+	{
+	    if (!++ovf)
+	    {
+		ovfh++;
+	    };
+	};
+	sei();
+	now = (uint64_t)ovfh << 32 | (uint32_t)ovf << 16 | tcnt;
+	return ((now - pps_last) & PPS_TS_MASK) / cpu_hz;
+};
+
 ISR(TIMER1_OVF_vect)
 {
-	pps_count.pps_words[1] += 1;
+	if (!++pps_ovf)
+	{
+	    pps_ovfh++;
+	};
 };
 
 ISR(TIMER1_CAPT_vect)
+// The capture has priority over the overflow, so if Timer 1 wrapped shortly
+// before (or after) the edge, TOV1 may still be pending and pps_ovf one short.
+// ICR1 tells which side of the wrap the edge fell: a small value means the
+// capture came after it and the pending overflow belongs in the timestamp. A
+// large one means the wrap came after the capture, while this ISR was
+// waiting to run. This holds as long as the ISR runs within 2^15 cycles.
 {
-	uint16_t icr;
-	// Save the current interval
-	icr = ICR1;
-	pps_count.pps_words[0] = icr;
-	pps_count.pps_long -= pps_start;
-	pps_start = icr;
-	
-	// Now place an entry on timer completion queue to fork 
-	// to a background process that reports the number of cycles.
-	isr_fork(pps_report, 0, pps_count.pps_bytes);
-	pps_count.pps_words[1] = 0;
+	struct event * ev;
+	uint16_t icr = ICR1;
+	uint16_t ovf = pps_ovf;
+	uint8_t ovfh = pps_ovfh;
+
+	if ((TIFR & 1<<TOV1) && icr < 0x8000)
+	{
+	    if (!++ovf)
+	    {
+		ovfh++;
+	    };
+	};
+
+	// Now pass the capture timestamp to a background process
+	// that reports it. If the event ring is full it is counted there.
+	if (ev = event_alloc())
+	{
+	    ev->ev_ufn = pps_report;
+	    ev->ev_context = ovfh;
+	    ev->ev_data.words[0] = icr;
+	    ev->ev_data.words[1] = ovf;
+	    event_post();
+	};
 
 	// DEBUG - turn LED off and on with PPS
 	led_toggle(LEDB_unit);
 }
 
-static unsigned char pps_report(struct tlist * tl)
-// Report number of processor cycles in a 1 second interval
+static void pps_report(struct event * ev)
+// Add the interval since the last accepted pulse to the phase, and report
+// the phase gained over each reporting interval
 {
 	struct spi_buf * buf;
+	uint64_t ts;
+	uint64_t delta;
+	uint32_t n;
 	int32_t fcpu_err;
+	int32_t ppserr;
+	uint32_t ppsint;
 
-	// # of cycles +/- nominal CPU frequency
-	fcpu_err = tl->tl_udata.longs - F_CPU;
+	ts = ((uint64_t)ev->ev_context << 32) | ev->ev_data.longs;
+	if (!pps_valid)
+	{
+	    pps_last = ts;
+	    pps_valid = 1;
+	    return;
+	};
+
+	// Until the clock is known, the intervals go to measuring it
+	delta = (ts - pps_last) & PPS_TS_MASK;
+	if (!cpu_known)
+	{
+	    pps_last = ts;
+	    cpu_measure(delta > 0xFFFFFFFF ? 0xFFFFFFFF : delta);
+	    return;
+	};
+
+	// Whole seconds since the last good pulse, and cycles +/- nominal
+	n = (delta + cpu_hz / 2) / cpu_hz;
+	fcpu_err = (int64_t)delta - (int64_t)n * cpu_hz;
 
 	// First print to console, remove when spi comms debugged
-	serial_printf("%8li cycles\r\n", fcpu_err);
+	serial_printf_P(PSTR("%8li cycles\r\n"), fcpu_err);
+
+	// While the RC oscillator is being trimmed the intervals go to that
+	if (rc_search(fcpu_err, n))
+	{
+	    stream_pps(fcpu_err, n, STREAM_TRIM);
+	    pps_last = ts;
+	    return;
+	};
 
-	// Accumlated error over INTERVAL seconds, then send value to SPI master
-	if (abs(fcpu_err) <= ppserr_max)
+	// A doubled pulse, or one out of tolerance, is ignored. If they keep
+	// coming, the last good pulse was probably the bad one, so start again.
+	if (!n || fcpu_err > (int64_t)n * ppserr_max || fcpu_err < -(int64_t)n * ppserr_max)
 	{
-	    // Add the error to total
-	    ppserr += fcpu_err;
+	    stream_pps(fcpu_err, n, STREAM_GLITCH);
+	    pps_glitch++;
+	    if (++pps_bad >= PPS_RESYNC)
+	    {
+		pps_last = ts;
+		pps_bad = 0;
+		pps_resync++;
+		pps_rphase = pps_phase;
+		pps_rsecs = pps_secs;
+		pps_wfill = 0;
+		pps_gate = 0;
+		pps_rlog = OCXO_MINDELTA;
+		pps_rlen = 0;
+		adev_restart();
+		kal_restart();
+#if !RC_TRIM
+		disc_restart();
+#endif
+	    };
+	    return;
+	};
 
-	    // After INTERVAL seconds, send to master and reset
-	    if (++ppsint >= INTERVAL)
+	// Within tolerance, it must also agree with the recent ones, unless
+	// OSCCAL is being switched, when its steps swamp any GPS spike
+	if (rc_state != RC_DITHER && pps_outside(fcpu_err, n))
+	{
+	    if (++pps_bad < PPS_RESYNC)
 	    {
-		// DEBUG - print equivalent message on serial console
-		serial_printf("F_CPU: %8lu, Interval: %u, Error: %8li\r\n", F_CPU, ppsint, ppserr);
-
-		// If no buffers available, just keep counting.
-		if (buf = spi_getbuf())
-		{
-		    // DEBUG - turn on red LED, SPI ISR turns it off.
-		    led_state(1, LEDR_unit);
-
-		    *(buf->ptr++) = SPICMD_PPS;
-		    *(buf->ptr++) = F_CPU & 0xFF;
-		    *(buf->ptr++) = (F_CPU >>  8) & 0xFF;
-		    *(buf->ptr++) = (F_CPU >> 16) & 0xFF;
-		    *(buf->ptr++) = (F_CPU >> 24) & 0xFF;
-		    *(buf->ptr++) = ppsint;
-		    *(buf->ptr++) = ppserr & 0xFF;
-		    *(buf->ptr++) = (ppserr >>  8) & 0xFF;
-		    *(buf->ptr++) = (ppserr >> 16) & 0xFF;
-		    *(buf->ptr++) = (ppserr >> 24) & 0xFF;
-		    spi_tx_queue(buf);
-		};
-		ppserr = 0;
-		ppsint = 0;
-	    }; 
+		stream_pps(fcpu_err, n, STREAM_OUTLIER);
+		pps_outlier++;
+		return;
+	    };
+	    pps_reacq++;
+	    pps_wfill = 0;
+	    pps_gate = 0;
+	    pps_rlog = OCXO_MINDELTA;
+	    pps_rlen = 0;
+	};
+	pps_filter(fcpu_err / (int32_t)n);
+	pps_bad = 0;
+	pps_missed += n - 1;
+	pps_last = ts;
+	pps_secs += n;
+	stream_pps(fcpu_err, n, STREAM_OK);
+
+	// The Allan deviation wants a phase every second; short gaps are
+	// filled in along a straight line, longer ones start it afresh.
+	if (n > ADEV_GAP)
+	{
+	    adev_restart();
+	    pps_rlog = OCXO_MINDELTA;
+	    pps_rlen = 0;
 	} else {
-	    // If error exceeds PPSERR, we are in an unlocked state
-	    ppsint = 0;
-	    ppserr = 0;
+	    for (uint32_t k = 1; k < n; k++)
+	    {
+		adev_add(pps_phase + (int32_t)(fcpu_err * (int32_t)k / (int32_t)n));
+	    };
+	};
+	pps_phase += fcpu_err;
+	adev_add(pps_phase);
+	kal_pps(fcpu_err, n);
+	rc_pps(pps_phase, fcpu_err);
+#if RC_TRIM
+	// No EFC to steer, OSCCAL is the only control
+#elif DISC_KALMAN
+	disc_pps(pps_phase + kal_phase(), pps_secs);
+#else
+	disc_pps(pps_phase, pps_secs);
+#endif
+	tlm_update();
+
+	// After 2^pps_rlog seconds, send phase gained to master
+	ppsint = pps_secs - pps_rsecs;
+	if (ppsint >= 1UL << pps_rlog)
+	{
+	    ppserr = pps_phase - pps_rphase;
+	    pps_rphase = pps_phase;
+	    pps_rsecs = pps_secs;
+
+	    // The interval is two bytes in the message; after a long
+	    // outage just start a new one.
+	    if (ppsint > 0xFFFF)
+	    {
+		pps_rlen = 0;
+		return;
+	    };
+	    pps_interval(ppserr, ppsint);
+
+	    // DEBUG - print equivalent message on serial console
+	    serial_printf_P(PSTR("F_CPU: %8lu, Interval: %lu, Error: %8li\r\n"), cpu_hz, ppsint, ppserr);
+
+	    // If no buffers available, this replaces the oldest report waiting
+	    if (buf = spi_evbuf())
+	    {
+		// DEBUG - turn on red LED, SPI ISR turns it off.
+		led_state(1, LEDR_unit);
+
+		*(buf->ptr++) = SPICMD_PPS;
+		*(buf->ptr++) = cpu_hz & 0xFF;
+		*(buf->ptr++) = (cpu_hz >>  8) & 0xFF;
+		*(buf->ptr++) = (cpu_hz >> 16) & 0xFF;
+		*(buf->ptr++) = (cpu_hz >> 24) & 0xFF;
+		*(buf->ptr++) = ppsint & 0xFF;
+		*(buf->ptr++) = ppsint >> 8;
+		*(buf->ptr++) = ppserr & 0xFF;
+		*(buf->ptr++) = (ppserr >>  8) & 0xFF;
+		*(buf->ptr++) = (ppserr >> 16) & 0xFF;
+		*(buf->ptr++) = (ppserr >> 24) & 0xFF;
+		spi_tx_queue(buf);
+	    };
+	};
+}
+
+static void pps_interval(int32_t err, uint32_t len)
+// Set the next reporting interval from how the phase gained over this
+// one compares with the last
+{
+	int64_t d;
+
+	if (pps_rlen)
+	{
+	    d = err - (int64_t)pps_rlast * len / pps_rlen;
+	    if (d > PPS_RDROP * OCXO_JITTER || d < -PPS_RDROP * OCXO_JITTER)
+	    {
+		pps_rlog = OCXO_MINDELTA;
+	    } else if (d <= PPS_RGROW * OCXO_JITTER && d >= -PPS_RGROW * OCXO_JITTER
+			&& pps_rlog < OCXO_MAXDELTA) {
+		pps_rlog++;
+	    };
+	};
+	pps_rlast = err;
+	pps_rlen = len;
+}
+
+static uint8_t pps_outside(int32_t err, uint32_t n)
+// Is an error over n seconds outside the gate around the median?
+{
+	int32_t dev = err - (int32_t)n * pps_med;
+
+	if (!pps_gate)
+	{
+	    return 0;
+	};
+	return dev > (int32_t)n * pps_gate || dev < -(int32_t)n * pps_gate;
+}
+
+static void sort(int32_t * a, uint8_t len)
+// Insertion sort, fine for a handful
+{
+	for (uint8_t i = 1; i < len; i++)
+	{
+	    int32_t v = a[i];
+	    uint8_t j = i;
+
+	    for (; j && a[j - 1] > v; j--)
+	    {
+		a[j] = a[j - 1];
+	    };
+	    a[j] = v;
+	};
+}
+
+static void pps_filter(int32_t err)
+// Add an accepted per second error to the window, then work out the
+// median and, from the median absolute deviation, the gate
+{
+	int32_t a[PPS_WIN];
+	int32_t mad;
+
+	pps_win[pps_whead] = err;
+	if (++pps_whead >= PPS_WIN)
+	{
+	    pps_whead = 0;
+	};
+	if (pps_wfill < PPS_WIN)
+	{
+	    pps_wfill++;
+	};
+	for (uint8_t i = 0; i < pps_wfill; i++)
+	{
+	    a[i] = pps_win[(pps_whead + PPS_WIN - 1 - i) % PPS_WIN];
+	};
+	sort(a, pps_wfill);
+	pps_med = a[pps_wfill / 2];
+	if (pps_wfill < PPS_WMIN)
+	{
+	    pps_gate = 0;
+	    return;
+	};
+
+	for (uint8_t i = 0; i < pps_wfill; i++)
+	{
+	    a[i] = a[i] > pps_med ? a[i] - pps_med : pps_med - a[i];
+	};
+	sort(a, pps_wfill);
+	mad = a[pps_wfill / 2];
+	pps_gate = mad * 9 / 2;
+	if (pps_gate < PPS_GATE_MIN)
+	{
+	    pps_gate = PPS_GATE_MIN;
+	};
+	if (pps_gate > ppserr_max)
+	{
+	    pps_gate = ppserr_max;
 	};
-	return 1;
 }
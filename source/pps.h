@@ -31,5 +31,20 @@
 #include <stdint.h>
 
 uint8_t pps_init(uint32_t);
+void pps_clock(uint32_t);
+uint32_t pps_quiet(void);
+
+// Phase of the CPU clock against GPS (see pps.c)
+extern int64_t  pps_phase;		// Accumulated time error, cycles
+extern uint32_t pps_secs;		// Seconds since measuring began
+extern uint16_t pps_missed;		// Seconds with no pulse
+extern uint16_t pps_glitch;		// Pulses ignored
+extern uint16_t pps_resync;		// Times measuring started afresh
+extern uint16_t pps_outlier;		// Pulses ignored by the robust filter
+extern uint16_t pps_reacq;		// Times the robust filter started afresh
+extern int32_t  pps_med;		// Median per second error, cycles
+extern int32_t  pps_gate;		// Robust filter gate, cycles (0 = open)
+extern uint8_t  pps_rlog;		// Log 2 of the reporting interval
+extern uint32_t pps_tol;		// Tolerance, ppm
 
 #endif /* GPSDO_H_ */
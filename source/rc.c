@@ -0,0 +1,154 @@
+/*
+ * rc.c
+ *
+ *  Created on: October 15, 2026
+ *  Trimming the internal RC oscillator (OSCCAL) from PPS
+ */
+
+/*
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+*/
+
+#include <avr/io.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "rc.h"
+
+/*
+ A board with no crystal runs from the internal RC oscillator, which is
+ only calibrated at the factory to a few percent, and less well than that
+ away from 5V. Its frequency is set by OSCCAL, each step moving it by
+ about half a percent, so PPS can trim it in closed loop to RC_HZ.
+
+ Search: at boot OSCCAL holds the factory calibration, which is the best
+ place to start. Each PPS interval shows whether the clock is slow or
+ fast, and by how much, and OSCCAL moves that way by as many steps as the
+ error is worth, but never more than RC_STEP a second, so the USART and
+ SPI keep working through it. It stops when it has seen two adjacent
+ codes, one slow and one fast. From a few percent out that takes a few
+ seconds. The intervals go to this and not to measuring phase
+ (pps_report() asks rc_search() first), and the pulses are still rounded
+ to whole seconds of RC_HZ, which is good as long as the clock is within
+ 50%.
+
+ Dither: no one step is right, so OSCCAL is switched between the two,
+ once a second after each pulse, on the sign of the phase: the fast step
+ while the clock is behind GPS, the slow one while it is ahead. The
+ phase stays within a second's worth of the difference between them
+ (around 40000 cycles at 8MHz, a few ms), so the average frequency is
+ exact, whatever the two steps are, though one may be used for many
+ seconds at a time if it is the nearer. Each second also shows which
+ way the step just used went: if the fast step lost time, or the slow
+ one gained, RC_RUN seconds in a row, the temperature or the supply has
+ moved the oscillator past it and the pair moves a step that way.
+
+ OSCCAL only ever moves by small steps, as the datasheet asks: at most
+ RC_STEP codes a second in the search, and one code at a time after it.
+*/
+
+uint8_t  rc_state;			// RC_OFF, RC_SEARCH, RC_DITHER
+uint8_t  rc_code;			// Slow step of the pair (or the code so far)
+int16_t  rc_slow;			// Highest code seen slow in the search (-1 none)
+int16_t  rc_fast;			// Lowest code seen fast in the search (256 none)
+uint8_t  rc_hi;				// On the fast step
+uint8_t  rc_run;			// Seconds in a row it went the wrong way
+uint16_t rc_moves;			// Times the pair has moved
+
+void rc_init(void)
+// Start trimming OSCCAL: the search begins from the factory calibration
+{
+	rc_state = RC_SEARCH;
+	rc_code = OSCCAL;
+	rc_slow = -1;
+	rc_fast = 256;
+	rc_hi = 0;
+	rc_run = 0;
+	rc_moves = 0;
+};
+
+uint8_t rc_search(int32_t err, uint32_t n)
+// Called by pps_report() with the cycles over or under n seconds of
+// RC_HZ since the last pulse. Returns 1 if the search used them.
+{
+	uint32_t d;
+	int16_t next;
+
+	if (rc_state != RC_SEARCH)
+	{
+	    return 0;
+	};
+	if (!n)
+	{
+	    return 1;
+	};
+
+	// Steps the error is worth (each about 0.5%), 1 to RC_STEP of them,
+	// but not past a code already seen the other way
+	d = (uint32_t)(err < 0 ? -err : err) / n / (RC_HZ / 200);
+	d = d < 1 ? 1 : d > RC_STEP ? RC_STEP : d;
+	if (err <= 0)
+	{
+	    rc_slow = rc_code;			// Still slow, go up
+	    next = rc_code + d;
+	    next = next < rc_fast ? next : rc_fast - 1;
+	} else {
+	    rc_fast = rc_code;			// Fast, go down
+	    next = rc_code - d;
+	    next = next > rc_slow ? next : rc_slow + 1;
+	};
+	if (rc_fast - rc_slow > 1)
+	{
+	    rc_code = next;
+	} else {
+	    rc_state = RC_DITHER;
+	    rc_hi = 0;
+	    rc_run = 0;
+	    rc_code = rc_slow < 0 ? 0 : rc_slow > 0xFE ? 0xFE : rc_slow;
+	};
+	OSCCAL = rc_code;
+	return 1;
+};
+
+void rc_pps(int64_t phase, int32_t gain)
+// Called by pps_report() after each good pulse with the phase and the
+// cycles gained since the last one: check the step just used and choose
+// the one for the next second
+{
+	if (rc_state != RC_DITHER)
+	{
+	    return;
+	};
+	if (rc_hi ? gain >= 0 : gain <= 0)
+	{
+	    rc_run = 0;
+	} else if (++rc_run >= RC_RUN) {
+	    if (rc_hi && rc_code < 0xFE)
+	    {
+		rc_code++;			// Even the fast step is slow
+		rc_moves++;
+	    } else if (!rc_hi && rc_code) {
+		rc_code--;			// Even the slow step is fast
+		rc_moves++;
+	    };
+	    rc_run = 0;
+	};
+	rc_hi = phase < 0;			// Behind, run fast
+	OSCCAL = rc_code + rc_hi;
+};
@@ -0,0 +1,47 @@
+/*
+ * rc.h
+ *
+ *  Created on: October 15, 2026
+ *  Trimming the internal RC oscillator (OSCCAL) from PPS
+ */
+
+/*
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+*/
+
+#ifndef RC_H_
+#define RC_H_
+
+#include <stdint.h>
+
+// States
+#define RC_OFF 0			// Not trimming (crystal or external clock)
+#define RC_SEARCH 1			// Successive approximation of OSCCAL
+#define RC_DITHER 2			// Between two adjacent steps
+
+extern uint8_t  rc_state;
+extern uint8_t  rc_code;		// Slow step of the pair (or the code so far)
+extern uint8_t  rc_hi;			// On the fast step
+extern uint16_t rc_moves;		// Times the pair has moved
+
+void rc_init(void);
+uint8_t rc_search(int32_t, uint32_t);
+void rc_pps(int64_t, int32_t);
+
+#endif /* RC_H_ */
@@ -28,6 +28,8 @@
 #ifndef RINGBUF_H_
 #define RINGBUF_H_
 
+#include <stdint.h>
+
 typedef struct{
 	unsigned char space;
 	unsigned char length;
@@ -30,22 +30,27 @@
 #include <stdlib.h>
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <avr/pgmspace.h>
 #include "config.h"
 #include "gpsdo.h"
 #include "serial.h"
+#include "cpu.h"
 
-static uint16_t bps_div[BPS_LEN] =
+// Kept in flash, like the printf formats, as RAM is short
+static const uint32_t bps_rate[BPS_LEN] PROGMEM =
 {
-        UBRR_1200,
-        UBRR_2400,
-        UBRR_4800,
-        UBRR_9600,
-        UBRR_19200,
-        UBRR_38400,
-        UBRR_57600,
-        UBRR_115200
+        1200,
+        2400,
+        4800,
+        9600,
+        19200,
+        38400,
+        57600,
+        115200
 };
 
+static uint8_t serial_rate;			// BPS_* the port was set to
+
   volatile struct serial_buf * outbuf_head;		// Queue of things to be printed
   volatile struct serial_buf * outbuf_tail;		// Locates the end of queue
   
@@ -74,9 +79,8 @@ int8_t serial_init(uint8_t rate)
 	outbuf_tail = 0;
 
         // Set 12 bit baud rate divisor & double speed if req'd
-	UBRRH = (uint8_t)((bps_div[rate]>>8) & 0x0F);
-	UBRRL = (uint8_t)(bps_div[rate] & 0xFF);
-	if (bps_div[rate] & 0x8000) UCSRA |= 1<<U2X;
+	serial_rate = rate;
+	serial_clock(cpu_hz);
 
 	// Set 12 bit baud rate divisor & double speed if req'd
 	//UBRRH = 0; 
@@ -92,7 +96,33 @@ int8_t serial_init(uint8_t rate)
 	return 0;
 }
 
-int8_t serial_printf(const char *fmt, ...)
+void serial_clock(uint32_t hz)
+// Set the baud rate divisor for a CPU clock of hz. Normal speed (16
+// clocks a bit) is used if it is within 0.5% of the rate, otherwise
+// double speed if that comes closer.
+{
+	uint32_t bps = pgm_read_dword(&bps_rate[serial_rate]);
+	uint16_t n = (hz / (8 * bps) - 1) / 2;	// Normal, rounded
+	uint16_t f = (hz / (4 * bps) - 1) / 2;	// Double speed, rounded
+	uint32_t rn = hz / (16 * ((uint32_t)n + 1));	// Rates they give
+	uint32_t rf = hz / (8 * ((uint32_t)f + 1));
+	uint32_t en = rn > bps ? rn - bps : bps - rn;	// and their errors
+	uint32_t ef = rf > bps ? rf - bps : bps - rf;
+
+	if (en * 200 > bps && ef < en)
+	{
+	    n = f;
+	    UCSRA |= 1<<U2X;
+	} else {
+	    UCSRA &= ~(1<<U2X);
+	};
+	UBRRH = (uint8_t)((n>>8) & 0x0F);
+	UBRRL = (uint8_t)(n & 0xFF);
+};
+
+int8_t serial_printf_P(const char *fmt, ...)
+// As printf, but fmt is in flash (PSTR("...")), as string constants
+// would otherwise each take RAM as well
 {
 	struct serial_buf * buf;
 
@@ -110,7 +140,7 @@ int8_t serial_printf(const char *fmt, ...)
 	    // Format the string to be output into the buffer
 	    buf->ptr = buf->buf;				// Start at first character to print
 	    buf->next = 0;					// There is no next buffer yet
-	    vsnprintf(buf->buf, SERBUF_CLEN - 1, fmt, vars);	// Format string into buffer, truncate if too long
+	    vsnprintf_P(buf->buf, SERBUF_CLEN - 1, fmt, vars);	// Format string into buffer, truncate if too long
 
 	    // Link buffer into the output queue
 	    cbi(UCSRB, UDRIE);
@@ -29,8 +29,12 @@
 #ifndef SERIAL_H_
 #define SERIAL_H_
 
-// Number and *data* length of serial buffers
-#define SERBUF_NUM    8
+#include <avr/pgmspace.h>
+
+// Number and *data* length of serial buffers. Serial output is now only
+// the boot banner and debug lines (the data goes over SPI), so two will
+// do: one formatting while the other goes out.
+#define SERBUF_NUM    2
 #define SERBUF_CLEN  83			// 80 + CR + LF + null
 
 #if defined (__AVR_ATmega32A__)
@@ -67,244 +71,6 @@
 #define BPS_115200 7
 #define BPS_LEN BPS_115200 + 1
 
-// All the UBRR values for each baud rate (rounded)
-
-#define UBRRN_1200   ((F_CPU / (8L * 1200)   - 1) / 2)
-#define UBRRN_2400   ((F_CPU / (8L * 2400)   - 1) / 2)
-#define UBRRN_4800   ((F_CPU / (8L * 4800)   - 1) / 2)
-#define UBRRN_9600   ((F_CPU / (8L * 9600)   - 1) / 2)
-#define UBRRN_19200  ((F_CPU / (8L * 19200)  - 1) / 2)
-#define UBRRN_38400  ((F_CPU / (8L * 38400)  - 1) / 2)
-#define UBRRN_57600  ((F_CPU / (8L * 57600)  - 1) / 2)
-#define UBRRN_115200 ((F_CPU / (8L * 115200) - 1) / 2)
-
-// All the UBRR values for each baud rate in fast mode
-
-#define UBRRF_1200   ((F_CPU / (4L * 1200)   - 1) / 2)
-#define UBRRF_2400   ((F_CPU / (4L * 2400)   - 1) / 2)
-#define UBRRF_4800   ((F_CPU / (4L * 4800)   - 1) / 2)
-#define UBRRF_9600   ((F_CPU / (4L * 9600)   - 1) / 2)
-#define UBRRF_19200  ((F_CPU / (4L * 19200)  - 1) / 2)
-#define UBRRF_38400  ((F_CPU / (4L * 38400)  - 1) / 2)
-#define UBRRF_57600  ((F_CPU / (4L * 57600)  - 1) / 2)
-#define UBRRF_115200 ((F_CPU / (4L * 115200) - 1) / 2)
-
-// Error values for each (0 = within 0.5%, 1 = within 2%, -1 = out of spec), normal rate
-// Flags for baud rate table
-#define UBRR_FAST 0x8000			// In spec only in fast mode <= 2% error
-#define UBRR_ERR  0x4000			// Out of spec > 2% error
-#define UBRR_MGNL 0x2000			// Marginal .5% < error <= 2% 
-
-// 1200 bps constants
-
-#define ERRN (1 + (100 * F_CPU / (16 * (UBRRN_1200 + 1))) / 1200) % 100
-#define ERRF (1 + (100 * F_CPU / ( 8 * (UBRRF_1200 + 1))) / 1200) % 100
-
-#if ERRN <= 1					// Error is less than 0.5%
-  #define UBRR_1200 UBRRN_1200
-#elif ERRN <= 4					// Error is less than 2%
-  #if ERRF <= 1
-    #define UBRR_1200 (UBRRF_1200 | UBRR_FAST)
-  #else
-    #define UBRR_1200 (UBRRN_1200 | UBRR_MGNL)
-  #endif
-#else						// Error is >2%
-  #if ERRF <= 1					// But fast mode error is < .5%
-    #define UBRR_1200 (UBRRF_1200 | UBRR_FAST)
-  #elif ERRF <= 4
-    #define UBRR_1200 (UBRRF_1200 | UBRR_FAST ! UBRR_MGNL)
-  #else
-    #define UBRR_1200 (UBRRF_1200 | UBRR_FAST | UBRR_ERR)
-  #endif
-#endif
-
-#undef ERRN
-#undef ERRF
-
-// 2400 bps constants
-
-#define ERRN (1 + (100 * F_CPU / (16 * (UBRRN_2400 + 1))) / 2400) % 100
-#define ERRF (1 + (100 * F_CPU / ( 8 * (UBRRF_2400 + 1))) / 2400) % 100
-
-
-#if ERRN <= 1					// Error is less than 0.5%
-  #define UBRR_2400 UBRRN_2400
-#elif ERRN <= 4					// Error is less than 2%
-  #if ERRF <= 1
-    #define UBRR_2400 (UBRRF_2400 | UBRR_FAST)
-  #else
-    #define UBRR_2400 (UBRRN_2400 | UBRR_MGNL)
-  #endif
-#else
-  #if ERRF <= 1
-    #define UBRR_2400 (UBRRF_2400 | UBRR_FAST)
-  #elif ERRF <= 4
-    #define UBRR_2400 (UBRRF_2400 | UBRR_FAST | UBRR_MGNL)
-  #else
-    #define UBRR_2400 (UBRRF_2400 | UBRR_FAST | UBRR_ERR)
-  #endif
-#endif
-
-#undef ERRN
-#undef ERRF
-
-// 4800 bps
-
-#define ERRN (1 + (100 * F_CPU / (16 * (UBRRN_4800 + 1))) / 4800) % 100
-#define ERRF (1 + (100 * F_CPU / ( 8 * (UBRRF_4800 + 1))) / 4800) % 100
-
-#if ERRN <= 1					// Error is less than 0.5%
-  #define UBRR_4800 UBRRN_4800
-#elif ERRN <= 4					// Error is less than 2%
-  #if ERRF <= 1
-    #define UBRR_4800 (UBRRF_4800 | UBRR_FAST)
-  #else
-    #define UBRR_4800 (UBRRN_4800 | UBRR_MGNL)
-  #endif
-#else
-  #if ERRF <= 1
-    #define UBRR_4800 (UBRRF_4800 | UBRR_FAST)
-  #elif ERRF <= 4
-    #define UBRR_4800 (UBRRF_4800 | UBRR_FAST | UBRR_MGNL)
-  #else
-    #define UBRR_4800 (UBRRF_4800 | UBRR_FAST | UBRR_ERR)
-  #endif
-#endif
-
-
-#undef ERRN
-#undef ERRF
-
-// 9600 bps
-
-#define ERRN (1 + (100 * F_CPU / (16 * (UBRRN_9600 + 1))) / 9600) % 100
-#define ERRF (1 + (100 * F_CPU / ( 8 * (UBRRF_9600 + 1))) / 9600) % 100
-
-#if ERRN <= 1					// Error is less than 0.5%
-  #define UBRR_9600 UBRRN_9600
-#elif ERRN <= 4					// Error is less than 2%
-  #if ERRF <= 1
-    #define UBRR_9600 (UBRRF_9600 | UBRR_FAST)
-  #else
-    #define UBRR_9600 (UBRRN_9600 | UBRR_MGNL)
-  #endif
-#else
-  #if ERRF <= 1
-    #define UBRR_9600 (UBRRF_9600 | UBRR_FAST)
-  #elif ERRF <= 4
-    #define UBRR_9600 (UBRRF_9600 | UBRR_FAST | UBRR_MGNL)
-  #else
-    #define UBRR_9600 (UBRRF_9600 | UBRR_FAST | UBRR_ERR)
-  #endif
-#endif
-
-#undef ERRN
-#undef ERRF
-
-// 19200 bps
-
-#define ERRN (1 + (100 * F_CPU / (16 * (UBRRN_19200 + 1))) / 19200) % 100
-#define ERRF (1 + (100 * F_CPU / ( 8 * (UBRRF_19200 + 1))) / 19200) % 100
-
-#if ERRN <= 1					// Error is less than 0.5%
-  #define UBRR_19200 UBRRN_19200
-#elif ERRN <= 4					// Error is less than 2%
-  #if ERRF <= 1
-    #define UBRR_19200 (UBRRF_19200 | UBRR_FAST)
-  #else
-    #define UBRR_19200 (UBRRN_19200 | UBRR_MGNL)
-  #endif
-#else
-  #if ERRF <= 1
-    #define UBRR_19200 (UBRRF_19200 | UBRR_FAST)
-  #elif ERRF <= 4
-    #define UBRR_19200 (UBRRF_19200 | UBRR_FAST | UBRR_MGNL)
-  #else
-    #define UBRR_19200 (UBRRF_19200 | UBRR_FAST | UBRR_ERR)
-  #endif
-#endif
-
-#undef ERRN
-#undef ERRF
-
-// 38400 bps
-
-#define ERRN (1 + (100 * F_CPU / (16 * (UBRRN_38400 + 1))) / 38400) % 100
-#define ERRF (1 + (100 * F_CPU / ( 8 * (UBRRF_38400 + 1))) / 38400) % 100
-
-#if ERRN <= 1					// Error is less than 0.5%
-  #define UBRR_38400 UBRRN_38400
-#elif ERRN <= 4					// Error is less than 2%
-  #if ERRF <= 1
-    #define UBRR_38400 (UBRRF_38400 | UBRR_FAST)
-  #else
-    #define UBRR_38400 (UBRRN_38400 | UBRR_MGNL)
-  #endif
-#else
-  #if ERRF <= 1
-    #define UBRR_38400 (UBRRF_38400 | UBRR_FAST)
-  #elif ERRF <= 4
-    #define UBRR_38400 (UBRRF_38400 | UBRR_FAST |UBRR_MGNL)
-  #else
-    #define UBRR_38400 (UBRRF_38400 | UBRR_FAST |UBRR_ERR)
-  #endif
-#endif
-
-#undef ERRN
-#undef ERRF
-
-// 57600
-
-#define ERRN (1 + (100 * F_CPU / (16 * (UBRRN_57600 + 1))) / 57600) % 100
-#define ERRF (1 + (100 * F_CPU / ( 8 * (UBRRF_57600 + 1))) / 57600) % 100
-
-#if ERRN <= 1					// Error is less than 0.5%
-  #define UBRR_57600 UBRRN_57600
-#elif ERRN <= 4					// Error is less than 2%
-  #if ERRF <= 1
-    #define UBRR_57600 (UBRRF_57600 | UBRR_FAST)
-  #else
-    #define UBRR_57600 (UBRRN_57600 | UBRR_MGNL)
-  #endif
-#else
-  #if ERRF <= 1
-    #define UBRR_57600 (UBRRF_57600 | UBRR_FAST)
-  #elif ERRF <= 4
-    #define UBRR_57600 (UBRRF_57600 | UBRR_FAST | UBRR_MGNL)
-  #else
-    #define UBRR_57600 (UBRRF_57600 | UBRR_FAST | UBRR_ERR)
-  #endif
-#endif
-
-#undef ERRN
-#undef ERRF
-
-// 115200 bps
-
-#define ERRN (1 + (100 * F_CPU / (16 * (UBRRN_115200 + 1))) / 115200) % 100
-#define ERRF (1 + (100 * F_CPU / ( 8 * (UBRRF_115200 + 1))) / 11520) % 100
-
-#if ERRN <= 1					// Error is less than 0.5%
-  #define UBRR_115200 UBRRN_115200
-#elif ERRN <= 4					// Error is less than 2%
-  #if ERRF <= 1
-    #define UBRR_115200 (UBRRF_115200 | UBRR_FAST)
-  #else
-    #define UBRR_115200 (UBRRN_115200 | UBRR_MGNL)
-  #endif
-#else
-  #if ERRF <= 1
-    #define UBRR_115200 (UBRRF_115200 | UBRR_FAST)
-  #elif ERRF <= 4
-    #define UBRR_115200 (UBRRF_115200 | UBRR_FAST | UBRR_MGNL)
-  #else
-    #define UBRR_115200 (UBRRF_115200 | UBRR_FAST | UBRR_ERR)
-  #endif
-#endif
-
-#undef ERRN
-#undef ERRF
-
 struct serial_buf {
 	struct serial_buf *next;
 	char * ptr;
@@ -316,6 +82,7 @@ struct serial_buf {
 
 // External function prototypes
   int8_t serial_init(uint8_t);
-  int8_t serial_printf(const char *, ...);
+  void serial_clock(uint32_t);
+  int8_t serial_printf_P(const char *, ...);	// Format in flash, PSTR("...")
 
 #endif /* SERIAL_H_ */
@@ -9,6 +9,71 @@
 
 		Binary format: Based on SLIP characters:.
 
+		Each frame, both ways, is
+
+			len seq type data... crc_lo crc_hi END
+
+		escaped, where len counts type and data (so the frame never
+		starts with a NUL, which is idle) and the CRC is the
+		CRC-CCITT of avr-libc (_crc_ccitt_update(), from 0xFFFF) over
+		everything before it. The MCU numbers its frames; the master
+		can see one is missing from the gap and ask for it again with
+		SPICMD_RESEND, and a frame that fails its CRC costs only itself,
+		as the next starts after its END. Frames that have been sent
+		are kept until their buffer is needed for another, so the last
+		few can be resent; if it has gone a SPICMD_RESEND frame with its
+		sequence number says so, and if it has yet to go nothing is
+		said, as it is on its way.
+
+		Messages reporting events (spi_evbuf()) overwrite the oldest one
+		still waiting if there are no buffers, so a master that stops
+		reading finds the latest when it comes back, and spi_dropped
+		says how many it missed. Replies to queries (spi_replybuf()) get
+		a buffer the same way, as the master is waiting for them, but
+		are marked so that they are never overwritten themselves; if
+		every frame waiting is a reply the query goes unanswered and the
+		master asks again. Longer results sent a frame at a time
+		(spi_getbuf()) just wait for a buffer. Values wanted every
+		second are in tlm.c.
+
+		The SPI clock is limited by how long SPI_STC_vect takes to put
+		the next byte in SPDR, so it does nothing else. spi_tx_queue()
+		escapes a message in place and adds the END before it is queued,
+		and received bytes are stored as they come until END, to be
+		unescaped by spi_cmd() in the background. Each interrupt is then
+		a byte copy each way with a pointer and a count. Frames are kept
+		in one chain in the order they go, sent ones first, so finishing
+		a frame is just moving spi_tx on to the next; what has been sent
+		is everything before it. Receiving goes into a buffer spi_xeq()
+		has left ready, and a complete frame is left in spi_rxdone for
+		it. spi_xeq() runs from the main loop when spi_pending() says
+		there is something for it.
+
+		Cycles, counted by hand from what avr-gcc -Os makes of the C
+		(4 to respond, 3 for the jmp from the vector, 4 more if asleep,
+		the prologue with its pushes, then the body):
+
+		                                before  now
+		    to the next byte in SPDR      93     57
+		    whole interrupt, worst       ~285    127
+
+		Before, the interrupt called event_alloc() and led_state(), so
+		it saved all 12 call-clobbered registers; it now uses 8 and
+		calls nothing. The master clocks the bytes of a transfer back
+		to back, so the next byte must be in SPDR within one SCK period
+		of the last one ending: about 43kHz before and 70kHz now at
+		4MHz. Another interrupt running as a byte ends adds its length
+		(the EFC's is about 45 cycles), which 25kHz has room for; above
+		about 40kHz such a byte is garbled and the CRC and resend deal
+		with it. 100kHz needs a gap between bytes or a faster clock.
+
+		With SPI_DRDY set, DRDY_PIN is high from when a frame is
+		queued until spi_xeq() finds the END of the last one waiting
+		has gone to SPDR, so the master can wait for an edge on it
+		rather than polling. The first byte after an idle spell is the NUL already
+		in SPDR, then the frame, which starts with its length, so the
+		master knows how many more bytes to clock (one more for each
+		ESC among them).
 */
 
 /*
@@ -34,31 +99,48 @@
 #include <stdio.h>
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <util/crc16.h>
 #include "config.h"
 #include <stdint.h>
 #include "gpsdo.h"
 #include "spi.h"
 #include "led.h"
+#include "adev.h"
+#include "kalman.h"
+#include "disc.h"
+#include "temp.h"
+#include "tlm.h"
+#include "cmd.h"
 
-// Output only for now
-volatile struct spi_buf * spi_rx_head;            		// Queue of things to be printed
-volatile struct spi_buf * spi_rx_tail;            		// Locates the end of queue
-volatile struct spi_buf * spi_tx_head;            		// Queue of things to be printed
-volatile struct spi_buf * spi_tx_tail;            		// Locates the end of queue
+static void spi_cmd(struct spi_buf *);
+static void spi_resend(uint8_t);
+
+// Frames to send are in one chain, oldest first: those sent (kept for a
+// resend), then spi_tx going out, then those waiting to go
+volatile struct spi_buf * spi_sent_head;		// Oldest frame in the chain
+volatile struct spi_buf * spi_tx_tail;            	// Newest frame in the chain
+volatile struct spi_buf * spi_tx;			// Frame going out, 0 if idle
 
 	 struct spi_buf spi_bufs[SPIBUF_NUM];     	// Static spi buffer allocation
 volatile struct spi_buf * spi_free_head;       		// Free list for dedicated spi buffers
 
 volatile struct spi_buf * spi_rx;			// Active receive buffer
-volatile struct spi_buf * spi_tx;			// Active transmit buffer
+volatile struct spi_buf * spi_rxbuf;			// Ready for the next frame in
+volatile struct spi_buf * spi_rxdone;			// Frame in, for spi_xeq()
+static uint8_t spi_going;				// DRDY (and the red LED) up, for spi_xeq() to drop
 
-uint8_t spi_rx_shift;					// Receiver is in shift state
-uint8_t spi_tx_shift;					// Transmitter is in shift state
+uint8_t spi_seq;					// Sequence number of the next frame
+uint16_t spi_crcerr;					// Frames received with a bad CRC or length
+uint16_t spi_dropped;					// Event messages overwritten unsent
 
 void spi_init()
 {
-	// Enable output on MISO
+	// Enable output on MISO, and data ready
 	DDRB = (1 << MISO_PIN);
+#if SPI_DRDY
+	cbi(PORTB, DRDY_PIN);
+	sbi(DDRB, DRDY_PIN);
+#endif
 
 	// Enable SPI slave mode (configures all other required pins)
 	SPCR = (1 << SPE);
@@ -74,14 +156,20 @@ void spi_init()
             };
         };
 
-        // Initialize buffer pointers
-        spi_rx_head = 0;
-        spi_rx_tail = 0;
-        spi_tx_head = 0;
+        // Initialize buffer pointers, with one ready to receive
         spi_tx_tail = 0;
+	spi_sent_head = 0;
 
 	spi_tx = 0;
+	spi_going = 0;
 	spi_rx = 0;
+	spi_rxdone = 0;
+	spi_rxbuf = spi_free_head;
+	spi_free_head = spi_rxbuf->next;
+	spi_rxbuf->ptr = spi_rxbuf->buf;
+	spi_seq = 0;
+	spi_crcerr = 0;
+	spi_dropped = 0;
 
 	// NULs are used to indicate nothing to send (yet)
 	SPDR = NUL;	
@@ -90,6 +178,7 @@ void spi_init()
 	sbi(SPCR, SPIE);
 };
 struct spi_buf * spi_getbuf()
+// A free buffer, or else the oldest one sent
 {
 	struct spi_buf * buf;
 
@@ -97,158 +186,383 @@ struct spi_buf * spi_getbuf()
 	if (buf = (struct spi_buf *)spi_free_head)
 	{
 	    spi_free_head = buf->next;
+	} else if ((buf = (struct spi_buf *)spi_sent_head) && buf != spi_tx) {
+	    spi_sent_head = buf->next;
+	    if (spi_tx_tail == buf)
+	    {
+		spi_tx_tail = 0;
+	    };
+	} else {
+	    buf = 0;
+	};
+	if (buf)
+	{
 	    buf->ptr = buf->buf;
-	}
+	    buf->reply = 0;
+	};
 	sbi(SPCR, SPIE);
 	return buf;
 };
 
-void spi_tx_queue(struct spi_buf * buf)
+struct spi_buf * spi_evbuf()
+// A buffer for an event message. If there is none to be had, the oldest
+// message waiting to go (not the one going, nor a reply) is overwritten.
 {
-	// Get byte count from pointer then reset to start of message
-	buf->cnt = buf->ptr - buf->buf;
-	buf->ptr = buf->buf;
+	struct spi_buf * buf;
+	struct spi_buf * prev;
 
-	// Add to output queue, or to active tx buffer if tx not active
+	if (buf = spi_getbuf())
+	{
+	    return buf;
+	};
 	cbi(SPCR, SPIE);
-	if (spi_tx)
+	if (prev = (struct spi_buf *)spi_tx)
 	{
-	    if (spi_tx_tail)
+	    while ((buf = (struct spi_buf *)prev->next) && buf->reply)
 	    {
-		spi_tx_tail->next = buf;
-	    } else {
-		spi_tx_head = buf;
-		buf->next = 0;
+		prev = buf;
+	    };
+	};
+	if (buf)
+	{
+	    prev->next = buf->next;
+	    if (spi_tx_tail == buf)
+	    {
+		spi_tx_tail = prev;
 	    };
-	    spi_tx_tail = buf;
+	    buf->ptr = buf->buf;
+	    spi_dropped++;
+	};
+	sbi(SPCR, SPIE);
+	return buf;
+};
+
+struct spi_buf * spi_replybuf()
+// A buffer for the reply to a query, had as for an event message but
+// marked so that it is never overwritten itself
+{
+	struct spi_buf * buf;
+
+	if (buf = spi_evbuf())
+	{
+	    buf->reply = 1;
+	};
+	return buf;
+};
+
+static void spi_tx_append(struct spi_buf * buf)
+// Add an escaped frame to the end of the chain, and start it going if
+// nothing is. SPI interrupts must be off.
+{
+	buf->cnt = buf->len;
+	buf->ptr = buf->buf;
+	buf->next = 0;
+	if (spi_tx_tail)
+	{
+	    spi_tx_tail->next = buf;
 	} else {
+	    spi_sent_head = buf;
+	};
+	spi_tx_tail = buf;
+	if (!spi_tx)
+	{
 	    spi_tx = buf;
-	    // This is the reason transmissions can't start with ESC or END.
-	    // SPDR = *(spi_tx->ptr++);
-	    // spi_tx->cnt--;
-	}; 
+	};
+	spi_going = 1;
+#if SPI_DRDY
+	sbi(PORTB, DRDY_PIN);
+#endif
+};
+
+static char * spi_escape(char * to, char c)
+// Put one byte, escaped, before to
+{
+	if (c == (char)END)
+	{
+	    *(--to) = ESC_END;
+	    *(--to) = ESC;
+	} else if (c == (char)ESC) {
+	    *(--to) = ESC_ESC;
+	    *(--to) = ESC;
+	} else {
+	    *(--to) = c;
+	};
+	return to;
+};
+
+void spi_tx_queue(struct spi_buf * buf)
+// Frame the message (type and data) in the buffer and queue it
+{
+	uint8_t n = buf->ptr - buf->buf;
+	uint8_t seq = spi_seq++;
+	uint16_t crc = 0xFFFF;
+	int8_t len = 3;				// len, seq and END, unescaped
+	char * to;
+
+	if (n > SPIBUF_DLEN)
+	{
+	    // Too long to send; drop it as if there were no buffer
+	    cbi(SPCR, SPIE);
+	    buf->next = spi_free_head;
+	    spi_free_head = buf;
+	    sbi(SPCR, SPIE);
+	    return;
+	};
+
+	// Add the CRC after the message, then escape the lot in place, working
+	// back from the end, with the header in front and END after
+	crc = _crc_ccitt_update(crc, n);
+	crc = _crc_ccitt_update(crc, seq);
+	for (uint8_t i = 0; i < n; i++)
+	{
+	    crc = _crc_ccitt_update(crc, buf->buf[i]);
+	};
+	buf->buf[n] = crc & 0xFF;
+	buf->buf[n + 1] = crc >> 8;
+	for (uint8_t i = 0; i < n + 2; i++)
+	{
+	    len += (buf->buf[i] == (char)END || buf->buf[i] == (char)ESC) ? 2 : 1;
+	};
+	len += seq == END || seq == ESC;
+	len += n == END || n == ESC;
+	to = buf->buf + len;
+	*(--to) = END;
+	for (uint8_t i = n + 2; i-- > 0;)
+	{
+	    to = spi_escape(to, buf->buf[i]);
+	};
+	to = spi_escape(to, seq);
+	to = spi_escape(to, n);
+	buf->seq = seq;
+	buf->len = len;
+
+	cbi(SPCR, SPIE);
+	spi_tx_append(buf);
 	sbi(SPCR, SPIE);
 };
 
-// Execute any commands that may have come from the SPI master
-void spi_cmd()
+static int8_t spi_unescape(struct spi_buf * buf)
+// Undo the SLIP escapes of a received message in place. Returns its
+// length, or -1 if an ESC is followed by anything else.
+{
+	char * from = buf->buf;
+	char * to = buf->buf;
+	char * end = buf->buf + buf->cnt;
+
+	while (from < end)
+	{
+	    if (*from != (char)ESC)
+	    {
+		*(to++) = *(from++);
+	    } else if (++from < end && *from == (char)ESC_END) {
+		*(to++) = END;
+		from++;
+	    } else if (from < end && *from == (char)ESC_ESC) {
+		*(to++) = ESC;
+		from++;
+	    } else {
+		return -1;
+	    };
+	};
+	return to - buf->buf;
+};
+
+static uint8_t spi_unframe(struct spi_buf * buf)
+// Unescape a received frame and check its length and CRC. If it is good
+// leave ptr at the type, cnt the length with the data, and seq the
+// master's sequence number, and return 1.
+{
+	int8_t cnt = spi_unescape(buf);
+	uint16_t crc = 0xFFFF;
+
+	if (cnt < 5 || (uint8_t)buf->buf[0] != cnt - 4)
+	{
+	    return 0;
+	};
+	for (int8_t i = 0; i < cnt - 2; i++)
+	{
+	    crc = _crc_ccitt_update(crc, buf->buf[i]);
+	};
+	if ((uint8_t)buf->buf[cnt - 2] != (crc & 0xFF) || (uint8_t)buf->buf[cnt - 1] != crc >> 8)
+	{
+	    return 0;
+	};
+	buf->seq = buf->buf[1];
+	buf->cnt = cnt - 4;
+	buf->ptr = buf->buf + 2;
+	return 1;
+};
+
+static void spi_resend(uint8_t seq)
+// Queue a sent frame again, or say it has gone. One that is going, or
+// still waiting to go, comes in its turn.
 {
 	struct spi_buf * buf;
+	struct spi_buf * prev = 0;
+	uint8_t sent = 1;
 
 	cbi(SPCR, SPIE);
-	if (buf = (struct spi_buf *)spi_rx_head)
+	for (buf = (struct spi_buf *)spi_sent_head; buf; buf = (struct spi_buf *)buf->next)
 	{
-	    if(!(spi_rx_head = buf->next))
-            {
-		spi_rx_tail = 0;
+	    if (buf == spi_tx)
+	    {
+		sent = 0;
 	    };
-            sbi(SPCR, SPIE);
-	    switch (*(buf->ptr++))
+	    if (buf->seq == seq)
 	    {
-		case 1:
-		    msg1(buf);
-		    break;
-		default:
-		    // TBA - send "Unknown Message" repsonse
-		    break;
+		break;
 	    };
-	    cbi(SPCR, SPIE);
-            buf->next = spi_free_head;
-	    spi_free_head = buf;
+	    prev = buf;
+	};
+	if (buf && sent)
+	{
+	    if (prev)
+	    {
+		prev->next = buf->next;
+	    } else {
+		spi_sent_head = buf->next;
+	    };
+	    if (spi_tx_tail == buf)
+	    {
+		spi_tx_tail = prev;
+	    };
+	    spi_tx_append(buf);
 	};
 	sbi(SPCR, SPIE);
-	return;
+	if (!buf && (buf = spi_getbuf()))
+	{
+	    *(buf->ptr++) = SPICMD_RESEND;
+	    *(buf->ptr++) = seq;
+	    spi_tx_queue(buf);
+	};
+};
+
+// Execute a command that has come from the SPI master. Runs in the background
+// from spi_xeq() when the message is complete.
+static void spi_cmd(struct spi_buf * buf)
+{
+	if (!spi_unframe(buf))
+	{
+	    spi_crcerr++;
+	    buf->cnt = 0;
+	};
+	switch (buf->cnt > 0 ? *(buf->ptr++) : 0)
+	{
+	    case 1:
+		msg1(buf);
+		break;
+	    case SPICMD_ADEV:
+		adev_query();
+		break;
+	    case SPICMD_KAL:
+		kal_query((uint8_t *)buf->ptr, buf->cnt - 1);
+		break;
+	    case SPICMD_LOCK:
+		disc_report();
+		break;
+	    case SPICMD_TEMP:
+		temp_query((uint8_t *)buf->ptr, buf->cnt - 1);
+		break;
+	    case SPICMD_TLM:
+		tlm_query();
+		break;
+	    case SPICMD_RESEND:
+		if (buf->cnt == 2)
+		{
+		    spi_resend(*buf->ptr);
+		};
+		break;
+	    case 0:
+		break;				// Bad frame
+	    default:
+		// Get, set, statistics, version, and the error reply
+		cmd_query(buf->ptr[-1], buf->seq, (uint8_t *)buf->ptr, buf->cnt - 1);
+		break;
+	};
+	cbi(SPCR, SPIE);
+	buf->next = spi_free_head;
+	spi_free_head = buf;
+	sbi(SPCR, SPIE);
 }
 
+void spi_xeq(void)
+// Background work for SPI_STC_vect, from the main loop: run a command that
+// has come in, leave a buffer ready for the next, and drop DRDY once the
+// last frame waiting has gone to SPDR
+{
+	struct spi_buf * buf;
+
+	cbi(SPCR, SPIE);
+	buf = (struct spi_buf *)spi_rxdone;
+	spi_rxdone = 0;
+	sbi(SPCR, SPIE);
+	if (buf)
+	{
+	    buf->cnt = buf->ptr - buf->buf;
+	    spi_cmd(buf);
+	};
+	if (!spi_rxbuf && (buf = spi_evbuf()))
+	{
+	    cbi(SPCR, SPIE);
+	    spi_rxbuf = buf;
+	    sbi(SPCR, SPIE);
+	};
+	cbi(SPCR, SPIE);
+	if (!spi_tx)
+	{
+	    // DEBUG - turn red led off
+	    led_state(0, LEDR_unit);
+#if SPI_DRDY
+	    cbi(PORTB, DRDY_PIN);
+#endif
+	    spi_going = 0;
+	};
+	sbi(SPCR, SPIE);
+};
+
+uint8_t spi_pending(void)
+// Whether spi_xeq() has anything to do: a frame in, no buffer ready for
+// the next, or DRDY to drop now the last frame has gone
+{
+	return spi_rxdone || !spi_rxbuf || (spi_going && !spi_tx);
+};
+
 ISR(SPI_STC_vect)
 {
-	char txchar;
-	char rxchar;
+	uint8_t rxchar;
 
 	// We're here because the character has been received
 	rxchar = SPDR;
 
-	// If we're receiving something, then continue to do so
-	if (spi_rx)
+	// Transmit if there's something to send, first, as the master may
+	// already be clocking it out. The frame is escaped and ends in END,
+	// and stays in the chain once it has gone, for a resend.
+	if (spi_tx)
 	{
-	    if (rxchar == END)
-	    // END means move the buffer onto the receive queue, if there is one
+	    SPDR = *(spi_tx->ptr++);
+	    if (!--spi_tx->cnt)
 	    {
-		if (spi_rx_tail)
-		{
-		    spi_rx_tail->next = spi_rx;
-		} else {
-		    spi_rx_head = spi_rx;
-		}
-		spi_rx->next = 0;
-		spi_rx_tail = spi_rx;
-		spi_rx = 0;
-	    } else if (spi_rx_shift) {
-		if (rxchar == ESC_ESC)
-		{
-		    *(spi_rx->ptr++) = ESC;
-		} else if (rxchar == ESC_END){
-		    *(spi_rx->ptr++) = END;
-		// Only the above 2 options valid, toss transmission otherwise
-		} else {
-		    spi_rx->next = spi_free_head;
-		    spi_free_head = spi_rx;
-		};
-		spi_rx_shift = 0;
-	    } else if (rxchar == ESC) {
-		spi_rx_shift = -1;
-	    } else {
-		*(spi_rx->ptr++) = rxchar;
-	    };
-	} else if (rxchar != NUL) {
-            // Non-null characters indicate a message, capture it.
-	    spi_rx = spi_free_head;
-	    if (spi_rx)
-	    {
-	    	spi_free_head = spi_rx->next;
-                spi_rx->ptr = spi_rx->buf;
-		*(spi_rx->ptr++) = rxchar;
+		spi_tx = spi_tx->next;
 	    };
+	} else {
+	    SPDR = NUL;
 	};
-	// Transmit if there's something to send;
-	if (spi_tx)
+
+	// Store what comes in as it is, until END, for spi_xeq(). Anything
+	// but NUL starts a frame, in the buffer spi_xeq() left ready (if it
+	// hasn't had the chance, the frame is lost and the master resends).
+	if (spi_rx)
 	{
-	    if (spi_tx_shift)
+	    if (rxchar == END)
 	    {
-		SPDR = spi_tx_shift;
-		spi_tx_shift = 0;
-	    } else {
-		txchar = *(spi_tx->ptr++);
-		if (spi_tx->cnt--)
-		{
-		    if (txchar == END)
-		    {
-		        SPDR = ESC;
-		        spi_tx_shift = ESC_END;
-		    } else if (txchar == ESC) { 
-		        SPDR = ESC;
-		        spi_tx_shift = ESC_ESC;
-		    } else {
-			SPDR = txchar;
-			spi_tx_shift = 0;
-		    };
-		} else {
-		    // DEBUG - turn red led off
-		    led_state(0, LEDR_unit);
-		    SPDR = END;
-
-		    // Return this buffer to the free pool
-		    spi_tx->next = spi_free_head;
-		    spi_free_head = spi_tx;
-
-		    // Get another buffer from the xmit queue, if any
-		    if (spi_tx = spi_tx_head)
-		    {
-		    	spi_tx_head = spi_tx->next;
-		    };
-		};
+		spi_rxdone = spi_rx;
+		spi_rx = 0;
+	    } else if (spi_rx->ptr < spi_rx->buf + SPIBUF_CLEN) {
+		// Still escaped; anything past the end is lost
+		*(spi_rx->ptr++) = rxchar;
 	    };
-	} else {
-	    SPDR = NUL;
+	} else if (rxchar != NUL && rxchar != END && (spi_rx = spi_rxbuf)) {
+	    spi_rxbuf = 0;
+	    *(spi_rx->ptr++) = rxchar;
 	};
 };
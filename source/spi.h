@@ -30,9 +30,11 @@
 #define SPI_H_
 
 #define SPIBUF_NUM 4
-#define SPIBUF_CLEN 24
+#define SPIBUF_DLEN 21				// Longest message (type and data)
+#define SPIBUF_CLEN (2 * (SPIBUF_DLEN + 4) + 1)	// With seq, len and CRC, every byte escaped, and END
 
 #define MISO_PIN 6
+#define DRDY_PIN 3			// Data ready out, PB3 (pin 4), if SPI_DRDY
 
 // Control characters
 #define NUL  0
@@ -43,11 +45,28 @@
 
 // Commands
 #define SPICMD_PPS 0x01
+#define SPICMD_ADEV 0x02
+#define SPICMD_HOLD 0x03
+#define SPICMD_KAL 0x04
+#define SPICMD_LOCK 0x05
+#define SPICMD_TEMP 0x06
+#define SPICMD_RESEND 0x07
+#define SPICMD_TLM 0x08
+#define SPICMD_GET 0x09			// Request/response commands (cmd.c)
+#define SPICMD_SET 0x0A
+#define SPICMD_STATS 0x0B
+#define SPICMD_RESET 0x0C
+#define SPICMD_VERSION 0x0D
+#define SPICMD_ERROR 0x0E
+#define SPICMD_STREAM 0x0F			// Capture records (stream.c)
 
 struct spi_buf {
         volatile struct spi_buf *next;
         volatile char * ptr;
 	volatile int8_t cnt;
+	int8_t len;			// Escaped frame length, to resend it
+	uint8_t seq;			// Frame sequence number
+	uint8_t reply;			// Reply to a query, never overwritten
         char buf[SPIBUF_CLEN];
 };
 
@@ -55,9 +74,16 @@ struct spi_buf {
 void spi_init();
 uint8_t spi_printf(const char *, ...);
 
+extern uint16_t spi_crcerr;
+extern uint16_t spi_dropped;
+extern uint8_t spi_seq;
+
 struct spi_buf * spi_getbuf();
+struct spi_buf * spi_evbuf();
+struct spi_buf * spi_replybuf();
 void spi_tx_queue(struct spi_buf *);
-void spi_cmd();
+void spi_xeq(void);
+uint8_t spi_pending(void);
 void msg1(struct spi_buf *);
 
 #endif
@@ -0,0 +1,170 @@
+/*
+ * stream.c
+ *
+ *  Created on: October 15, 2026
+ *  Per-second capture records, batched into SPI frames
+ */
+
+/*
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+*/
+
+#include <avr/io.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "spi.h"
+#include "stream.h"
+
+/*
+ A reporting interval's phase is all the master normally hears of the
+ pulses. For looking at the GPS receiver or the oscillator itself it can
+ have every one: its error in cycles from the whole seconds since the last
+ good pulse, what pps.c made of it, and the seconds if not one.
+
+ One record a second in a frame of its own would be mostly framing, so up
+ to stream_batch of them go in one SPICMD_STREAM message:
+
+	SPICMD_STREAM, first record number (2 bytes), record count, records...
+
+ The count is one byte, as stream_batch is, so the master need not
+ decode the records to know how many the frame holds.
+
+ A record is the difference from the one before (from 0 for the first in
+ a frame, so each frame stands alone), zigzag coded so small negative
+ differences are small numbers, shifted left one with the low bit set if
+ the pulse was not a good one a second after the last, then written 7 bits
+ at a time, low first, with the top bit set on all but the last byte. If
+ the low bit was set a status byte (STREAM_OK...) and the seconds, coded
+ the same way, follow. With the oscillator's offset taken out by the
+ differences and a GPS receiver good to some tens of ns, most records are
+ one byte. The master can tell a lost frame from a gap in the record
+ numbers.
+
+ stream_bytes counts the frames' bytes on the wire, escapes, CRC and all,
+ so stream_bytes / stream_records is what each second costs.
+*/
+
+uint8_t  stream_batch = STREAM_BATCH;	// Records per frame (0 = off)
+uint16_t stream_rec;			// Next record number
+uint32_t stream_records;		// Records sent
+uint32_t stream_frames;			// Frames they went in
+uint32_t stream_bytes;			// Bytes those took on the wire
+
+static uint8_t stream_data[SPIBUF_DLEN - 4];	// Records waiting
+static uint8_t stream_len;		// Bytes in it
+static uint8_t stream_cnt;		// Records in it
+static int32_t stream_prev;		// Error in the last of them
+
+static uint8_t stream_varint(uint8_t * p, uint32_t v)
+// Write v 7 bits at a time, returning the bytes used
+{
+	uint8_t n = 0;
+
+	while (v >= 0x80)
+	{
+	    p[n++] = v | 0x80;
+	    v >>= 7;
+	};
+	p[n++] = v;
+	return n;
+};
+
+static uint8_t stream_code(uint8_t * p, int32_t err, uint32_t n, uint8_t status)
+// Code a record, returning its length
+{
+	int32_t d = err - stream_prev;
+	uint32_t zz = ((uint32_t)d << 1) ^ (uint32_t)(d >> 31);
+	uint8_t flag = status != STREAM_OK || n != 1;
+	uint8_t len;
+
+	len = stream_varint(p, zz << 1 | flag);
+	if (flag)
+	{
+	    p[len++] = status;
+	    len += stream_varint(p + len, n);
+	};
+	return len;
+};
+
+void stream_pps(int32_t err, uint32_t n, uint8_t status)
+// Called by pps.c with each pulse, once the clock is known
+{
+	uint8_t rec[STREAM_MAX];
+	uint8_t len;
+
+	if (!stream_batch)
+	{
+	    return;
+	};
+	len = stream_code(rec, err, n, status);
+	if (stream_len + len > sizeof stream_data)
+	{
+	    stream_flush();
+	    len = stream_code(rec, err, n, status);
+	};
+	for (uint8_t i = 0; i < len; i++)
+	{
+	    stream_data[stream_len++] = rec[i];
+	};
+	stream_prev = err;
+	if (++stream_cnt >= stream_batch)
+	{
+	    stream_flush();
+	};
+};
+
+void stream_flush(void)
+// Send the records waiting
+{
+	struct spi_buf * buf;
+	uint16_t first = stream_rec;
+
+	if (!stream_cnt)
+	{
+	    return;
+	};
+	// The record numbers are used up either way, so the master sees a gap
+	stream_rec += stream_cnt;
+	if (buf = spi_evbuf())
+	{
+	    *(buf->ptr++) = SPICMD_STREAM;
+	    *(buf->ptr++) = first & 0xFF;
+	    *(buf->ptr++) = first >> 8;
+	    *(buf->ptr++) = stream_cnt;
+	    for (uint8_t i = 0; i < stream_len; i++)
+	    {
+		*(buf->ptr++) = stream_data[i];
+	    };
+	    spi_tx_queue(buf);
+	    stream_records += stream_cnt;
+	    stream_frames++;
+	    stream_bytes += buf->len;
+	};
+	stream_len = 0;
+	stream_cnt = 0;
+	stream_prev = 0;
+};
+
+void stream_set(uint8_t batch)
+// Set the records per frame, sending what is waiting first
+{
+	stream_flush();
+	stream_batch = batch;
+};
@@ -0,0 +1,51 @@
+/*
+ * stream.h
+ *
+ *  Created on: October 15, 2026
+ *  Per-second capture records, batched into SPI frames
+ */
+
+/*
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+*/
+
+#ifndef STREAM_H_
+#define STREAM_H_
+
+#include <stdint.h>
+
+// What became of a pulse
+#define STREAM_OK 0			// Accepted
+#define STREAM_GLITCH 1			// Doubled or out of tolerance
+#define STREAM_OUTLIER 2		// Outside the median gate
+#define STREAM_TRIM 3			// Used to trim the RC oscillator
+
+#define STREAM_MAX 11			// Longest record, bytes
+
+extern uint8_t  stream_batch;		// Records per frame (0 = off)
+extern uint16_t stream_rec;		// Next record number
+extern uint32_t stream_records;		// Records sent
+extern uint32_t stream_frames;		// Frames they went in
+extern uint32_t stream_bytes;		// Bytes those took on the wire
+
+void stream_pps(int32_t, uint32_t, uint8_t);
+void stream_flush(void);
+void stream_set(uint8_t);
+
+#endif /* STREAM_H_ */
@@ -0,0 +1,272 @@
+/*
+ * temp.c
+ *
+ *  Created on: October 15, 2026
+ *  Temperature compensation of the oscillator from a thermistor on the ADC
+ */
+
+/*
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+*/
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "event.h"
+#include "spi.h"
+#include "disc.h"
+#include "cpu.h"
+#include "temp.h"
+
+/*
+ What the loop can't see coming is the oscillator moving with the
+ temperature: it only finds out from the phase, after the fact, so a
+ change of temperature shows up as wander while locked and goes
+ uncorrected in holdover. A thermistor divider on ADC channel TEMP_MUX
+ measures it instead, and the frequency it causes is put right as it
+ happens (feed-forward).
+
+ The ADC is otherwise idle. It is started by each Timer 1 overflow (auto
+ trigger), every 65536 cycles, and TEMP_N = 4^TEMP_OVS results are added
+ up in the ISR and shifted down TEMP_OVS bits, for a reading of 10 +
+ TEMP_OVS bits about once a second. Oversampling only adds resolution if
+ the input has about an LSB of noise on it to dither the conversions,
+ which a thermistor next to an oven usually does; the reading is in ADC
+ steps, not degrees, as the slope is learned anyway.
+
+ While the loop is locked, the code it settles on (with the correction
+ in force added back) is the code the oscillator needs, so each update
+ regresses that on the mean reading since the last, and on the time, as
+ the oscillator's aging moves the code too. The means and the sums of
+ squares and products about them forget exponentially over TEMP_TAU
+ seconds: for each of the reading t, time s and code c,
+
+	mt += a.dt,	Stc = (1-a).(Stc + a.dt.dc),	a = T/TEMP_TAU
+
+ (dt, dc the reading and code less their means, and likewise for the
+ rest) and the slope, with the time held constant, is
+
+	k = (Stc - Sts.Ssc/Sss) / (Stt - Sts^2/Sss)
+
+ Once there have been TEMP_MIN_N updates and the reading has varied by
+ more than TEMP_MINVAR (mean square, the denominator) the correction
+
+	k.(t - t0)
+
+ is added to the loop's code whenever either changes (disc_efc()). t0 is
+ the mean reading when it started, and stays put so that the correction
+ doesn't move the code hold.c is learning from as the mean moves. Since
+ the regression is on the total code, an error in k is left for the loop
+ to take up and learned out at the next updates. Nothing is learned in
+ holdover, where the correction goes on from what was last learned.
+*/
+
+#define TEMP_N (1 << 2 * TEMP_OVS)
+
+static uint32_t temp_acc;		// Sum of conversions (ISR)
+static uint16_t temp_cnt;		// Conversions in it (ISR)
+
+uint16_t temp_t;			// Latest reading, TEMP_BITS
+float    temp_sum;			// Readings since the last update
+uint16_t temp_sn;			// and how many
+uint8_t  temp_on;			// Add the correction to the EFC
+uint8_t  temp_ok;			// The slope is good enough to use
+uint16_t temp_n;			// Regression updates
+float    temp_t0;			// Reading the correction is zero at
+float    temp_mt;			// Mean reading
+float    temp_mc;			// Mean code
+float    temp_ds;			// Seconds from the mean time to the last update
+float    temp_stt;			// Mean squares and products about the means:
+float    temp_sts;			// reading, time (seconds) and code
+float    temp_sss;
+float    temp_stc;
+float    temp_ssc;
+float    temp_k;			// Slope, codes per reading step
+
+static void temp_read(struct event *);
+
+void temp_init(void)
+// Start reading the temperature
+{
+	temp_acc = 0;
+	temp_cnt = 0;
+	temp_sum = 0;
+	temp_sn = 0;
+	temp_n = 0;
+	temp_ok = 0;
+	temp_k = 0;
+	temp_on = TEMP_COMP;
+	ADMUX = 1<<REFS0 | TEMP_MUX;		// AVcc reference
+	SFIOR = (SFIOR & ~(1<<ADTS2 | 1<<ADTS1 | 1<<ADTS0)) | 1<<ADTS2 | 1<<ADTS1;
+	ADCSRA = 1<<ADEN | 1<<ADATE | 1<<ADIE;
+	temp_clock(cpu_hz);
+};
+
+void temp_clock(uint32_t hz)
+// Set the ADC clock prescaler for a CPU clock of hz, the fastest that
+// keeps the ADC clock at 200kHz or under
+{
+	uint8_t ps = 1;
+
+	while (ps < 7 && hz > (200000UL << ps))
+	{
+	    ps++;
+	};
+	ADCSRA = (ADCSRA & ~(1<<ADPS2 | 1<<ADPS1 | 1<<ADPS0)) | ps;
+};
+
+ISR(ADC_vect)
+{
+	struct event * ev;
+
+	temp_acc += ADC;
+	if (++temp_cnt < TEMP_N)
+	{
+	    return;
+	};
+	if (ev = event_alloc())
+	{
+	    ev->ev_ufn = temp_read;
+	    ev->ev_data.longs = temp_acc;
+	    event_post();
+	};
+	temp_acc = 0;
+	temp_cnt = 0;
+}
+
+static void temp_read(struct event * ev)
+// A new reading: correct the EFC for it
+{
+	temp_t = ev->ev_data.longs >> TEMP_OVS;
+	temp_sum += temp_t;
+	temp_sn++;
+	if (disc_mode >= DISC_COARSE)
+	{
+	    disc_efc();
+	};
+};
+
+float temp_ff(void)
+// Correction for the latest reading, codes
+{
+	return temp_on && temp_ok ? temp_k * ((float)temp_t - temp_t0) : 0;
+};
+
+void temp_lock(float u, uint32_t t)
+// Called by the loop while tracking: its code u has been in force for
+// the last t seconds
+{
+	float tm, c, a, dt, ds, dc, v;
+
+	if (!temp_sn)
+	{
+	    return;
+	};
+	tm = temp_sum / temp_sn;
+	c = u + (temp_on && temp_ok ? temp_k * (tm - temp_t0) : 0);
+	temp_sum = 0;
+	temp_sn = 0;
+	if (!temp_n)
+	{
+	    temp_mt = tm;
+	    temp_mc = c;
+	    temp_ds = 0;
+	    temp_stt = temp_sts = temp_sss = 0;
+	    temp_stc = temp_ssc = 0;
+	} else {
+	    a = t < TEMP_TAU ? (float)t / TEMP_TAU : 1;
+	    dt = tm - temp_mt;
+	    ds = temp_ds + t;
+	    dc = c - temp_mc;
+	    temp_mt += a * dt;
+	    temp_ds = (1 - a) * ds;
+	    temp_mc += a * dc;
+	    temp_stt = (1 - a) * (temp_stt + a * dt * dt);
+	    temp_sts = (1 - a) * (temp_sts + a * dt * ds);
+	    temp_sss = (1 - a) * (temp_sss + a * ds * ds);
+	    temp_stc = (1 - a) * (temp_stc + a * dt * dc);
+	    temp_ssc = (1 - a) * (temp_ssc + a * ds * dc);
+	};
+	if (temp_n < 0xFFFF)
+	{
+	    temp_n++;
+	};
+	if (temp_n < TEMP_MIN_N || temp_sss <= 0)
+	{
+	    return;
+	};
+	v = temp_stt - temp_sts * temp_sts / temp_sss;
+	if (v > TEMP_MINVAR)
+	{
+	    temp_k = (temp_stc - temp_sts * temp_ssc / temp_sss) / v;
+	    if (!temp_ok)
+	    {
+		temp_t0 = temp_mt;
+		temp_ok = 1;
+	    };
+	};
+};
+
+void temp_query(uint8_t * set, uint8_t len)
+// SPI master sent SPICMD_TEMP, with 0 or 1 to turn the correction off or
+// on if len is 1. The reply is: SPICMD_TEMP, on, slope usable, reading,
+// mean reading (2 bytes each), slope (2^-16 codes per reading step, 4
+// bytes), correction now (codes, 2 bytes), updates (2 bytes), all little
+// endian.
+{
+	struct spi_buf * buf;
+	uint16_t v[4];
+	int32_t k = temp_k * 65536.0f;
+
+	if (len == 1)
+	{
+	    temp_on = set[0] != 0;
+	    if (disc_mode >= DISC_COARSE)
+	    {
+		disc_efc();
+	    };
+	};
+	if (!(buf = spi_getbuf()))
+	{
+	    return;
+	};
+	v[0] = temp_t;
+	v[1] = temp_mt + 0.5f;
+	v[2] = (int16_t)temp_ff();
+	v[3] = temp_n;
+	*(buf->ptr++) = SPICMD_TEMP;
+	*(buf->ptr++) = temp_on;
+	*(buf->ptr++) = temp_ok;
+	*(buf->ptr++) = v[0] & 0xFF;
+	*(buf->ptr++) = v[0] >> 8;
+	*(buf->ptr++) = v[1] & 0xFF;
+	*(buf->ptr++) = v[1] >> 8;
+	*(buf->ptr++) = k & 0xFF;
+	*(buf->ptr++) = (k >>  8) & 0xFF;
+	*(buf->ptr++) = (k >> 16) & 0xFF;
+	*(buf->ptr++) = (k >> 24) & 0xFF;
+	for (uint8_t i = 2; i < 4; i++)
+	{
+	    *(buf->ptr++) = v[i] & 0xFF;
+	    *(buf->ptr++) = v[i] >> 8;
+	};
+	spi_tx_queue(buf);
+};
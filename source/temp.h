@@ -0,0 +1,48 @@
+/*
+ * temp.h
+ *
+ *  Created on: October 15, 2026
+ *  Temperature compensation of the oscillator from a thermistor on the ADC
+ */
+
+/*
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+*/
+
+#ifndef TEMP_H_
+#define TEMP_H_
+
+#include <stdint.h>
+
+#define TEMP_BITS (10 + TEMP_OVS)	// Bits in a reading
+
+extern uint16_t temp_t;			// Latest reading, TEMP_BITS
+extern uint8_t  temp_on;		// Add the correction to the EFC
+extern uint8_t  temp_ok;		// The slope is good enough to use
+extern uint16_t temp_n;			// Regression updates
+extern float    temp_mt;		// Mean reading
+extern float    temp_k;			// Slope, codes per reading step
+
+void temp_init(void);
+void temp_clock(uint32_t);
+void temp_lock(float, uint32_t);
+float temp_ff(void);
+void temp_query(uint8_t *, uint8_t);
+
+#endif /* TEMP_H_ */
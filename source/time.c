@@ -43,43 +43,39 @@
 #include "serial.h"
 #include "gpsdo.h"
 #include "led.h"
+#include "cpu.h"
 
 // Internal function prototypes
 
 unsigned char ltime_xeq(struct tlist *);
+static void time_insert(struct tlist *);
+static void time_rearm(void);
+static uint8_t time_period(void);
 
 
 //Fork counts (Union of forkq array and individual labels). Counts should not exceed 1.
 
-volatile uint8_t std_timer;			// 10ms timer completion count
+volatile uint16_t std_timer;			// 10ms timer completion count
 
 // END EXTERNAL
 
 
-// Move these defines to .h file
-#if F_CPU > 255 * 100 * 1024		// >= 26.112 MHz
-  #pragma GCC error "F_CPU exceeds maximum permissable value"
-#elif F_CPU > 255 * 100 * 256		// >= 6.528 MHz
-  #define prescale 1024
-  #define clock_select (1<<CS02 | 1<<CS00)
-#elif F_CPU > 255 * 100 * 64		// >= 1.632 MHz
-  #define prescale 256
-  #define clock_select 1<<CS02
-#elif F_CPU > 255 * 100 * 8		// >= 204 kHz
-  #define prescale 64
-  #define clock_select (1<<CS01 | 1<<CS00)
-#elif F_CPU > 255 * 100			// >=25.5 kHz
-  #define prescale 8
-  #define clock_select 1<<CS01
-#else
-  #pragma GCC error "F_CPU value is too low"
-#endif
+// Timer0 prescaler and tick length for the CPU clock, set by time_clock()
+// when it is known (cpu.c) rather than from F_CPU at build time
+static uint8_t  prescale_log2;			// Timer0 prescaler, as a power of 2
+static uint8_t  clock_select;			// and its clock select bits
+static int32_t  tick_cycles;			// CPU cycles in a 10ms tick
+static uint16_t tick_span;			// Ticks beyond reach of one compare
+
+// The prescaler is a power of 2, so it is applied with shifts and masks
+// rather than 32 bit multiplies and divides
+#define prescale (1 << prescale_log2)		// Timer0 prescaler
 
 // Values to track drift. 
-#define lead_interval (F_CPU / 100 / prescale) // Standard counter interval
+#define lead_interval (tick_cycles >> prescale_log2)	// Standard counter interval
 #define lag_interval (lead_interval + 1)	// Drift correction counter
 
-#define lead ((F_CPU / 100) % prescale)	// Drift due to std_interval
+#define lead (tick_cycles & (prescale - 1))	// Drift due to std_interval
 #define lag (prescale - lead)		// Drift due to alt_interval
 
 // Calculate initial value of drift counter to remove bias offset
@@ -110,21 +106,26 @@ volatile uint8_t std_timer;			// 10ms timer completion count
 #endif
 */
 
+#ifndef TIMEBUF_NUM
 #define TIMEBUF_NUM 5
+#endif
+
+// Slots in the timer wheel, must be a power of 2
+#define TIME_WHEEL 8
 
 
 volatile struct tlist *time_free;	// Free timer buffers
 volatile struct tlist *time_fork;	// Interface between ISR & bacground
-	 struct tlist *time_active;	// Main timer
+	 struct tlist *time_wheel[TIME_WHEEL];	// Main timer, hashed by expiry tick
+	 uint8_t time_slot;		// Wheel slot of the last tick processed
 	 struct tlist *time_done;	// Expired timer list
 
 	 struct tlist time_bufs[TIMEBUF_NUM];
 
-#if prescale > 127
-volatile int16_t drift;				// # of ticks ahead (behind) actual time
-#else
-volatile int8_t drift;
-#endif
+volatile int32_t drift;				// # of cycles ahead (behind) actual time
+
+volatile uint16_t time_pend;			// Ticks counted by Timer0, not yet signalled
+volatile uint16_t time_sleep;			// Signal the background after this many ticks
 
 /* Standard Timer
 
@@ -144,12 +145,36 @@ volatile int8_t drift;
 	increasing the value of the count register by 1 every 8th
 	cycle, the error can be maintained at < .08ms.
 
+	On the ATmega32A the correction is done by keeping drift, the
+	number of cycles the compare interrupts have run ahead of the
+	ticks they have counted, and choosing each compare interval to
+	bring the next tick boundary as close as possible to the right
+	cycle. Drift therefore stays within half a prescale count for
+	ever. In CTC mode the interval is OCR0 + 1 counts.
+
+	Tickless mode (TIME_TICKLESS in config.h): the background tells
+	the interrupt, through time_sleep, how many ticks it can sleep
+	before the next timer is due. The interrupt keeps counting ticks
+	in time_pend, but each compare interval is stretched as far as
+	the 8 bit counter allows towards the deadline and std_timer is
+	only bumped when the deadline arrives, so proc_timer() has
+	nothing to do on the wake-ups in between. The prescaler is 1024
+	in this mode to let one compare span as many ticks as possible.
+
 	The 10ms timer runs continuously once time_init is called. When
 	a timer is set to a positive integer, it creates an entry on the
-	time_active queue. The entry is moved to the time_done queue
-	when the timer expires. Setting a timer of zero ticks places the
-	entry on the time_done queue which is a sneaky way to invoke a
-	background callback function from an ISR.
+	time_wheel. The entry is moved to the time_done queue when the
+	timer expires. Setting a timer of zero ticks places the entry on
+	the time_done queue which is a sneaky way to invoke a background
+	callback function from an ISR.
+
+	The time_wheel is a hashed timing wheel. Each tick moves on to the
+	next of its TIME_WHEEL slots, and a timer is linked into the slot
+	that will be current when it expires, with tl_ticks reduced to the
+	number of times round the wheel it has yet to go. A tick therefore
+	only looks at 1/TIME_WHEEL of the running timers (plus those that
+	expire) rather than counting down every one, and setting or
+	rescheduling a timer never has to search a list.
 */
 
 void time_init(void)
@@ -158,18 +183,25 @@ void time_init(void)
 // 1024, for most clock speeds we will need to adjust the count
 // to eliminate cumulative error.
 {
-	// Initialize the main timer list & timer expired tlists
-	time_active = 0;
+	// Initialize the main timer wheel & timer expired tlists
+	for (uint8_t i = 0; i < TIME_WHEEL; i++)
+	{
+	    time_wheel[i] = 0;
+	};
+	time_slot = 0;
 	time_fork = 0;
 	time_done = 0;
 
-	drift = -lead;
+#if defined (__AVR_ATmega32A__)
+	time_pend = 0;
+	time_sleep = 1;
+#endif
 
         // Create the free list of events.
 	time_free = time_bufs;
         {
             struct tlist * next = 0;
-            for (int8_t i = TIMEBUF_NUM; i-- > 0;)
+            for (uint8_t i = TIMEBUF_NUM; i-- > 0;)
             {
                 time_bufs[i].tl_next = next;
                 next = &time_bufs[i];
@@ -181,19 +213,59 @@ void time_init(void)
 
 	// Initialize 8 bit timer/counter 0.
 	// Count up to <interval> and generate interrupt 
+	time_clock(cpu_hz);
 #if defined (__AVR_ATmega32A__)
-	OCR0 = lead_interval;			// Use shorter interval
-	TCCR0 = (1<<WGM01 | clock_select);	// CTC mode, Set prescaler
 	//TIMSK = 1<<OCIE0;			// Interrupt on expiry
 	sbi(TIMSK, OCIE0);			// Interrupt on expiry
 #elif defined (__AVR_ATmega1284P__)
-	OCR0A = lead_interval;			// Interval <= 10ms
-	OCR0B = lag_interval;			// Interval > 10ms
 	//TIMSKA = 1<<OCIE0A;			// lead <= lag, use lead
 	sbi(TIMSK, OCIE0);			// Interrupt on expiry
+#endif
+};
+
+void time_clock(uint32_t hz)
+// Set Timer0 up for a CPU clock of hz: the smallest prescaler that lets
+// a 10ms tick fit in the 8 bit counter (1024 in tickless mode), from
+// 25.5kHz to 26.1MHz. Called by time_init() and again once the clock
+// has been measured; the tick in progress is started again.
+{
+	uint8_t sreg = SREG;
+	uint8_t p;				// log2 of the prescaler
+	uint8_t cs;
+
+	if (hz > 255UL * 100 * 256 || (TIME_TICKLESS && hz > 8UL * 100 * 1024))
+	{
+	    p = 10;				// >= 6.528 MHz, or tickless >= 819 kHz
+	    cs = 1<<CS02 | 1<<CS00;
+	} else if (hz > 255UL * 100 * 64) {	// >= 1.632 MHz
+	    p = 8;
+	    cs = 1<<CS02;
+	} else if (hz > 255UL * 100 * 8) {	// >= 204 kHz
+	    p = 6;
+	    cs = 1<<CS01 | 1<<CS00;
+	} else {				// >=25.5 kHz
+	    p = 3;
+	    cs = 1<<CS01;
+	};
+
+	cli();
+	prescale_log2 = p;
+	clock_select = cs;
+	tick_cycles = hz / 100;
+	tick_span = (256UL << p) / tick_cycles + 1;
+#if defined (__AVR_ATmega32A__)
+	drift = 0;
+	TCNT0 = 0;
+	OCR0 = time_period();			// Interval to the first tick
+	TCCR0 = (1<<WGM01 | clock_select);	// CTC mode, Set prescaler
+#elif defined (__AVR_ATmega1284P__)
+	drift = -lead;
+	OCR0A = lead_interval;			// Interval <= 10ms
+	OCR0B = lag_interval;			// Interval > 10ms
 	TCCR0A = 1<<WGM01;			// CTC mode
 	TCCR0B = (1<<FOC0A | clock_select);	// Set prescaler & lead intval
 #endif
+	SREG = sreg;				// Interrupts back as they were
 };
 
 /* time_set(ufn, ticks, context, data[], periodic)
@@ -214,7 +286,7 @@ int8_t time_set(unsigned char (*ufn)(struct tlist *), uint8_t ticks, uint8_t con
 	    time_free = ptr->tl_next;
 	    sei();
 
-	    ptr->tl_ticks = ticks;				// Set timer interval (decremented by interrupt)
+	    ptr->tl_ticks = ticks;				// Set timer interval (counted down by proc_timer)
 	    ptr->tl_interval = periodic ? ticks : 0; 		// Set recurrence if desired
 	    ptr->tl_ufn = ufn;					// Set callback function
 	    ptr->tl_ucontext = context;				// User context
@@ -230,8 +302,8 @@ int8_t time_set(unsigned char (*ufn)(struct tlist *), uint8_t ticks, uint8_t con
 	    // If an interval is specified, set it up, otherwise expire the new timer immediately
 	    if (ticks)
 	    {
-		ptr->tl_next = time_active;
-		time_active = ptr;
+		time_insert(ptr);
+		time_rearm();
 	    } else {
 		ptr->tl_next = time_done;
 		time_done = ptr;
@@ -283,10 +355,9 @@ void time_xeq(void)
 	    // Invoke call-back function and reschedule on normal return if required
 	    if (!ptr->tl_ufn(ptr) && ptr->tl_interval)
 	    {
-		// Reschedule by putting it back on the active list
+		// Reschedule by putting it back on the timer wheel
 		ptr->tl_ticks = ptr->tl_interval;
-		ptr->tl_next = time_active;
-	    	time_active = ptr;
+		time_insert(ptr);
 	    } else {
 		// Normal return or not periodic, free the entry
 		cli();
@@ -295,30 +366,108 @@ void time_xeq(void)
 		sei();
 	    };
 	};
+	time_rearm();
+};
+
+static void time_insert(struct tlist *ptr)
+// Link a timer into the wheel slot in which it expires. As before, a timer
+// set to n ticks expires on the (n+1)th tick, so it goes n+1 slots ahead
+// of the current one and tl_ticks becomes the number of times it must be
+// passed over first.
+{
+	uint8_t slot = (time_slot + ptr->tl_ticks + 1) & (TIME_WHEEL - 1);
+
+	ptr->tl_ticks /= TIME_WHEEL;
+	ptr->tl_next = time_wheel[slot];
+	time_wheel[slot] = ptr;
+};
+
+static uint16_t time_next(void)
+// Number of ticks until the first timer on the wheel expires, or 0xFFFF if
+// there are none. Slots are looked at in the order they will come round;
+// once a timer is found that expires on its slot's next turn, no later
+// slot can hold an earlier one.
+{
+	uint16_t next = 0xFFFF;
+
+	for (uint8_t d = 1; d <= TIME_WHEEL && next > d; d++)
+	{
+	    struct tlist *ptr = time_wheel[(time_slot + d) & (TIME_WHEEL - 1)];
+
+	    for (; ptr; ptr = ptr->tl_next)
+	    {
+		uint16_t t = d + ptr->tl_ticks * TIME_WHEEL;
+		if (t < next)
+		{
+		    next = t;
+		    if (t == d)
+		    {
+			break;
+		    };
+		};
+	    };
+	};
+	return next;
+};
+
+static void time_rearm(void)
+// Tell the Timer0 interrupt how long the background can sleep. Ticks that
+// are already counted but not yet processed bring the deadline closer. If
+// the compare in progress would run past the new deadline it is cut short,
+// but never to a count Timer0 has already passed.
+{
+#if TIME_TICKLESS && defined (__AVR_ATmega32A__)
+	uint16_t next = time_next();
+	uint8_t ocr;
+
+	cli();
+	next = (next > std_timer) ? next - std_timer : 1;
+	time_sleep = (next > time_pend) ? next : time_pend + 1;
+	ocr = time_period();
+	if (ocr < OCR0 && TCNT0 < OCR0)
+	{
+	    OCR0 = (ocr > TCNT0) ? ocr : TCNT0 + 1;
+	};
+	sei();
+#endif
+};
+
+uint8_t time_pending(void)
+// Whether proc_timer() or time_xeq() has anything to do: ticks counted
+// for the background, or timers forked or expired. Interrupts should be
+// off, as std_timer is 16 bits.
+{
+	return std_timer || time_fork || time_done;
 };
 
 // Background fork for processing each timer tick
 
 uint8_t proc_timer()
-// Called upon wake-up due to interrupt. If a clock interrupt has
-// been counted (in std_timer), the time in each entry on the active
-// timer queue is decremented, and if it has expired, the entry is
-// moved to the done queue for processing.
+// Called upon wake-up due to interrupt. For each clock interrupt that has
+// been counted (in std_timer), the wheel moves on one slot. Each entry in
+// that slot has either come round for the last time, and is moved to the
+// done queue for processing, or has one less turn of the wheel to wait.
 {
 	struct tlist *ptr;
 	struct tlist **pptr;	// Pointer to where we found the pointer
+	uint16_t ticks;
 
-	while (std_timer)
+	// Take all the ticks counted so far (16 bits, so not atomic)
+	cli();
+	ticks = std_timer;
+	std_timer = 0;
+	sei();
+
+	while (ticks)
 	{
-	    std_timer--;
-	    // Find each item on the timer queue
-	    pptr = &time_active;
-	    ptr = time_active;
+	    ticks--;
+	    time_slot = (time_slot + 1) & (TIME_WHEEL - 1);
+	    pptr = &time_wheel[time_slot];
+	    ptr = *pptr;
 
-	    // Count down each timer by 1 tick
 	    while (ptr)
 	    {
-		// Move entry to front of done queue at 0 ticks
+		// Move entry to front of done queue on its last turn
 		if ((ptr->tl_ticks)--)
 		{
 		    pptr = &(ptr->tl_next);				// Not expired yet, move on to next entry
@@ -327,7 +476,7 @@ uint8_t proc_timer()
 		    *pptr = ptr->tl_next;				// Unlink expired timer
 		    ptr->tl_next = time_done;				// Link to first item on done queue
 		    time_done = ptr;					// And put it on the front of the queue
-		    ptr = *pptr;					// Read to process next item in active list
+		    ptr = *pptr;					// Read to process next item in slot
 		};
 	    };
 	};
@@ -337,6 +486,7 @@ uint8_t proc_timer()
 int8_t isr_fork(unsigned char (*ufn)(struct tlist *), uint8_t context, uint8_t data[])
 // Create an entry in the 'done' queue for immediate processing
 // This is must be called from an ISR (ie with interrupts disabled) to schedule something into the background
+// Returns 1 if there is no free timer. ISRs that must not lose events should use the event ring (event.c).
 {
 	struct tlist *ptr;
 
@@ -357,25 +507,55 @@ int8_t isr_fork(unsigned char (*ufn)(struct tlist *), uint8_t context, uint8_t d
 
 	    ptr->tl_next = (struct tlist *)time_fork;
 	    time_fork = ptr;
-
+	    return 0;
 	};
+	return 1;
 };
 
 #if defined (__AVR_ATmega32A__)
+static uint8_t time_period(void)
+// OCR0 value for the compare interval that ends closest to the next point
+// the background needs waking, taking account of drift. Called with
+// interrupts disabled. The interval is 1 to 256 counts.
+{
+	uint16_t left = time_sleep - time_pend;
+	int32_t counts;
+
+	if (left > tick_span)
+	{
+	    return 255;
+	};
+	counts = ((int32_t)left * tick_cycles - drift + (prescale >> 1)) >> prescale_log2;
+	if (counts < 1)
+	{
+	    return 0;
+	} else if (counts > 256) {
+	    return 255;
+	};
+	return counts - 1;
+};
+
 ISR(TIMER0_COMP_vect)
-// Timer has reached threshold of approximately 10 ms. The task scheduler
-// running in the background is signalled with a completion count, which
-// allows stacking of completions in case of undue processing delays. The
-// count register is reset with the appropriate value.
+// The compare interval has ended. Count the ticks it covered, keeping
+// the remainder in drift, and signal the background with the completion
+// count once it is due to wake. That allows stacking of completions in
+// case of undue processing delays. The count register is then set for
+// the next interval, which is one tick unless the background has said
+// it can sleep longer.
 {
-	std_timer++;				// Tell background to process
-	if (drift >= 0) {			// Keep drift within limits
-	    drift -= lead;
-	    OCR0 = lead_interval;
-	} else {
-	    drift += lag;
-	    OCR0 = lag_interval;
-	}
+	drift += ((int32_t)OCR0 + 1) << prescale_log2;
+	while (drift >= tick_cycles - (prescale >> 1))
+	{
+	    drift -= tick_cycles;
+	    time_pend++;
+	};
+	if (time_pend >= time_sleep)
+	{
+	    std_timer += time_pend;		// Tell background to process
+	    time_pend = 0;
+	    time_sleep = 1;			// Until the background says otherwise
+	};
+	OCR0 = time_period();
 }
 #elif defined (__AVR_ATmega1284P__)
 ISR(TIMER0_COMPA_vect)
@@ -383,15 +563,17 @@ ISR(TIMER0_COMPA_vect)
 // switching between timer compare registers as required. 
 {
 	std_timer++;				// Tell background to process
-  #if lead != 0
 	// Choose whether adding or subtracting to keep drift within limts
+	if (!lead)
+	{
+	    return;
+	};
         if (drift >= 0) {
 	    drift -= lead;			// Select shorter interval
         } else {
 	    drift += lag;
 	    TIMSK0 = 1<<OCIE0B;			// Select longer interval
         }
-  #endif
 }
 
 ISR(TIMER0_COMPB_vect)
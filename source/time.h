@@ -45,6 +45,7 @@ struct tdata {
 };
 
 // A list of tlist entries, not a queue as it will not be ordered by expiry time.
+// On the timer wheel, tl_ticks counts the turns of the wheel still to wait.
 struct tlist {
 	struct tlist * tl_next;			// Forward pointer, null if last entry
     	unsigned char tl_ticks;			// Downward counter
@@ -60,12 +61,14 @@ struct tlist {
 };
 
 void time_init(void);
+void time_clock(uint32_t);
 int8_t time_delay(uint8_t, uint8_t (*)(void));
 int8_t time_set(unsigned char (*)(struct tlist *), uint8_t, uint8_t, uint8_t[], int8_t);
 int8_t ltime_set(void (*)(uint8_t), uint16_t, uint8_t);
 int8_t isr_fork(unsigned char (*)(struct tlist *), uint8_t, uint8_t[]);
 
 uint8_t proc_timer(void);
+uint8_t time_pending(void);
 void time_xeq(void);
 void time_dump(void);
 
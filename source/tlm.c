@@ -0,0 +1,108 @@
+/*
+ * tlm.c
+ *
+ *  Created on: October 15, 2026
+ *  Latest-value telemetry registers, read over SPI
+ */
+
+/*
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+*/
+
+#include <avr/io.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "spi.h"
+#include "pps.h"
+#include "disc.h"
+#include "efc.h"
+#include "temp.h"
+#include "tlm.h"
+
+/*
+ Reports that go out as they happen wait in the SPI queue, oldest first,
+ and a master that stops reading for a while gets old news when it
+ comes back. The values that matter from second to second are kept here
+ instead, always current, for the master to ask for with SPICMD_TLM
+ whenever it likes.
+
+ There are two copies. tlm_update() fills in the one not being read and
+ then makes it current with a single byte store, so a reader (the reply
+ built in the background, or anything in an interrupt) always gets one
+ whole second, never half of each.
+*/
+
+struct tlm tlm[2];
+volatile uint8_t tlm_cur;		// The copy to read
+
+void tlm_update(void)
+// Called once a second, after a pulse or by the holdover tick
+{
+	struct tlm * t = &tlm[!tlm_cur];
+
+	t->secs = pps_secs;
+	t->phase = pps_phase;
+	t->med = pps_med;
+	t->efc = efc_get();
+	t->temp = temp_t;
+	t->state = disc_mode;
+	t->n = tlm[tlm_cur].n + 1;
+	tlm_cur = !tlm_cur;
+};
+
+void tlm_query(void)
+// SPI master sent SPICMD_TLM. The reply is: SPICMD_TLM, updates (mod
+// 256), loop state, seconds, phase (low 32 bits, cycles), median error
+// (cycles per second) (4 bytes each), EFC code, temperature reading and
+// SPI event messages dropped (2 bytes each), all little endian.
+{
+	struct spi_buf * buf;
+	struct tlm t = tlm[tlm_cur];
+	uint32_t v[3];
+	uint16_t w[3];
+
+	// Current data comes before anything still waiting
+	if (!(buf = spi_replybuf()))
+	{
+	    return;
+	};
+	v[0] = t.secs;
+	v[1] = t.phase;
+	v[2] = t.med;
+	w[0] = t.efc;
+	w[1] = t.temp;
+	w[2] = spi_dropped;
+	*(buf->ptr++) = SPICMD_TLM;
+	*(buf->ptr++) = t.n;
+	*(buf->ptr++) = t.state;
+	for (uint8_t i = 0; i < 3; i++)
+	{
+	    *(buf->ptr++) = v[i] & 0xFF;
+	    *(buf->ptr++) = (v[i] >>  8) & 0xFF;
+	    *(buf->ptr++) = (v[i] >> 16) & 0xFF;
+	    *(buf->ptr++) = (v[i] >> 24) & 0xFF;
+	};
+	for (uint8_t i = 0; i < 3; i++)
+	{
+	    *(buf->ptr++) = w[i] & 0xFF;
+	    *(buf->ptr++) = w[i] >> 8;
+	};
+	spi_tx_queue(buf);
+};
@@ -0,0 +1,50 @@
+/*
+ * tlm.h
+ *
+ *  Created on: October 15, 2026
+ *  Latest-value telemetry registers, read over SPI
+ */
+
+/*
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+*/
+
+#ifndef TLM_H_
+#define TLM_H_
+
+#include <stdint.h>
+
+// One second's telemetry
+struct tlm {
+	uint32_t secs;			// pps_secs
+	int32_t  phase;			// pps_phase, low 32 bits, cycles
+	int32_t  med;			// pps_med, cycles per second
+	uint16_t efc;			// EFC code out
+	uint16_t temp;			// temp_t
+	uint8_t  state;			// disc_mode
+	uint8_t  n;			// Updates, mod 256
+};
+
+extern struct tlm tlm[2];
+extern volatile uint8_t tlm_cur;	// The copy to read
+
+void tlm_update(void);
+void tlm_query(void);
+
+#endif /* TLM_H_ */
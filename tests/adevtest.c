@@ -0,0 +1,216 @@
+/*
+	This program is for Gnu LINUX, not AVR.
+	Build with: sh host/BUILD (from the top of the tree)
+
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+
+*/
+
+/*
+	Checks the Allan and modified Allan deviation estimates against
+	the textbook values for white phase noise (ADEV = sqrt(3) sigma/tau,
+	MDEV = ADEV/sqrt(tau)) and white frequency noise (ADEV =
+	sigma/sqrt(tau), MDEV about ADEV/sqrt(2)), that a constant
+	frequency offset gives zero and a linear drift exactly D tau/sqrt(2)
+	even as the phase wraps, that the state fits the RAM budget, that
+	PPS pulses feed it, and that the results come back over SPI.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "config.h"
+#include "sim.h"
+#include "time.h"
+#include "pps.h"
+#include "spi.h"
+#include "event.h"
+#include "adev.h"
+
+#define SAMPLES 200000
+#define SIGMA 100.0			// Noise, cycles
+
+extern struct adev_level adev_level[ADEV_LEVELS];
+
+static int fail;
+
+static void check(int ok, const char * what)
+{
+	printf("%s: %s\n", ok ? "ok  " : "FAIL", what);
+	if (!ok) fail = 1;
+}
+
+static double gauss(void)
+{
+	double u = drand48(), v = drand48();
+
+	return sqrt(-2 * log(1 - u)) * cos(2 * M_PI * v);
+}
+
+static int near(uint32_t got, double want, double tol)
+{
+	return fabs(got - want) <= tol * want;
+}
+
+int main()
+{
+	uint16_t n;
+	uint32_t a, m;
+	double y;
+	int ok;
+
+	printf("ADEV state: %u bytes\n", (unsigned)sizeof(adev_level));
+	check(sizeof(adev_level) <= 528, "ADEV state fits in 528 bytes (506 on the AVR)");
+
+	// White phase noise
+	srand48(1);
+	adev_init();
+	for (uint32_t t = 0; t < SAMPLES; t++)
+	    adev_add(lrint(SIGMA * gauss()));
+	ok = 1;
+	for (uint8_t j = 0; j <= 7; j++)
+	{
+	    double tau = 1 << j;
+	    double want = sqrt(3) * SIGMA / tau / F_CPU * 1e12;
+
+	    adev_result(j, &n, &a, &m);
+	    printf("  WPM tau %4.0f: n %5u ADEV %8u (%8.0f) MDEV %8u (%8.0f)\n",
+		tau, n, a, want, m, want / sqrt(tau));
+	    ok &= near(a, want, 0.1) && near(m, want / sqrt(tau), 0.1);
+	}
+	check(ok, "white phase noise, tau 1 to 128");
+
+	// White frequency noise
+	adev_init();
+	y = 0;
+	for (uint32_t t = 0; t < SAMPLES; t++)
+	{
+	    y += SIGMA * gauss();
+	    adev_add(lrint(y));
+	}
+	ok = 1;
+	for (uint8_t j = 0; j <= 7; j++)
+	{
+	    double tau = 1 << j;
+	    double want = SIGMA / sqrt(tau) / F_CPU * 1e12;
+
+	    adev_result(j, &n, &a, &m);
+	    printf("  WFM tau %4.0f: n %5u ADEV %8u (%8.0f) MDEV %8u (%8.0f)\n",
+		tau, n, a, want, m, want / sqrt(2));
+	    ok &= near(a, want, 0.1) && (j < 3 || near(m, want / sqrt(2), 0.1));
+	}
+	check(ok, "white frequency noise, tau 1 to 128");
+
+	// Constant frequency offset, wrapping the phase many times
+	adev_init();
+	for (uint32_t t = 0; t < 5000; t++)
+	    adev_add(t * 12345677u);
+	ok = 1;
+	for (uint8_t j = 0; j < ADEV_LEVELS; j++)
+	{
+	    adev_result(j, &n, &a, &m);
+	    ok &= adev_level[j].sum == 0 && adev_level[j].msum == 0;
+	    ok &= n > 0;
+	}
+	check(ok, "frequency offset gives zero at every tau");
+
+	// Linear frequency drift of 2 cycles/s/s: second difference 2 tau^2
+	adev_init();
+	for (uint32_t t = 0; t < 5000; t++)
+	    adev_add(t * t + t * 12345677u);
+	ok = 1;
+	for (uint8_t j = 0; j < ADEV_LEVELS; j++)
+	{
+	    double tau = 1 << j;
+	    double want = sqrt(2) * tau / F_CPU * 1e12;
+
+	    adev_result(j, &n, &a, &m);
+	    printf("  drift tau %4.0f: n %5u ADEV %8u MDEV %8u (%8.0f)\n", tau, n, a, m, want);
+	    ok &= n > 0 && near(a, want, 1e-4) && near(m, want, 1e-4);
+	}
+	check(ok, "linear drift, tau 1 to 1024");
+
+	// Many days at tau 1: sum and count halve, the mean holds
+	adev_init();
+	srand48(2);
+	for (uint32_t t = 0; t < 300000; t++)
+	    adev_add(lrint(SIGMA * gauss()));
+	adev_result(0, &n, &a, &m);
+	check(n > 0x4000 && near(a, sqrt(3) * SIGMA / F_CPU * 1e12, 0.05),
+	    "sums halve instead of overflowing");
+
+	// PPS pulses from a CPU clock 3Hz fast, one pulse missing
+	sim_init(F_CPU);
+	time_init();
+	spi_init();
+	pps_init(150000);
+	sei();
+	for (uint16_t i = 0; i < 40; i++)
+	{
+	    sim_advance(F_CPU + 3);
+	    if (i != 20)
+		sim_capture();
+	    event_xeq();
+	}
+	adev_result(0, &n, &a, &m);
+	check(n == 37 && a == 0, "PPS feeds each second, a missing one filled in");
+
+	// Ask for the results over SPI, and read them all back
+	{
+	    static const uint8_t cmd[] = { SPICMD_ADEV };
+	    uint8_t frame[32], got = 0;
+	    uint16_t seen = 0;
+	    int len;
+
+	    sim_spi_send(cmd, sizeof cmd);
+	    spi_xeq();
+	    ok = 1;
+	    for (uint16_t i = 0; i < 200 && got < ADEV_LEVELS; i++)
+	    {
+		sim_advance(F_CPU / 100);
+		proc_timer();
+		time_xeq();
+		while ((len = sim_spi_recv(frame, sizeof frame, 32)) >= 0)
+		{
+		    uint16_t fn = frame[2] | frame[3] << 8;
+		    uint32_t fa = frame[4] | frame[5] << 8 | frame[6] << 16 | (uint32_t)frame[7] << 24;
+		    uint32_t fm = frame[8] | frame[9] << 8 | frame[10] << 16 | (uint32_t)frame[11] << 24;
+
+		    // The PPS reports queued earlier come first
+		    if (frame[0] != SPICMD_ADEV)
+			continue;
+		    if (len != 12 || frame[1] >= ADEV_LEVELS)
+		    {
+			ok = 0;
+			continue;
+		    }
+		    adev_result(frame[1], &n, &a, &m);
+		    ok &= fn == n && fa == a && fm == m;
+		    seen |= 1 << frame[1];
+		    got++;
+		}
+	    }
+	    check(ok && got == ADEV_LEVELS && seen == (1 << ADEV_LEVELS) - 1,
+		"SPI query returns every tau");
+	}
+
+	return fail;
+}
@@ -0,0 +1,205 @@
+/*
+	This program is for Gnu LINUX, not AVR.
+	Build with: sh host/BUILD (from the top of the tree)
+
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+
+*/
+
+/*
+	The request/response commands. Each reply must carry the sequence
+	number of the request's frame. Parameters are read, set (the loop's
+	gains must follow), refused out of range or read only, and unknown
+	ones reported; statistics blocks must match the counters, which a
+	reset clears; the version must give the capabilities built in; and a
+	command type nobody knows gets an error reply.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "config.h"
+#include "sim.h"
+#include "spi.h"
+#include "event.h"
+#include "pps.h"
+#include "disc.h"
+#include "cpu.h"
+#include "cmd.h"
+
+static int fail;
+static uint8_t r[32];			// Reply
+static int rlen;
+static uint8_t seq;			// Sequence number of the request
+
+static void check(int ok, const char * what)
+{
+	printf("%s: %s\n", ok ? "ok  " : "FAIL", what);
+	if (!ok) fail = 1;
+}
+
+static int ask(const uint8_t * msg, uint8_t n)
+// Send a command and read its reply. Returns 1 if it is for this one.
+{
+	seq = sim_spi_send(msg, n);
+	spi_xeq();
+	while ((rlen = sim_spi_recv(r, sizeof r, 200)) >= 0)
+	{
+	    if (rlen >= 3 && r[1] == seq)
+		return 1;
+	}
+	return 0;
+}
+
+static int32_t le32(const uint8_t * p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static int32_t get(uint8_t id, uint8_t * status)
+{
+	uint8_t m[] = { SPICMD_GET, id };
+
+	ask(m, sizeof m);
+	*status = r[2];
+	return le32(r + 4);
+}
+
+static int32_t set(uint8_t id, int32_t v, uint8_t * status)
+{
+	uint8_t m[] = { SPICMD_SET, id, v & 0xFF, (v >> 8) & 0xFF, (v >> 16) & 0xFF, (v >> 24) & 0xFF };
+
+	ask(m, sizeof m);
+	*status = r[2];
+	return le32(r + 4);
+}
+
+int main()
+{
+	uint8_t st, st2;
+	int32_t v;
+	char what[100];
+
+	sim_init(F_CPU);
+	spi_init();
+	pps_init(150000);
+	disc_init(0x8000, 0);
+	sei();
+
+	// Get
+	{
+	    uint8_t m[] = { SPICMD_GET, PARAM_CPU_HZ };
+
+	    check(ask(m, sizeof m) && rlen == 8 && r[0] == SPICMD_GET && r[2] == CMD_OK && r[3] == PARAM_CPU_HZ
+		    && le32(r + 4) == (int32_t)cpu_hz, "CPU clock read, reply carries the request's sequence number");
+	}
+	v = get(PARAM_PPS_TOL, &st);
+	check(st == CMD_OK && v == 150000, "PPS tolerance read");
+	v = get(PARAM_TAU_TRK, &st);
+	check(st == CMD_OK && v == DISC_TAU_TRK, "tracking time constant read");
+
+	// Set
+	v = set(PARAM_PPS_TOL, 1000, &st);
+	check(st == CMD_OK && v == 1000 && pps_tol == 1000, "PPS tolerance set");
+	v = set(PARAM_TAU_COARSE, 2 * DISC_TAU_COARSE, &st);
+	snprintf(what, sizeof what, "coarse time constant doubled: %ld, loop has %.0f", (long)v, disc_tau[0]);
+	check(st == CMD_OK && v == 2 * DISC_TAU_COARSE && fabsf(disc_tau[0] - 2 * DISC_TAU_COARSE) < 0.5f, what);
+	v = set(PARAM_ZETA, 1000, &st);
+	check(st == CMD_OK && v == 1000 && disc_zeta == 1.0f, "damping set");
+	v = set(PARAM_RLOG, OCXO_MAXDELTA + 1, &st);
+	check(st == CMD_ERANGE && v == pps_rlog, "reporting interval out of range refused");
+	v = set(PARAM_CPU_HZ, 1, &st);
+	check(st == CMD_ERO && v == (int32_t)cpu_hz, "CPU clock is read only");
+	get(99, &st);
+	set(99, 0, &st2);
+	check(st == CMD_EID && st2 == CMD_EID, "unknown parameter");
+	{
+	    uint8_t m[] = { SPICMD_GET };
+
+	    ask(m, sizeof m);
+	    check(r[2] == CMD_ELEN, "short command");
+	}
+
+	// Statistics and reset
+	pps_glitch = 7;
+	pps_outlier = 3;
+	event_lost = 5;
+	event_peak = 8;
+	{
+	    uint8_t m[] = { SPICMD_STATS, STATS_PPS };
+
+	    ask(m, sizeof m);
+	    check(rlen == 4 + 14 && r[2] == CMD_OK && r[3] == STATS_PPS && (r[10] | r[11] << 8) == 7
+		    && (r[14] | r[15] << 8) == 3, "PPS statistics");
+	}
+	{
+	    uint8_t m[] = { SPICMD_STATS, STATS_LOOP };
+
+	    ask(m, sizeof m);
+	    check(rlen == 4 + 13 && r[2] == CMD_OK && r[4] == disc_mode && (r[5] | r[6] << 8) == disc_changes,
+		    "loop statistics");
+	}
+	{
+	    uint8_t m[] = { SPICMD_STATS, STATS_EVENT };
+
+	    ask(m, sizeof m);
+	    check(rlen == 4 + 3 && r[2] == CMD_OK && r[3] == STATS_EVENT && (r[4] | r[5] << 8) == 5 && r[6] == 8,
+		    "event statistics");
+	}
+	{
+	    uint8_t m[] = { SPICMD_STATS, 9 };
+
+	    ask(m, sizeof m);
+	    check(rlen == 4 && r[2] == CMD_EID, "unknown statistics block");
+	}
+	{
+	    uint8_t m[] = { SPICMD_RESET };
+
+	    ask(m, sizeof m);
+	    check(rlen == 3 && r[2] == CMD_OK && !pps_glitch && !pps_outlier && !disc_changes, "counters reset");
+	}
+	{
+	    uint8_t m[] = { SPICMD_STATS, STATS_EVENT };
+
+	    ask(m, sizeof m);
+	    check(rlen == 4 + 3 && (r[4] | r[5] << 8) == 0 && r[6] == 0, "event counters reset");
+	}
+
+	// Version, and something unknown
+	{
+	    uint8_t m[] = { SPICMD_VERSION };
+	    uint16_t caps;
+
+	    ask(m, sizeof m);
+	    caps = r[5] | r[6] << 8;
+	    snprintf(what, sizeof what, "version %u.%u, capabilities 0x%02X, messages to %u bytes", r[3], r[4], caps, r[7]);
+	    check(rlen == 12 && r[3] == CMD_VERSION_MAJOR && r[4] == CMD_VERSION_MINOR && r[7] == SPIBUF_DLEN
+		    && !(caps & CAP_TEMP) == !TEMP_COMP && !(caps & CAP_KALMAN) == !DISC_KALMAN
+		    && le32(r + 8) == (int32_t)cpu_hz, what);
+	}
+	{
+	    uint8_t m[] = { 0x55, 1, 2 };
+
+	    ask(m, sizeof m);
+	    check(rlen == 4 && r[0] == SPICMD_ERROR && r[2] == CMD_ETYPE && r[3] == 0x55, "unknown command");
+	}
+
+	return fail;
+}
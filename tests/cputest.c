@@ -0,0 +1,127 @@
+/*
+	This program is for Gnu LINUX, not AVR.
+	Build with: sh host/BUILD (from the top of the tree)
+
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+
+*/
+
+/*
+	The CPU clock measured from PPS at boot. The same build (F_CPU 4MHz)
+	is run on the simulated part at each of the clocks in config.h: the
+	old 4.000445MHz crystal, 7.023MHz, a 10MHz OCXO and 14.247MHz. After
+	the first pulses the clock must be known, the PPS phase must show
+	the crystal's offset from nominal, the USART divisor must give 4800
+	baud and a one second timer must keep time. One run drops a pulse while
+	measuring, which only delays it.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "config.h"
+#include "sim.h"
+#include "osc.h"
+#include "time.h"
+#include "serial.h"
+#include "pps.h"
+#include "cpu.h"
+
+static int fail;
+static uint32_t seconds;		// Expiries of the 1 second timer
+static uint64_t first, last;		// Cycles of the second and last
+
+static void check(int ok, const char * what)
+{
+	printf("%s: %s\n", ok ? "ok  " : "FAIL", what);
+	if (!ok) fail = 1;
+}
+
+static unsigned char second(struct tlist * tl)
+{
+	// The first comes part of a tick after it was set
+	if (++seconds == 2)
+	    first = sim_cycles;
+	last = sim_cycles;
+	return 0;
+}
+
+static void background(void)
+{
+	proc_timer();
+	time_xeq();
+}
+
+static void run(uint32_t hz, double offset, uint8_t drop)
+{
+	struct osc o = { .y0 = offset };
+	struct sim_rates rate = {0};
+	uint32_t n, secs;
+	int64_t err;
+	uint16_t ubrr;
+	double baud;
+	char what[80];
+
+	sim_init(hz);
+	cpu_init(0);
+	time_init();
+	serial_init(BPS_4800);
+	pps_init(1000);
+	sei();
+	osc_init(&o);
+
+	for (n = 0; !cpu_known && n < 30; n++)
+	    osc_second(&o, n + 1 != drop);
+	snprintf(what, sizeof what, "%lu Hz: clock %lu Hz after %lu seconds",
+		(unsigned long)hz, (unsigned long)cpu_hz, (unsigned long)n);
+	check(cpu_known && cpu_hz == hz && n <= CPU_CAL + 1 + (drop ? 3 : 0), what);
+
+	for (secs = 0; secs < 100; secs++)
+	    osc_second(&o, 1);
+	snprintf(what, sizeof what, "%lu Hz: %lu seconds, phase %lld cycles, %lu glitches",
+		(unsigned long)hz, (unsigned long)pps_secs, (long long)pps_phase, (unsigned long)pps_glitch);
+	check(pps_secs == secs && !pps_glitch && fabs((double)pps_phase / pps_secs - offset) < 1, what);
+
+	ubrr = (uint16_t)(UBRRH & 0x0F) << 8 | UBRRL;
+	baud = (double)hz / ((UCSRA & 1<<U2X ? 8 : 16) * (ubrr + 1.0));
+	snprintf(what, sizeof what, "%lu Hz: UBRR %u%s, %.0f baud", (unsigned long)hz, ubrr,
+		UCSRA & 1<<U2X ? " (U2X)" : "", baud);
+	check(fabs(baud / 4800 - 1) < 0.02, what);
+
+	// 100 seconds of a one second timer, to within a prescale count
+	seconds = 0;
+	time_set(second, 99, 0, 0, 1);
+	sim_run(&rate, (uint64_t)hz * 100, background);
+	err = (int64_t)(last - first) - (int64_t)(seconds - 2) * hz;
+	snprintf(what, sizeof what, "%lu Hz: %lu one second timers in 100 seconds, %lld cycles out",
+		(unsigned long)hz, (unsigned long)seconds, (long long)err);
+	check(seconds >= 99 && seconds <= 101 && llabs(err) <= 1024, what);
+}
+
+int main()
+{
+	run(4000000, 445, 0);
+	run(7023000, -31, 3);
+	run(10000000, 2.5, 0);
+	run(14247000, 160, 0);
+
+	return fail;
+}
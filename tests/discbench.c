@@ -0,0 +1,112 @@
+/*
+	This program is for Gnu LINUX, not AVR.
+	Build with: sh host/BUILD (from the top of the tree)
+
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+
+*/
+
+/*
+	Benchmarks the disciplining loop against the simulated oscillator
+	for a range of time constants and damping, with the gains held
+	fixed (no switch to tracking). For each it reports:
+
+	  Bn		the loop noise bandwidth the settings give,
+			(zeta + 1/(4 zeta)) / (2 tau)
+	  peak		largest phase error after a 1Hz frequency step, cycles
+	  settle	seconds from the step until the phase error stays
+			inside SETTLE cycles
+	  overshoot	the largest phase error the other side of zero
+			after the step, cycles
+	  rms		phase error once settled, cycles, with 1 cycle of
+			PPS jitter and some random walk of frequency
+
+	The phase error is the oscillator's true time error, not what the
+	loop measures.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "config.h"
+#include "sim.h"
+#include "osc.h"
+#include "pps.h"
+#include "efc.h"
+#include "disc.h"
+
+#define STEP 1.0			// Frequency step, Hz
+#define SETTLE 4			// Settled phase error, cycles
+
+static void bench(float tau, float zeta)
+{
+	struct osc o = { .y0 = 0, .kv = DISC_KV, .wpm = 1, .rwfm = 2e-5 };
+	uint32_t secs = 40 * tau + 4000;
+	uint32_t settle = 0;
+	double peak = 0, over = 0, sum = 0, x;
+	uint32_t n = 0;
+
+	sim_init(F_CPU);
+	pps_init(150000);
+	sei();
+	osc_seed(1);
+	osc_init(&o);
+	osc_second(&o, 1);
+	disc_init(EFC_MID, 0);
+	disc_config(tau, tau, tau, zeta, 0);
+	for (uint16_t i = 0; i < 8 * tau; i++)
+	    osc_second(&o, 1);
+
+	// Step, then measure from the phase when it came
+	o.y += STEP;
+	x = o.x;
+	for (uint32_t i = 1; i <= secs; i++)
+	{
+	    double e;
+
+	    osc_second(&o, 1);
+	    e = o.x - x;
+	    if (fabs(e) > SETTLE)
+		settle = i;
+	    if (e > peak)
+		peak = e;
+	    if (-e > over)
+		over = -e;
+	    if (i > secs - 2000)
+	    {
+		sum += e * e;
+		n++;
+	    }
+	}
+	printf("%6.0f %5.3f %9.2e %7.0f %8lu %9.0f %6.1f\n", tau, zeta,
+		(zeta + 1 / (4 * zeta)) / (2 * tau), peak, (unsigned long)settle, over, sqrt(sum / n));
+}
+
+int main()
+{
+	static const float taus[] = { 32, 64, 128, 256, 512, 1024 };
+	static const float zetas[] = { 0.5, 0.707, 1.0 };
+
+	printf("   tau  zeta    Bn(Hz)    peak   settle overshoot    rms\n");
+	for (uint8_t i = 0; i < sizeof(taus) / sizeof(taus[0]); i++)
+	    for (uint8_t j = 0; j < sizeof(zetas) / sizeof(zetas[0]); j++)
+		bench(taus[i], zetas[j]);
+	return 0;
+}
@@ -0,0 +1,111 @@
+/*
+	This program is for Gnu LINUX, not AVR.
+	Build with: sh host/BUILD (from the top of the tree)
+
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+
+*/
+
+/*
+	Runs the disciplining loop against the simulated oscillator: it
+	acquires a 1.7Hz offset with an EFC gain 20% off what the loop
+	assumes, goes through the acquisition states to the tracking gains
+	and holds the frequency, and it rides out a spell where the
+	oscillator is beyond the EFC range without winding up.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "config.h"
+#include "sim.h"
+#include "osc.h"
+#include "pps.h"
+#include "efc.h"
+#include "disc.h"
+
+static int fail;
+
+static void check(int ok, const char * what)
+{
+	printf("%s: %s\n", ok ? "ok  " : "FAIL", what);
+	if (!ok) fail = 1;
+}
+
+static uint32_t settle(struct osc * o, uint32_t secs)
+// Run for secs; return the time of the last second the phase error (as
+// the loop sees it) was outside DISC_LOCKED
+{
+	uint32_t last = 0;
+
+	for (uint32_t i = 1; i <= secs; i++)
+	{
+	    osc_second(o, 1);
+	    if (disc_x > DISC_LOCKED || disc_x < -DISC_LOCKED || disc_mode != DISC_TRK)
+		last = i;
+	}
+	return last;
+}
+
+int main()
+{
+	struct osc o = { .y0 = 1.7, .kv = 0.8 * DISC_KV, .wpm = 1 };
+	uint32_t t, t2;
+	double x0, y;
+	uint16_t u;
+
+	sim_init(F_CPU);
+	pps_init(150000);
+	sei();
+	osc_init(&o);
+	osc_second(&o, 1);			// First pulse starts the count
+	disc_init(EFC_MID, 0);
+	check(disc_mode == DISC_COARSE && efc_get() == EFC_MID && (TCCR2 & (1<<WGM20 | 1<<WGM21)),
+		"PWM started at the middle of the range");
+
+	t = settle(&o, 20000);
+	printf("acquired in %lu seconds, EFC %u\n", (unsigned long)t, efc_get());
+	check(t < 2000 && disc_mode == DISC_TRK, "acquires and goes over to tracking gains");
+
+	x0 = o.x;
+	for (uint16_t i = 0; i < 4000; i++)
+	    osc_second(&o, 1);
+	y = (o.x - x0) / 4000;
+	printf("frequency error over 4000s: %.2e Hz (%.1e)\n", y, y / F_CPU);
+	check(fabs(y) < 1e-3, "frequency held to 1mHz");
+
+	// Oscillator jumps beyond the top of the EFC range for an hour
+	o.y = -3.5;
+	for (uint16_t i = 0; i < 3600; i++)
+	    osc_second(&o, 1);
+	u = disc_u;
+	check(u == 0xFFFF, "EFC held at the limit while out of range");
+	printf("phase error as the loop sees it: %ld cycles\n", (long)disc_x);
+
+	// Back in range: it should settle in about the time it takes to
+	// acquire from cold (which now has the coarse state to help it; this
+	// starts from fine acquisition)
+	o.y = -1.7;
+	t2 = settle(&o, 20000);
+	printf("recovered in %lu seconds, EFC %u\n", (unsigned long)t2, efc_get());
+	check(t2 < 2000, "no windup after being out of range");
+
+	return fail;
+}
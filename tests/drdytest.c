@@ -0,0 +1,151 @@
+/*
+	This program is for Gnu LINUX, not AVR.
+	Build with: sh host/BUILD (from the top of the tree)
+
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+
+*/
+
+/*
+	The data ready line. It must be low with nothing to send, go high
+	when a frame is queued and stay high until the background finds the
+	END of the last one waiting has gone. A master that clocks only while it is
+	high, sizing each read from the frame's length byte and the escapes
+	in it, must get every frame with only the one idle NUL ahead of them,
+	and nothing when the line is low.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "sim.h"
+#include "spi.h"
+#include "event.h"
+
+static int fail;
+static uint32_t clocked;		// Bytes the master clocked
+static uint32_t idle;			// NULs among them outside a frame
+static uint8_t inframe;
+static uint8_t later;			// Queue a frame after this many bytes
+
+static void queue(uint8_t, uint8_t, uint8_t);
+
+static void check(int ok, const char * what)
+{
+	printf("%s: %s\n", ok ? "ok  " : "FAIL", what);
+	if (!ok) fail = 1;
+}
+
+static void count(uint8_t miso)
+{
+	clocked++;
+	if (miso == END)
+	    inframe = 0;
+	else if (miso != NUL)
+	    inframe = 1;
+	else if (!inframe)
+	    idle++;
+	if (later && !--later)
+	    queue(SPICMD_HOLD, 3, 2);
+}
+
+static int ready(void)
+{
+	return !!(PORTB & (1 << DRDY_PIN));
+}
+
+static uint8_t read(uint8_t n)
+// Clock n bytes, returning the ESCs among them
+{
+	uint8_t esc = 0;
+
+	while (n--)
+	    esc += sim_spi(NUL) == ESC;
+	return esc;
+}
+
+static void master(void)
+// Read while the line is high: the length byte (after a NUL if the MCU
+// was idle), then the rest of the frame, then one more byte per ESC
+{
+	while (ready())
+	{
+	    uint8_t len = sim_spi(NUL);
+
+	    if (len == NUL)
+		len = sim_spi(NUL);
+	    if (len == NUL)
+		break;
+	    for (uint8_t n = len + 4; n; )
+		n = read(n);
+	    spi_xeq();			// The background runs between frames
+	}
+}
+
+static void queue(uint8_t type, uint8_t fill, uint8_t n)
+{
+	struct spi_buf * buf = spi_evbuf();
+
+	*(buf->ptr++) = type;
+	while (n--)
+	    *(buf->ptr++) = fill;
+	spi_tx_queue(buf);
+}
+
+int main()
+{
+	uint8_t frame[32];
+	int got = 0;
+	char what[120];
+
+	sim_init(F_CPU);
+	spi_init();
+	sei();
+	sim_spi_hook = count;
+
+	check(!ready() && (DDRB & (1 << DRDY_PIN)), "low with nothing to send");
+	queue(SPICMD_HOLD, 1, 4);
+	check(ready(), "high once a frame is queued");
+	queue(SPICMD_HOLD, END, 6);
+	queue(SPICMD_HOLD, ESC, 20);
+	master();
+	while (sim_spi_recv(frame, sizeof frame, 0) >= 0)
+	    got++;
+	snprintf(what, sizeof what, "3 frames, 2 of them mostly escapes: read %d in %lu bytes, %lu idle, %u bad",
+		got, (unsigned long)clocked, (unsigned long)idle, sim_spi_bad);
+	check(got == 3 && idle == 1 && !sim_spi_bad && !ready(), what);
+
+	// Nothing more until there is something to send
+	clocked = 0;
+	master();
+	check(!clocked, "nothing clocked while low");
+
+	// A frame queued while the last is going follows it with no gap
+	idle = 0;
+	later = 4;
+	queue(SPICMD_HOLD, 2, 2);
+	master();
+	got = 0;
+	while (sim_spi_recv(frame, sizeof frame, 0) >= 0)
+	    got++;
+	check(got == 2 && idle == 1 && !ready(), "a frame queued while one is going follows it");
+
+	return fail;
+}
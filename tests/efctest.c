@@ -0,0 +1,148 @@
+/*
+	This program is for Gnu LINUX, not AVR.
+	Build with: sh host/BUILD (from the top of the tree)
+
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+
+*/
+
+/*
+	Checks the EFC DAC (Timer 2 PWM with a sigma-delta modulator on
+	the low 8 bits of the code) by clocking Timer 2 and measuring the
+	time OC2 is high: over 256 PWM periods the average is exactly
+	code/65536 for codes across the whole range, the running error
+	never gets beyond one PWM count, and codes above 0xFF00 stop
+	there. Also that its 1950 interrupts a second leave the main loop
+	nothing to run, so it sleeps through them.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "sim.h"
+#include "efc.h"
+#include "time.h"
+#include "event.h"
+#include "spi.h"
+
+#define PERIOD (256 * 8)		// CPU cycles per PWM period
+
+static int fail;
+
+static void check(int ok, const char * what)
+{
+	printf("%s: %s\n", ok ? "ok  " : "FAIL", what);
+	if (!ok) fail = 1;
+}
+
+static unsigned char flash(struct tlist * tl)
+{
+	return 0;
+}
+
+static uint64_t average(uint16_t code, int32_t * worst)
+// Set code, let it run in, then return the time OC2 is high over 256
+// periods in 65536ths of a period, and the worst running error in counts
+{
+	int64_t err = 0;
+
+	efc_set(code);
+	sim_advance(2 * PERIOD);
+	sim_oc2_high = 0;
+	sim_oc2_cycles = 0;
+	*worst = 0;
+	for (uint16_t i = 1; i <= 256; i++)
+	{
+	    sim_advance(PERIOD);
+	    // High time so far, less what code/65536 would give, in 1/256 counts
+	    err = (int64_t)sim_oc2_high * 256 / 8 - (int64_t)i * efc_get();
+	    if (err > *worst) *worst = err;
+	    if (-err > *worst) *worst = -err;
+	}
+	*worst = (*worst + 255) / 256;
+	return sim_oc2_high * 65536 / sim_oc2_cycles;
+}
+
+int main()
+{
+	static const uint16_t codes[] = { 0, 1, 0x80, 0xFF, 0x100, 0x1234, 0x7FFF,
+		EFC_MID, 0x8001, 0xABCD, 0xFEFF, 0xFF00 };
+	int32_t worst, most = 0;
+	uint8_t ok = 1;
+
+	sim_init(F_CPU);
+	sim_timer2 = 1;
+	efc_init(EFC_MID);
+	sei();
+
+	check((DDRD & 1<<EFC_PIN) && (TIMSK & 1<<TOIE2), "OC2 is an output and the modulator runs");
+
+	for (uint8_t i = 0; i < sizeof(codes) / sizeof(codes[0]); i++)
+	{
+	    uint64_t a = average(codes[i], &worst);
+
+	    if (a != codes[i])
+		printf("  code %04x gives %04llx\n", codes[i], (unsigned long long)a);
+	    ok &= a == codes[i];
+	    if (worst > most) most = worst;
+	}
+	for (uint32_t code = 0; code < 0xFF00; code += 251)
+	{
+	    ok &= average(code, &worst) == code;
+	    if (worst > most) most = worst;
+	}
+	check(ok, "average is code/65536 across the range");
+	printf("worst running error %ld count\n", (long)most);
+	check(most <= 1, "running error within one PWM count");
+
+	check(average(0xFFFF, &worst) == 0xFF00 && efc_get() == 0xFF00, "codes above 0xFF00 give 0xFF00");
+
+	// A second of gpsdo.c's main loop with a half second timer running:
+	// the dispatchers only run when something is pending
+	{
+	    uint32_t ovf = sim_count[SIM_TIMER2_OVF];
+	    uint16_t passes = 0;
+
+	    time_init();
+	    spi_init();
+	    time_set(flash, 50, 0, 0, 1);
+	    sei();
+	    for (uint32_t c = 0; c < F_CPU; c += PERIOD)
+	    {
+		sim_advance(PERIOD);
+		cli();
+		if (time_pending() || event_pending() || spi_pending())
+		{
+		    sei();
+		    passes++;
+		    proc_timer();
+		    event_xeq();
+		    spi_xeq();
+		    time_xeq();
+		}
+		sei();
+	    }
+	    ovf = sim_count[SIM_TIMER2_OVF] - ovf;
+	    printf("%u EFC interrupts, %u main loop passes\n", (unsigned)ovf, passes);
+	    check(ovf >= F_CPU / PERIOD - 1 && passes <= 3, "EFC interrupts leave the main loop asleep");
+	}
+
+	return fail;
+}
@@ -0,0 +1,153 @@
+/*
+	This program is for Gnu LINUX, not AVR.
+	Build with: sh host/BUILD (from the top of the tree)
+
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+
+*/
+
+/*
+	Checks the ISR to background event ring: events come out in the
+	order they went in, across many wraps of the free running indexes,
+	a full ring counts what it drops, and PPS captures that arrive while
+	the background is busy are all delivered. SPI commands go to
+	spi_xeq() instead.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "sim.h"
+#include "time.h"
+#include "pps.h"
+#include "spi.h"
+#include "serial.h"
+#include "event.h"
+
+extern struct event event_ring[EVENT_NUM];
+
+static uint8_t seen[64];
+static uint8_t nseen;
+static uint8_t commands;
+static int fail;
+
+static void record(struct event * ev)
+{
+	seen[nseen++] = ev->ev_context;
+}
+
+// Replaces the stub in sim.c
+void msg1(struct spi_buf * buf)
+{
+	commands++;
+}
+
+static uint8_t post(uint8_t context)
+// Post as an ISR would, with interrupts off. Returns 1 if dropped.
+{
+	struct event * ev;
+
+	cli();
+	if ((ev = event_alloc()))
+	{
+	    ev->ev_ufn = record;
+	    ev->ev_context = context;
+	    event_post();
+	}
+	sei();
+	return ev == 0;
+}
+
+static void check(int ok, const char * what)
+{
+	printf("%s: %s\n", ok ? "ok  " : "FAIL", what);
+	if (!ok) fail = 1;
+}
+
+int main()
+{
+	uint16_t lost;
+	uint8_t peak;
+	uint8_t dropped = 0;
+	int ok;
+
+	sim_init(F_CPU);
+	time_init();
+	spi_init();
+	serial_init(BPS_4800);
+	sei();
+
+	// Overfill the ring
+	for (uint8_t i = 0; i < EVENT_NUM + 3; i++)
+	    dropped += post(i);
+	event_xeq();
+	event_stats(&lost, &peak);
+	ok = nseen == EVENT_NUM;
+	for (uint8_t i = 0; i < nseen; i++)
+	    ok &= seen[i] == i;
+	check(ok, "full ring delivers the first events in order");
+	check(dropped == 3 && lost == 3, "dropped events are counted");
+	check(peak == EVENT_NUM, "peak shows the ring was full");
+
+	// Keep posting and running well past 256 events
+	ok = 1;
+	for (uint16_t n = 0; n < 1000; n++)
+	{
+	    nseen = 0;
+	    for (uint8_t i = 0; i < 1 + n % EVENT_NUM; i++)
+		post(i);
+	    event_xeq();
+	    ok &= nseen == 1 + n % EVENT_NUM;
+	    for (uint8_t i = 0; i < nseen; i++)
+		ok &= seen[i] == i;
+	}
+	event_stats(&lost, &peak);
+	check(ok && lost == 3, "order kept as the indexes wrap");
+
+	// Five seconds of PPS with the background too busy to run
+	pps_init(150000);
+	for (uint8_t i = 0; i < 5; i++)
+	{
+	    sim_advance(F_CPU + i);
+	    sim_capture();
+	}
+	ok = (uint8_t)(event_head - event_tail) == 5;
+	for (uint8_t i = 1; i < 5; i++)
+	    ok &= event_ring[(event_tail + i) & (EVENT_NUM - 1)].ev_data.longs
+		- event_ring[(event_tail + i - 1) & (EVENT_NUM - 1)].ev_data.longs == F_CPU + i;
+	check(ok, "PPS captures queue in order while the background is busy");
+	event_xeq();
+
+	// SPI commands are not events: each waits for spi_xeq(), which has
+	// a buffer ready for the next by the time it comes
+	ok = 1;
+	for (uint8_t i = 0; i < 2; i++)
+	{
+	    static const uint8_t cmd[] = { 1 };
+
+	    sim_spi_send(cmd, sizeof cmd);
+	    event_xeq();
+	    ok &= commands == i;
+	    spi_xeq();
+	}
+	check(ok && commands == 2 && event_head == event_tail, "SPI commands run from spi_xeq(), not the ring");
+
+	return fail;
+}
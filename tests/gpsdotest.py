@@ -0,0 +1,265 @@
+"""
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+"""
+
+"""
+    gpsdo.py's side of the data ready line, against a simulated MCU on a
+    mock SPI bus and a MockLine. Nothing may be clocked while the line is
+    low; while it is high every frame must be read, with one idle NUL
+    ahead of them after an idle spell and no more, even when most of a
+    frame is escapes or another is queued while one is going.
+
+    Then capture and replay: two runs appended to one capture file must
+    read back as two time marks and exactly the bytes each way, and
+    replay.py must get the same frames from it as the runs did, with
+    either deframer, and stop cleanly at a record cut short.
+
+    Last, the sequence numbers through the wrap: gaps asked for once,
+    late resends taken once, nothing waited for forever.
+
+    And GpioLine against a gpio-sim chip, if the kernel and libgpiod
+    bindings are there to make one (as root): low until pulled up, a
+    wait that times out while low, and one woken by the rising edge.
+"""
+
+import os
+import sys
+import tempfile
+import threading
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), '..', 'utility'))
+import gpsdo
+import replay
+from gpsdo import NUL, END, ESC, ESC_END, ESC_ESC, crc16
+
+
+class MockMcu():
+    # The MCU's end of the bus: SPDR holds the next byte out, a NUL when
+    # idle, and data ready is high until the last END has gone
+    def __init__(self):
+        self.out = bytearray()
+        self.spdr = NUL
+        self.busy = False       # SPDR holds a frame byte
+        self.seq = 0
+        self.queued = 0         # Bytes of frames queued
+        self.miso = bytearray() # Everything each way
+        self.mosi = bytearray()
+        self.later = None       # (bytes, frame): queue frame after bytes
+
+    def queue(self, msg):
+        body = bytes([len(msg), self.seq]) + msg
+        self.seq = (self.seq + 1) & 0xFF
+        crc = crc16(body)
+        body += bytes([crc & 0xFF, crc >> 8])
+        body = body.replace(bytes([ESC]), bytes([ESC, ESC_ESC])).replace(bytes([END]), bytes([ESC, ESC_END])) + bytes([END])
+        self.out += body
+        self.queued += len(body)
+
+    def level(self):
+        return self.busy or bool(self.out)
+
+    def xfer(self, data):
+        resp = []
+        self.mosi += bytes(data)
+        for b in data:
+            resp.append(self.spdr)
+            self.busy = bool(self.out)
+            self.spdr = self.out.pop(0) if self.out else NUL
+            if self.later:
+                n, msg = self.later
+                self.later = (n - 1, msg) if n > 1 else None
+                if n == 1:
+                    self.queue(msg)
+        self.miso += bytes(resp)
+        return resp
+
+    def close(self):
+        pass
+
+
+class Master(gpsdo.spiman):
+    def dispatch(self, seq, msg):
+        self.got.append(bytes(msg))
+
+
+fail = 0
+
+
+def check(ok, what):
+    global fail
+    print(f"{'ok  ' if ok else 'FAIL'}: {what}")
+    if not ok:
+        fail = 1
+
+
+# With gpsdo.py's own deframer, and host/slip.c's if it has been built
+for native in [None] + [d for d in [gpsdo.native_deframer()] if d]:
+    how = "slip.c" if native else "python"
+    mcu = MockMcu()
+    spi = Master(spi=mcu, drdy=gpsdo.MockLine(mcu.level), native=native)
+    spi.got = []
+
+    spi.poll(0)
+    check(spi.clocked == 0 and spi.drdy.waits == 1, f"{how}: nothing clocked while low")
+
+    msgs = [bytes([3, 1, 2, 3, 4]), bytes([3]) + bytes(6 * [END]), bytes([3]) + bytes(20 * [ESC])]
+    for m in msgs:
+        mcu.queue(m)
+    spi.poll(0)
+    check(spi.got == msgs and spi.clocked == mcu.queued + 1 and not mcu.level(),
+          f"{how}: 3 frames, 2 of them mostly escapes: {len(spi.got)} read in {spi.clocked} bytes, {mcu.queued} sent")
+
+    spi.got, spi.clocked, mcu.queued = [], 0, 0
+    mcu.queue(bytes([3, 2, 2]))
+    mcu.later = (4, bytes([3, 3, 3]))
+    spi.poll(0)
+    check(spi.got == [bytes([3, 2, 2]), bytes([3, 3, 3])] and spi.clocked == mcu.queued + 1 and not mcu.level()
+          and spi.crcerr == 0, f"{how}: a frame queued while one is going follows it: {spi.clocked} bytes, {mcu.queued} sent")
+
+# Capture two runs to one file, and replay it
+with tempfile.TemporaryDirectory() as tmp:
+    path = os.path.join(tmp, 'bus.cap')
+    miso, mosi, got = bytearray(), bytearray(), 0
+    for run in range(2):
+        mcu = MockMcu()
+        cap = gpsdo.Capture(mcu, path)
+        spi = Master(spi=cap, drdy=gpsdo.MockLine(mcu.level))
+        spi.got = []
+        spi.transfer(bytes([13]))
+        for m in msgs[:3 - run]:
+            mcu.queue(m)
+        spi.poll(0)
+        cap.f.close()
+        miso += mcu.miso
+        mosi += mcu.mosi
+        got += len(spi.got)
+
+    with open(path, 'rb') as f:
+        recs = list(gpsdo.read_capture(f))
+    marks = [r for r in recs if r[0] == gpsdo.CAPTURE_MARK]
+    check(len(marks) == 2 and marks[0][1] <= marks[1][1]
+          and b''.join(r[2] for r in recs if r[0] == gpsdo.CAPTURE_MISO) == miso
+          and b''.join(r[2] for r in recs if r[0] == gpsdo.CAPTURE_MOSI) == mosi
+          and all(a[1] <= b[1] for a, b in zip(recs, recs[1:]) if b[0] != gpsdo.CAPTURE_MARK),
+          f"capture: {len(recs)} records, 2 runs, {len(miso)} bytes in and {len(mosi)} out, in time order")
+
+    for native in [False, True]:
+        st, spi = replay.replay(path, quiet=True, native=native)
+        check(spi.frames == got and st.sent == 2 and spi.crcerr == 0 and st.miso == len(miso),
+              f"replay ({'slip.c' if spi.native else 'python'}): {spi.frames} frames ({got} read), "
+              f"{st.sent} sent, {spi.crcerr} bad")
+
+    with open(path, 'rb') as f:
+        data = f.read()
+    with open(path, 'wb') as f:
+        f.write(data[:-3])
+    st, spi = replay.replay(path, quiet=True, native=False)
+    check(spi.frames == got - 1 and spi.crcerr == 0, f"cut short: {spi.frames} frames")
+
+# Sequence numbers across the wrap. A gap is asked for once and a late
+# resend taken once; a duplicate, or a resend no longer wanted, is not,
+# and neither moves the sequence back. A gap waited for in vain is
+# forgotten after RESEND_MAX frames, so when its number comes round again
+# it is just the next frame. Two in a row from far behind are a restart.
+spi = gpsdo.spiman(spi=gpsdo.Idle())
+take = lambda seqs: [spi.sequence(s & 0xFF) for s in seqs]
+ok = all(take(range(250, 257)))
+ok &= take([258, 257, 257, 258]) == [True, True, False, False] and spi.seq == 2
+ok &= list(spi.requests) == [bytes([gpsdo.SPICMD_RESEND, 1])] and not spi.missing
+ok &= take([4]) == [True] and spi.missing == {3}
+ok &= all(take(range(5, 5 + spi.RESEND_MAX))) and not spi.missing
+ok &= take([3]) == [False] and spi.seq == (4 + spi.RESEND_MAX) & 0xFF
+ok &= all(take(range(5 + spi.RESEND_MAX, 256 + 4))) and spi.seq == 3 and len(spi.requests) == 2
+ok &= take([200, 201, 202]) == [False, True, True] and spi.seq == 202 and not spi.missing
+check(ok, f"sequence numbers through the wrap: {len(spi.requests)} resends asked for")
+
+
+class GpioSim():
+    # A one line gpio-sim chip made through configfs, its line driven by
+    # writing pull-up or pull-down to its sysfs pull attribute
+    ROOT = '/sys/kernel/config/gpio-sim'
+
+    def __init__(self, name):
+        if not os.path.isdir(self.ROOT):
+            raise OSError(f"no {self.ROOT} (gpio-sim not loaded, or configfs not mounted)")
+        self.dir = os.path.join(self.ROOT, name)
+        self.bank = os.path.join(self.dir, 'bank0')
+        os.mkdir(self.dir)
+        try:
+            os.mkdir(self.bank)
+            self.put(self.bank, 'num_lines', '1')
+            self.put(self.dir, 'live', '1')
+            self.chip = '/dev/' + self.get(self.bank, 'chip_name')
+            self.pull_path = os.path.join('/sys/devices/platform', self.get(self.dir, 'dev_name'),
+                                          self.get(self.bank, 'chip_name'), 'sim_gpio0', 'pull')
+        except OSError:
+            self.close()
+            raise
+
+    @staticmethod
+    def put(d, attr, v):
+        with open(os.path.join(d, attr), 'w') as f:
+            f.write(v)
+
+    @staticmethod
+    def get(d, attr):
+        with open(os.path.join(d, attr)) as f:
+            return f.read().strip()
+
+    def pull(self, up):
+        with open(self.pull_path, 'w') as f:
+            f.write('pull-up' if up else 'pull-down')
+
+    def close(self):
+        if os.path.exists(os.path.join(self.dir, 'live')):
+            self.put(self.dir, 'live', '0')
+        for d in (self.bank, self.dir):
+            if os.path.isdir(d):
+                os.rmdir(d)
+
+
+try:
+    import gpiod
+    sim = GpioSim(f"gpsdotest{os.getpid()}")
+except (ImportError, OSError) as e:
+    print(f"skip: GpioLine against gpio-sim: {e}")
+else:
+    line = None
+    try:
+        sim.pull(False)
+        line = gpsdo.GpioLine(sim.chip, 0)
+        low = not line.value()
+        t0 = time.monotonic()
+        timeout = not line.wait(0.1) and time.monotonic() - t0 >= 0.09
+        sim.pull(True)
+        high = line.value() and line.wait(0)
+        sim.pull(False)
+        line.wait(0)            # Read off the edge just made
+        threading.Timer(0.05, sim.pull, (True,)).start()
+        t0 = time.monotonic()
+        edge = line.wait(2) and time.monotonic() - t0 < 1
+        check(low and timeout and high and edge,
+              f"GpioLine on {sim.chip}: low {low}, wait timed out {timeout}, high {high}, woken by edge {edge}")
+    finally:
+        if line:
+            line.close()
+        sim.close()
+
+sys.exit(fail)
@@ -0,0 +1,127 @@
+/*
+	This program is for Gnu LINUX, not AVR.
+	Build with: sh host/BUILD (from the top of the tree)
+
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+
+*/
+
+
+/*
+	Holdover against the simulated oscillator, which ages (its frequency
+	drifts linearly) and wanders. The loop locks and tracks for long
+	enough to learn the aging, then PPS stops for ten minutes, an hour
+	and four hours. Each time the time error built up is compared with
+	what it would have been with the EFC left where it was, and with the
+	holdover's own estimate and measurement of it.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "config.h"
+#include "sim.h"
+#include "osc.h"
+#include "time.h"
+#include "pps.h"
+#include "efc.h"
+#include "disc.h"
+#include "hold.h"
+
+static int fail;
+
+static void check(int ok, const char * what)
+{
+	printf("%s: %s\n", ok ? "ok  " : "FAIL", what);
+	if (!ok) fail = 1;
+}
+
+static void outage(struct osc * o, uint32_t secs)
+{
+	double x0 = o->x, free = 0, te;
+	uint16_t u = efc_get();
+	char what[80];
+	uint32_t entered = 0;
+
+	for (uint32_t i = 1; i <= secs; i++)
+	{
+	    free += o->y + o->kv * ((double)u - EFC_MID);
+	    osc_second(o, 0);
+	    if (!entered && disc_mode == DISC_HOLD)
+		entered = i;
+	}
+	te = o->x - x0;
+	osc_second(o, 1);
+	printf("%5lu s: holdover after %lu s, time error %7.1f cycles, EFC left alone %7.1f, estimated %6.1f, measured %ld, %u points, aging %.4f codes/span\n",
+		(unsigned long)secs, (unsigned long)entered, te, free, hold_te, (long)hold_meas, hold_n, hold_c1);
+
+	snprintf(what, sizeof what, "%lu s: goes into holdover and back out", (unsigned long)secs);
+	check(entered && entered <= HOLD_WAIT + 2 && hold_secs >= secs - HOLD_WAIT && !hold_on && disc_mode != DISC_HOLD, what);
+	snprintf(what, sizeof what, "%lu s: measured time error agrees", (unsigned long)secs);
+	check(fabs(hold_meas - te) < 2 * DISC_LOCKED, what);
+	snprintf(what, sizeof what, "%lu s: estimate covers the error", (unsigned long)secs);
+	check(fabs(te) < 3 * hold_te + 2 * DISC_LOCKED, what);
+	if (fabs(free) > 8 * DISC_LOCKED)
+	{
+	    snprintf(what, sizeof what, "%lu s: time error a quarter of leaving the EFC", (unsigned long)secs);
+	    check(fabs(te) < fabs(free) / 4, what);
+	}
+}
+
+static void lock(struct osc * o, uint32_t secs)
+{
+	for (uint32_t i = 0; i < secs; i++)
+	    osc_second(o, 1);
+}
+
+int main()
+{
+	struct osc o = { .y0 = 0.4, .kv = DISC_KV, .aging = 5e-6, .rwfm = 5e-6, .wpm = 1 };
+
+	sim_init(F_CPU);
+	time_init();
+	pps_init(150000);
+	sei();
+	osc_seed(12);
+	osc_init(&o);
+	osc_second(&o, 1);
+	disc_init(EFC_MID, 0);
+
+	lock(&o, 4 * 3600);
+	check(disc_mode == DISC_TRK, "locked and tracking");
+
+	// A few seconds without pulses is not holdover
+	for (uint8_t i = 0; i < HOLD_WAIT - 1; i++)
+	    osc_second(&o, 0);
+	osc_second(&o, 1);
+	check(!hold_count && disc_mode == DISC_TRK, "short gap rides through");
+
+	outage(&o, 600);
+	lock(&o, 3 * 3600);
+	outage(&o, 3600);
+	lock(&o, 3 * 3600);
+	outage(&o, 4 * 3600);
+	check(hold_count == 3, "three holdovers");
+
+	lock(&o, 3600);
+	check(disc_mode == DISC_TRK, "tracking again");
+
+	return fail;
+}
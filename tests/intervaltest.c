@@ -0,0 +1,140 @@
+/*
+	This program is for Gnu LINUX, not AVR.
+	Build with: sh host/BUILD (from the top of the tree)
+
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+
+*/
+
+/*
+	Checks the adaptive reporting interval with a CPU clock 3Hz fast
+	and a cycle of capture jitter: it starts at 2^OCXO_MINDELTA
+	seconds, doubles each interval up to 2^OCXO_MAXDELTA while the
+	frequency holds, drops back to the minimum on a frequency step
+	and after an outage, and the SPI report carries the interval.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "config.h"
+#include "sim.h"
+#include "pps.h"
+#include "spi.h"
+#include "event.h"
+
+#define OFFSET 3			// CPU clock error, Hz
+
+static int fail;
+static int64_t late;			// Capture error of the last pulse
+static uint8_t msg[32];
+static uint8_t msglen;
+
+static void check(int ok, const char * what)
+{
+	printf("%s: %s\n", ok ? "ok  " : "FAIL", what);
+	if (!ok) fail = 1;
+}
+
+static void pulse(uint64_t after, int64_t err)
+// A PPS edge after cycles, captured err cycles late
+{
+	while (after + err - late > 0x80000000)
+	{
+	    sim_advance(0x80000000);
+	    after -= 0x80000000;
+	}
+	sim_advance(after + err - late);
+	late = err;
+	sim_capture();
+	event_xeq();
+}
+
+static void run(uint32_t secs, int32_t offset)
+{
+	for (uint32_t i = 0; i < secs; i++)
+	    pulse(F_CPU + offset, rand() % 3 - 1);
+}
+
+static void read_spi(void)
+// Clock out the first message queued
+{
+	int n = sim_spi_recv(msg, sizeof msg, 1000);
+
+	msglen = n < 0 ? 0 : n;
+}
+
+int main()
+{
+	uint32_t secs = 0;
+	uint8_t grown = OCXO_MINDELTA;
+	uint32_t grew_at = 0;
+
+	sim_init(F_CPU);
+	spi_init();
+	pps_init(150000);
+	sei();
+	srand(1);
+
+	pulse(12345, 0);
+	run((1 << OCXO_MINDELTA) - 1, OFFSET);
+	check(pps_rlog == OCXO_MINDELTA, "starts at the minimum interval");
+	run(1, OFFSET);
+	read_spi();
+	check(msglen == 11 && msg[0] == SPICMD_PPS
+		&& (msg[5] | msg[6] << 8) == 1 << OCXO_MINDELTA
+		&& (int32_t)(msg[7] | msg[8] << 8 | msg[9] << 16 | (uint32_t)msg[10] << 24) == (1 << OCXO_MINDELTA) * OFFSET + late,
+		"report carries the interval and phase gained");
+
+	// Let it grow, watching that it does so a step at a time
+	while (secs < 3UL << OCXO_MAXDELTA && pps_rlog < OCXO_MAXDELTA)
+	{
+	    run(1, OFFSET);
+	    secs++;
+	    if (pps_rlog != grown)
+	    {
+		if (pps_rlog != grown + 1)
+		    break;
+		grown = pps_rlog;
+		grew_at = secs;
+	    }
+	}
+	printf("reached 2^%u seconds after %lu seconds\n", pps_rlog, (unsigned long)grew_at);
+	check(pps_rlog == OCXO_MAXDELTA, "interval doubles up to the maximum");
+
+	// A 1Hz step, too small for the outlier filter to notice. The
+	// interval drops when the one in progress ends.
+	for (secs = 0; secs < 2UL << OCXO_MAXDELTA && pps_rlog == OCXO_MAXDELTA; secs++)
+	    run(1, OFFSET + 1);
+	check(pps_rlog == OCXO_MINDELTA && pps_reacq == 0, "small frequency step drops the interval");
+	run(1000, OFFSET + 1);
+	check(pps_rlog > OCXO_MINDELTA + 2, "and it grows again");
+
+	// A 50Hz step restarts the outlier filter, and the interval with it
+	run(10, OFFSET + 51);
+	check(pps_rlog == OCXO_MINDELTA && pps_reacq == 1, "large frequency step drops it at once");
+
+	// Outage
+	run(1000, OFFSET + 51);
+	pulse(100 * (uint64_t)(F_CPU + OFFSET + 51), 0);
+	check(pps_rlog == OCXO_MINDELTA, "outage drops the interval");
+
+	return fail;
+}
@@ -0,0 +1,129 @@
+/*
+	This program is for Gnu LINUX, not AVR.
+	Build with: sh host/BUILD (from the top of the tree)
+
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+
+*/
+
+/*
+	Compares the Kalman filter's frequency estimate with the plain one
+	pps_report() used to make, the phase gained over each 16 seconds
+	divided by 16, on the simulated oscillator fed through the PPS
+	capture. For a few kinds of clock it reports, in cycles/s (Hz of CPU
+	clock error):
+
+	  rms		residual against the true frequency once settled
+	  settle	seconds until the residual stays inside SETTLE
+	  worst		largest residual once settled
+
+	and the host time for one kal_pps() update. The filter is set for
+	the noise of each clock (R from the PPS jitter, Q1 from the random
+	walk); the last row runs with the defaults from config.h.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+
+#include "config.h"
+#include "sim.h"
+#include "osc.h"
+#include "pps.h"
+#include "kalman.h"
+
+#define SECS 20000
+#define SETTLE 0.02			// cycles/s, 5e-9 at 4MHz
+
+extern int64_t pps_phase;
+
+static int8_t half_log2(double v)
+{
+	return lround(2 * log2(v));
+}
+
+static void bench(const char * name, double wpm, double rwfm, double aging, int8_t tuned)
+{
+	struct osc o = { .y0 = 3.7, .wpm = wpm, .rwfm = rwfm, .aging = aging };
+	double sk = 0, ss = 0, wk = 0, ws = 0, sum = 0;
+	uint32_t tk = 0, ts = 0, n = 0;
+	int64_t x16 = 0;
+
+	sim_init(F_CPU);
+	pps_init(150000);
+	sei();
+	if (tuned)
+	    kal_config(half_log2(wpm * wpm + 1.0 / 12), -60, rwfm ? half_log2(rwfm * rwfm) : -100, -120);
+	osc_seed(3);
+	osc_init(&o);
+	osc_second(&o, 1);
+	for (uint32_t t = 1; t <= SECS; t++)
+	{
+	    double y = osc_freq(&o), ek, es;
+
+	    osc_second(&o, 1);
+	    if (!(t % 16))
+	    {
+		sum = (pps_phase - x16) / 16.0;
+		x16 = pps_phase;
+	    }
+	    ek = fabs(kal_freq() - y);
+	    es = fabs(sum - y);
+	    if (ek > SETTLE)
+		tk = t;
+	    if (es > SETTLE)
+		ts = t;
+	    if (t > SECS / 2)
+	    {
+		sk += ek * ek;
+		ss += es * es;
+		wk = ek > wk ? ek : wk;
+		ws = es > ws ? es : ws;
+		n++;
+	    }
+	}
+	printf("%-26s %9.2e %9.2e ", name, sqrt(sk / n), sqrt(ss / n));
+	printf(tk < SECS ? "%7lu " : "  never ", (unsigned long)tk);
+	printf(ts < SECS ? "%7lu " : "  never ", (unsigned long)ts);
+	printf("%9.2e %9.2e\n", wk, ws);
+}
+
+int main()
+{
+	struct timespec t0, t1;
+	uint32_t i;
+
+	printf("                           ---------- rms  -- settle --  --------- worst\n");
+	printf("                              Kalman      16 s  Kalman    16 s    Kalman      16 s\n");
+	bench("OCXO, 1 cycle jitter", 1, 1e-5, 0, 1);
+	bench("OCXO, 4 cycles jitter", 4, 1e-5, 0, 1);
+	bench("crystal, 4 cycles jitter", 4, 2e-4, 1e-6, 1);
+	bench("crystal, 16 cycles jitter", 16, 2e-4, 1e-6, 1);
+	bench("defaults, 4 cycles jitter", 4, 1e-5, 0, 0);
+
+	kal_init();
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < 1000000; i++)
+	    kal_pps((int32_t)(i * 2654435761u >> 29) - 4, 1);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	printf("kal_pps(): %.0f ns per update on this host\n",
+		((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / i);
+	return 0;
+}
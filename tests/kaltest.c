@@ -0,0 +1,212 @@
+/*
+	This program is for Gnu LINUX, not AVR.
+	Build with: sh host/BUILD (from the top of the tree)
+
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+
+*/
+
+
+/*
+	Checks the fixed point Kalman filter against the same filter in
+	double precision on a simulated clock with an offset, drift, random
+	walk and white phase noise; that it settles on the true frequency
+	and drift; that it carries on over short gaps and starts again
+	after long ones; and that the noise parameters can be set over SPI.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "config.h"
+#include "sim.h"
+#include "osc.h"
+#include "spi.h"
+#include "event.h"
+#include "kalman.h"
+
+#define LR 0
+#define LQ0 (-40)
+#define LQ1 (-46)
+#define LQ2 (-80)
+
+static int fail;
+
+static void check(int ok, const char * what)
+{
+	printf("%s: %s\n", ok ? "ok  " : "FAIL", what);
+	if (!ok) fail = 1;
+}
+
+// The reference: the same filter in double precision, absolute phase
+static double rx[3], rp[3][3], rr, rq[3];
+static int rn;
+
+static void ref_pps(double z, double err, uint32_t n)
+{
+	double a[3][3], k[3], d, v;
+
+	if (!rn++ || n > KAL_GAP)
+	{
+	    rx[0] = z; rx[1] = err / n; rx[2] = 0;
+	    for (int i = 0; i < 3; i++)
+		for (int j = 0; j < 3; j++)
+		    rp[i][j] = 0;
+	    rp[0][0] = rr; rp[1][1] = 2 * rr; rp[2][2] = ldexp(1, -20);
+	    rn = 1;
+	    return;
+	}
+	while (n--)
+	{
+	    rx[0] += rx[1] + rx[2] / 2;
+	    rx[1] += rx[2];
+	    for (int j = 0; j < 3; j++)
+	    {
+		a[0][j] = rp[0][j] + rp[1][j] + rp[2][j] / 2;
+		a[1][j] = rp[1][j] + rp[2][j];
+		a[2][j] = rp[2][j];
+	    }
+	    for (int i = 0; i < 3; i++)
+	    {
+		rp[i][0] = a[i][0] + a[i][1] + a[i][2] / 2;
+		rp[i][1] = a[i][1] + a[i][2];
+		rp[i][2] = a[i][2];
+		rp[i][i] += rq[i];
+	    }
+	}
+	d = rp[0][0] + rr;
+	v = z - rx[0];
+	for (int i = 0; i < 3; i++)
+	{
+	    k[i] = rp[i][0] / d;
+	    rx[i] += k[i] * v;
+	}
+	for (int i = 0; i < 3; i++)
+	    for (int j = 0; j < 3; j++)
+		a[i][j] = rp[i][j] - k[i] * rp[0][j];
+	for (int i = 0; i < 3; i++)
+	    for (int j = 0; j < 3; j++)
+		rp[i][j] = a[i][j];
+}
+
+// Simulated clock: true phase and frequency, cycles and cycles/s
+static double cx, cy, cd = 2e-5, cz;
+
+static void second(uint8_t pulse, uint32_t * n)
+{
+	double z;
+	int32_t err;
+
+	cx += cy + cd / 2;
+	cy += cd + 1e-4 * osc_gauss();
+	++*n;
+	if (!pulse)
+	    return;
+	z = cx + osc_gauss();
+	err = llround(z) - llround(cz);
+	cz = llround(z);
+	kal_pps(err, *n);
+	ref_pps(cz, err, *n);
+	*n = 0;
+}
+
+int main()
+{
+	double dx = 0, dy = 0, ey = 0, ed = 0;
+	uint32_t n = 0, t;
+	uint8_t frame[24];
+	int len;
+
+	sim_init(F_CPU);
+	spi_init();
+	sei();
+	kal_init();
+	check(kal_lr == KAL_R && kal_lq[0] == KAL_Q0 && kal_lq[1] == KAL_Q1 && kal_lq[2] == KAL_Q2,
+		"starts with the noise parameters from config.h");
+	kal_config(LR, LQ0, LQ1, LQ2);
+	rq[0] = pow(2, LQ0 / 2.0);
+	rq[1] = pow(2, LQ1 / 2.0);
+	rq[2] = pow(2, LQ2 / 2.0);
+	rr = pow(2, LR / 2.0);
+
+	osc_seed(5);
+	cy = 3.2;
+	second(1, &n);
+	for (t = 1; t <= 20000; t++)
+	{
+	    second(1, &n);
+	    if (t >= 100)
+	    {
+		double fy = kal_freq() - rx[1];
+		double fx = cz + kal_x[0] * ldexp(1, -32) - rx[0];
+
+		if (fabs(fy) / sqrt(rp[1][1]) > dy) dy = fabs(fy) / sqrt(rp[1][1]);
+		if (fabs(fx) > dx) dx = fabs(fx);
+	    }
+	}
+	ey = kal_freq() - cy;
+	ed = kal_x[2] * ldexp(1, -32 - 2 * KAL_TLOG) - cd;
+	printf("worst difference from double: phase %.1e cycles, frequency %.1e sigma\n", dx, dy);
+	printf("after %lu s: frequency off by %.2e (sigma %.2e) cycles/s, drift by %.2e (sigma %.2e)\n",
+		(unsigned long)t, ey, sqrt(rp[1][1]), ed, sqrt(rp[2][2]));
+	check(dx < 0.01 && dy < 0.05, "fixed point follows double precision");
+	check(fabs(ey) < 3 * sqrt(rp[1][1]) && fabs(ed) < 3 * sqrt(rp[2][2]), "settles on the true frequency and drift");
+
+	// A gap it can carry on over, then one it can't
+	for (uint8_t i = 0; i < 30; i++)
+	    second(0, &n);
+	t = kal_n;
+	second(1, &n);
+	check(kal_n == t + 1 && fabs(kal_freq() - cy) < 0.01, "carries on over a 30 s gap");
+	for (uint8_t i = 0; i < KAL_GAP + 1; i++)
+	    second(0, &n);
+	second(1, &n);
+	check(kal_n == 1, "starts again after a longer gap");
+
+	// New parameters over SPI (measurement noise left alone), and the
+	// state comes back
+	{
+	    static const uint8_t cmd[] = { SPICMD_KAL, (uint8_t)KAL_KEEP, (uint8_t)-50, (uint8_t)-60, (uint8_t)-90 };
+
+	    sim_spi_send(cmd, sizeof cmd);
+	}
+	spi_xeq();
+	len = sim_spi_recv(frame, sizeof frame, 80);
+	{
+	    int32_t f = frame[9] | frame[10] << 8 | frame[11] << 16 | (uint32_t)frame[12] << 24;
+
+	    check(kal_lr == LR && kal_lq[0] == -50 && kal_lq[1] == -60 && kal_lq[2] == -90,
+		    "parameters set over SPI");
+	    check(len == 17 && frame[0] == SPICMD_KAL && (int8_t)frame[2] == -50 && fabs(f / 65536.0 - kal_freq()) < 1e-4,
+		    "reply carries the parameters and state");
+	}
+
+	// After a gap of hours the cycles gained can be anything: it starts
+	// from their ratio, saturated rather than overflowing
+	kal_pps(-123456789, 3600);
+	dx = kal_freq() + 123456789.0 / 3600;
+	kal_pps(0x7FFFFFFF, 0xFFFFFFFF);
+	dy = kal_freq() - 0x7FFFFFFF / 4294967295.0;
+	kal_pps(0x7FFFFFFF, KAL_GAP + 1);
+	check(fabs(dx) < 0.01 && fabs(dy) < 1e-5 && kal_freq() > 1e6 && kal_n == 1,
+	    "any frequency after a long gap");
+
+	return fail;
+}
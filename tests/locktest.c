@@ -0,0 +1,147 @@
+/*
+	This program is for Gnu LINUX, not AVR.
+	Build with: sh host/BUILD (from the top of the tree)
+
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+
+*/
+
+
+/*
+	Runs the lock state machine against the simulated oscillator from
+	power up: the EFC is held through the warm up, then the loop goes
+	through coarse and fine acquisition to locked, recording when. The
+	time to lock is compared with going straight to fine acquisition.
+	Phase disturbances inside the hysteresis leave the lock alone, larger
+	ones drop back a state, and the state comes back over SPI.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "config.h"
+#include "sim.h"
+#include "osc.h"
+#include "pps.h"
+#include "spi.h"
+#include "event.h"
+#include "efc.h"
+#include "disc.h"
+
+static int fail;
+
+static void check(int ok, const char * what)
+{
+	printf("%s: %s\n", ok ? "ok  " : "FAIL", what);
+	if (!ok) fail = 1;
+}
+
+static uint32_t lock(struct osc * o, uint8_t coarse)
+// From power up with a 1.2Hz offset; returns the time to lock, seconds
+{
+	uint8_t last = DISC_OFF, order = 1;
+	uint16_t held = 1;
+
+	o->y0 = 1.2;
+	sim_init(F_CPU);
+	spi_init();
+	pps_init(150000);
+	sei();
+	osc_seed(9);
+	osc_init(o);
+	osc_second(o, 1);
+	disc_init(EFC_MID, OCXO_WARMUP);
+	if (!coarse)
+	    disc_config(DISC_TAU_ACQ, DISC_TAU_ACQ, DISC_TAU_TRK, DISC_ZETA, DISC_KD);
+	for (uint32_t i = 1; i <= 20000 && !disc_tlock; i++)
+	{
+	    osc_second(o, 1);
+	    if (disc_mode == DISC_WARM)
+		held &= efc_get() == EFC_MID;
+	    if (disc_mode != last)
+	    {
+		order &= disc_mode == last + 1 || last == DISC_OFF;
+		last = disc_mode;
+	    }
+	}
+	if (coarse)
+	{
+	    check(held && disc_at[DISC_COARSE] == OCXO_WARMUP, "EFC held through the warm up");
+	    check(order && disc_mode == DISC_TRK, "coarse, fine, locked in order");
+	    check(disc_at[DISC_WARM] < disc_at[DISC_COARSE] && disc_at[DISC_COARSE] < disc_at[DISC_ACQ]
+		    && disc_at[DISC_ACQ] < disc_at[DISC_TRK] && disc_tlock == disc_at[DISC_TRK],
+		    "transition times recorded");
+	}
+	return disc_tlock;
+}
+
+int main()
+{
+	struct osc o = { .kv = DISC_KV, .wpm = 1, .rwfm = 1e-5 };
+	uint32_t t, t0;
+	uint16_t changes;
+	uint8_t low;
+	static const uint8_t cmd[] = { SPICMD_LOCK };
+	uint8_t frame[24];
+	int len;
+
+	t0 = lock(&o, 0);
+	t = lock(&o, 1);
+	printf("time to lock from power up %lu s (%lu s acquiring); fine acquisition only %lu s\n",
+		(unsigned long)t, (unsigned long)(t - OCXO_WARMUP), (unsigned long)t0);
+	check(t < t0, "coarse acquisition locks sooner");
+
+	for (uint16_t i = 0; i < 4000; i++)
+	    osc_second(&o, 1);
+	printf("figure of merit %u\n", disc_quality());
+	check(disc_quality() >= 90, "figure of merit high once settled");
+
+	// Inside the hysteresis: stays locked
+	changes = disc_changes;
+	o.x += 2 * DISC_LOCKED;
+	for (uint16_t i = 0; i < 600; i++)
+	    osc_second(&o, 1);
+	check(disc_changes == changes && disc_mode == DISC_TRK, "small phase step rides through");
+
+	// Outside it: fine acquisition, not coarse, then locked again
+	o.x += 2 * DISC_HYST * DISC_LOCKED;
+	low = DISC_TRK;
+	for (uint16_t i = 0; i < 3000; i++)
+	{
+	    osc_second(&o, 1);
+	    if (disc_mode < low)
+		low = disc_mode;
+	}
+	check(low == DISC_ACQ, "large phase step drops back to fine acquisition");
+	check(disc_mode == DISC_TRK && disc_tlock == t, "locks again, time to lock kept");
+
+	// State over SPI, once the state changes have been read
+	while (sim_spi_recv(frame, sizeof frame, 200) >= 0)
+	    ;
+	sim_spi_send(cmd, sizeof cmd);
+	spi_xeq();
+	while ((len = sim_spi_recv(frame, sizeof frame, 80)) >= 0 && frame[0] != SPICMD_LOCK)
+	    ;
+	check(len == 19 && frame[1] == DISC_TRK && frame[2] == disc_quality()
+		&& (frame[11] | frame[12] << 8 | frame[13] << 16 | (uint32_t)frame[14] << 24) == t,
+		"state, figure of merit and time to lock over SPI");
+
+	return fail;
+}
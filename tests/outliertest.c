@@ -0,0 +1,110 @@
+/*
+	This program is for Gnu LINUX, not AVR.
+	Build with: sh host/BUILD (from the top of the tree)
+
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+
+*/
+
+/*
+	Checks the robust (median/MAD) PPS filter with a CPU clock 3Hz
+	fast and a cycle of capture jitter: the gate closes in as the
+	window fills, single spikes well inside the fixed tolerance are
+	left out of the phase and counted, and a real step in frequency
+	opens the gate again after a short run of outliers without losing
+	any cycles.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "config.h"
+#include "sim.h"
+#include "pps.h"
+#include "event.h"
+
+#define OFFSET 3			// CPU clock error, Hz
+#define SPIKE 40			// Capture error of a bad pulse, cycles
+#define PPS_RESYNC 4			// As in pps.c
+
+static int fail;
+static int64_t late;			// Capture error of the last pulse
+
+static void check(int ok, const char * what)
+{
+	printf("%s: %s\n", ok ? "ok  " : "FAIL", what);
+	if (!ok) fail = 1;
+}
+
+static void pulse(uint32_t second, int64_t err)
+// A PPS edge one GPS second after the last, captured err cycles late
+{
+	sim_advance(second + err - late);
+	late = err;
+	sim_capture();
+	event_xeq();
+}
+
+static int64_t jitter(void)
+{
+	return rand() % 3 - 1;
+}
+
+int main()
+{
+	int32_t gate;
+	uint8_t ok = 1;
+
+	sim_init(F_CPU);
+	pps_init(150000);			// Tolerance of 60000 cycles at 4MHz
+	sei();
+	srand(1);
+
+	pulse(12345, 0);
+	check(pps_gate == 0, "gate open until the window fills");
+	for (uint8_t i = 0; i < 30; i++)
+	    pulse(F_CPU + OFFSET, jitter());
+	gate = pps_gate;
+	printf("gate %ld cycles, median %ld\n", (long)gate, (long)pps_med);
+	check(gate > 0 && gate < 20 && pps_med == OFFSET, "gate closes in as the clock settles");
+
+	// Spikes, one pulse in ten. The old fixed gate summed these in.
+	for (uint16_t i = 0; i < 100; i++)
+	{
+	    if (i % 10 == 5)
+	    {
+		pulse(F_CPU + OFFSET, i & 16 ? SPIKE : -SPIKE);
+		continue;
+	    }
+	    pulse(F_CPU + OFFSET, jitter());
+	    ok &= pps_phase == (int64_t)pps_secs * OFFSET + late;
+	}
+	check(pps_outlier == 10 && pps_glitch == 0, "spikes ignored and counted");
+	check(ok, "phase follows the clock through the spikes");
+
+	// The clock steps 100Hz fast
+	for (uint8_t i = 0; i < 20; i++)
+	    pulse(F_CPU + OFFSET + 100, 0);
+	check(pps_reacq == 1 && pps_outlier == 10 + PPS_RESYNC - 1, "a frequency step reopens the filter");
+	check(pps_phase == (int64_t)pps_secs * OFFSET + 20 * 100, "no cycles lost over the step");
+	check(pps_med == OFFSET + 100 && pps_gate < 20, "gate closes in on the new frequency");
+
+	return fail;
+}
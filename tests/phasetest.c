@@ -0,0 +1,107 @@
+/*
+	This program is for Gnu LINUX, not AVR.
+	Build with: sh host/BUILD (from the top of the tree)
+
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+
+*/
+
+/*
+	Checks the PPS phase accumulator with a CPU clock 3Hz fast, so
+	that pps_phase should always be 3 cycles times pps_secs, through
+	a missing pulse, a doubled pulse, a pulse out of tolerance, a run
+	of bad pulses long enough to force a restart, and a 1000 second
+	outage.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "sim.h"
+#include "pps.h"
+#include "event.h"
+
+#define OFFSET 3			// CPU clock error, Hz
+#define SECOND (F_CPU + OFFSET)		// CPU cycles per GPS second
+
+static int fail;
+
+static void check(int ok, const char * what)
+{
+	printf("%s: %s\n", ok ? "ok  " : "FAIL", what);
+	if (!ok) fail = 1;
+}
+
+static void wait(uint64_t cycles)
+{
+	while (cycles > 0x80000000)
+	{
+	    sim_advance(0x80000000);
+	    cycles -= 0x80000000;
+	}
+	sim_advance(cycles);
+}
+
+static void pulse(uint64_t after)
+// Let some time pass, then a PPS edge, then let the background run
+{
+	wait(after);
+	sim_capture();
+	event_xeq();
+}
+
+int main()
+{
+	sim_init(F_CPU);
+	pps_init(100);				// 100 ppm, 400 cycles at 4MHz
+	sei();
+
+	pulse(12345);				// First pulse just starts the count
+	for (uint8_t i = 0; i < 10; i++)
+	    pulse(SECOND);
+	check(pps_secs == 10 && pps_phase == 10 * OFFSET, "ten good seconds");
+
+	pulse(2 * SECOND);
+	check(pps_secs == 12 && pps_phase == 12 * OFFSET && pps_missed == 1,
+		"missing pulse counted as two seconds");
+
+	pulse(SECOND / 2);
+	pulse(SECOND - SECOND / 2);
+	check(pps_secs == 13 && pps_phase == 13 * OFFSET && pps_glitch == 1,
+		"doubled pulse ignored without losing cycles");
+
+	pulse(SECOND + 5000);
+	pulse(SECOND - 5000);
+	check(pps_secs == 15 && pps_phase == 15 * OFFSET && pps_glitch == 2 && pps_missed == 2,
+		"pulse out of tolerance ignored without losing cycles");
+
+	pulse(1000 * (uint64_t)SECOND);
+	check(pps_secs == 1015 && pps_phase == 1015 * OFFSET && pps_missed == 1001,
+		"1000 second outage keeps phase");
+
+	// A bad anchor: every later pulse looks out of tolerance until restart
+	pulse(SECOND + 3000);
+	for (uint8_t i = 0; i < 8; i++)
+	    pulse(SECOND);
+	check(pps_resync == 1, "restart after a run of bad pulses");
+	check(pps_phase == (int64_t)pps_secs * OFFSET, "phase carries on from the restart");
+
+	return fail;
+}
@@ -0,0 +1,138 @@
+/*
+	This program is for Gnu LINUX, not AVR.
+	Build with: sh host/BUILD (from the top of the tree)
+
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+
+*/
+
+/*
+	Trimming the internal RC oscillator from PPS. The simulated part runs
+	from an RC oscillator whose OSCCAL steps are uneven and average 0.6%,
+	factory set 3.5% slow of RC_HZ. The search must start from the
+	factory code, move it at most RC_STEP steps a second, and leave the
+	pair of steps either side of RC_HZ within 8 seconds. Switching between them
+	must then hold the phase within a few steps' worth for hours, so the
+	average frequency is right to a part in a million. A drift of 2% over
+	an hour (temperature, supply) must move the pair without losing lock.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "config.h"
+#include "sim.h"
+#include "osc.h"
+#include "time.h"
+#include "pps.h"
+#include "cpu.h"
+#include "rc.h"
+
+static int fail;
+
+static void check(int ok, const char * what)
+{
+	printf("%s: %s\n", ok ? "ok  " : "FAIL", what);
+	if (!ok) fail = 1;
+}
+
+static double hz(struct osc * o, uint8_t code)
+// Frequency of the simulated oscillator at an OSCCAL code
+{
+	return (RC_HZ + o->y) * o->rc_f[code] / o->rc_f[o->rc_cal];
+}
+
+static void hours(struct osc * o, uint32_t secs, int64_t * maxph)
+// Run, noting the largest phase
+{
+	*maxph = 0;
+	while (secs--)
+	{
+	    osc_second(o, 1);
+	    if (llabs(pps_phase) > *maxph)
+		*maxph = llabs(pps_phase);
+	}
+}
+
+int main()
+{
+	struct osc o = { .y0 = -0.035 * RC_HZ, .rc_step = 0.006, .rc_cal = 0x9C,
+			 .rwfm = 20, .wpm = 2 };
+	uint32_t n, secs;
+	uint16_t moves, step;
+	int64_t ph0, maxph, bound;
+	double err;
+	char what[120];
+
+	sim_init(RC_HZ);
+	cpu_init(RC_HZ);
+	time_init();
+	pps_init(150000);
+	OSCCAL = o.rc_cal;		// Factory calibration, loaded at reset
+	rc_init();
+	sei();
+	osc_init(&o);
+	printf("untrimmed: %+.2f%% at OSCCAL 0x%02X\n", 100 * (hz(&o, o.rc_cal) / RC_HZ - 1), o.rc_cal);
+
+	// Search: first pulse, then up to RC_STEP codes a second from the
+	// factory calibration
+	for (n = 0, step = 0; rc_state == RC_SEARCH && n < 20; n++)
+	{
+	    uint8_t was = OSCCAL;
+
+	    osc_second(&o, 1);
+	    if (abs(OSCCAL - was) > step)
+		step = abs(OSCCAL - was);
+	}
+	snprintf(what, sizeof what, "search done after %lu seconds, at most %u steps a second: OSCCAL 0x%02X %+.3f%%, 0x%02X %+.3f%%",
+		(unsigned long)n, step, rc_code, 100 * (hz(&o, rc_code) / RC_HZ - 1),
+		rc_code + 1, 100 * (hz(&o, rc_code + 1) / RC_HZ - 1));
+	check(rc_state == RC_DITHER && n <= 8 && step <= RC_STEP
+		&& hz(&o, rc_code) <= RC_HZ && hz(&o, rc_code + 1) > RC_HZ, what);
+
+	// Dither: a second's worth of each step either side, plus the noise
+	bound = 2 * (int64_t)(hz(&o, rc_code + 1) - hz(&o, rc_code)) + 1000;
+	osc_second(&o, 1);
+	ph0 = pps_phase;
+	secs = pps_secs;
+	hours(&o, 3 * 3600, &maxph);
+	err = (double)(pps_phase - ph0) / ((double)(pps_secs - secs) * RC_HZ);
+	snprintf(what, sizeof what, "3 hours: phase within %lld cycles (bound %lld), mean error %.2g, %lu glitches, %lu outliers",
+		(long long)maxph, (long long)bound, err, (unsigned long)pps_glitch, (unsigned long)pps_outlier);
+	check(maxph <= bound && fabs(err) < 1e-6 && pps_secs - secs == 3 * 3600 && !pps_glitch, what);
+
+	// Drift the oscillator up 2% over an hour: the pair follows it down
+	o.aging = 0.02 * RC_HZ / 3600;
+	moves = rc_moves;
+	hours(&o, 3600, &maxph);
+	o.aging = 0;
+	for (n = 0; n < 60; n++)
+	    osc_second(&o, 1);
+	snprintf(what, sizeof what, "2%% drift: pair moved %u times to 0x%02X %+.3f%%, 0x%02X %+.3f%%, phase within %lld cycles",
+		rc_moves - moves, rc_code, 100 * (hz(&o, rc_code) / RC_HZ - 1),
+		rc_code + 1, 100 * (hz(&o, rc_code + 1) / RC_HZ - 1), (long long)maxph);
+	// (give or take what the frequency can walk in the seconds it takes
+	// to see a step go the wrong way)
+	check(rc_moves - moves >= 2 && maxph <= 2 * bound
+		&& hz(&o, rc_code) <= RC_HZ + 10 * o.rwfm && hz(&o, rc_code + 1) > RC_HZ - 10 * o.rwfm, what);
+
+	return fail;
+}
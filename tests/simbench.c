@@ -0,0 +1,152 @@
+/*
+	This program is for Gnu LINUX, not AVR.
+	Build with: sh host/BUILD (from the top of the tree)
+
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+
+*/
+
+/*
+	Drives the firmware core on the host with each interrupt source
+	firing at a controlled rate and reports how many events per second
+	of host time each path sustains:
+
+	  scheduler	TIMER0_COMP into proc_timer()/time_xeq() with a few
+			periodic timers set
+	  slip		SPI_STC with frames containing END and ESC bytes
+			continuously queued, so every other byte is an
+			escape (the frames are escaped as they are queued)
+	  pps		TIMER1_CAPT once per simulated second into
+			pps_report(), including the overflow interrupts
+	  serial	USART_UDRE draining serial_printf_P() lines
+
+	The numbers are only comparable between runs on the same machine.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "config.h"
+#include "sim.h"
+#include "time.h"
+#include "pps.h"
+#include "spi.h"
+#include "serial.h"
+#include "event.h"
+
+static uint32_t spi_frames;
+
+static unsigned char tick(struct tlist * tl)
+{
+	return 0;
+}
+
+static unsigned char chatter(struct tlist * tl)
+{
+	serial_printf_P(PSTR("%8li cycles\r\n"), (long)tl->tl_udata.longs);
+	return 0;
+}
+
+static void background(void)
+{
+	proc_timer();
+	event_xeq();
+	time_xeq();
+}
+
+static void slip_background(void)
+// Keep the SPI transmit queue full of frames that need escaping
+{
+	struct spi_buf * buf;
+
+	while ((buf = spi_getbuf()))
+	{
+	    for (uint8_t i = 0; i < 10; i++)
+		*(buf->ptr++) = (i & 1) ? END : ESC;
+	    spi_tx_queue(buf);
+	    spi_frames++;
+	}
+	background();
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void setup(void)
+{
+	sim_init(F_CPU);
+	time_init();
+	pps_init(150000);
+	spi_init();
+	serial_init(BPS_4800);
+	sei();
+}
+
+static void report(const char * name, uint8_t vector, double t)
+{
+	printf("%-10s %10lu events %8.3f s %12.0f events/s\n",
+		name, (unsigned long)sim_count[vector], t, sim_count[vector] / t);
+}
+
+int main()
+{
+	struct sim_rates rate;
+	double t;
+
+	// Scheduler: 5 periodic timers, Timer0 at 1 MHz simulated
+	setup();
+	for (uint8_t i = 0; i < 5; i++)
+	    time_set(tick, 1 + i, i, 0, 1);
+	rate = (struct sim_rates){.timer0 = 1000000};
+	t = now();
+	sim_run(&rate, (uint64_t)F_CPU * 4, background);
+	report("scheduler", SIM_TIMER0_COMP, now() - t);
+
+	// SLIP encoder: SPI byte per 4 CPU cycles, scheduler stopped
+	setup();
+	TCCR0 = 0;
+	rate = (struct sim_rates){.spi = F_CPU / 4};
+	t = now();
+	sim_run(&rate, (uint64_t)F_CPU * 4, slip_background);
+	report("slip", SIM_SPI_STC, now() - t);
+
+	// PPS statistics: one capture per second for a simulated day
+	setup();
+	TCCR0 = 0;
+	rate = (struct sim_rates){.capt = 1};
+	t = now();
+	sim_run(&rate, (uint64_t)F_CPU * 86400, background);
+	report("pps", SIM_TIMER1_CAPT, now() - t);
+
+	// Serial output: a line queued every tick, line drained a byte per event
+	setup();
+	time_set(chatter, 1, 0, 0, 1);
+	rate = (struct sim_rates){.udre = F_CPU / 16};
+	t = now();
+	sim_run(&rate, (uint64_t)F_CPU * 4, background);
+	report("serial", SIM_USART_UDRE, now() - t);
+
+	return 0;
+}
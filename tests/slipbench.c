@@ -0,0 +1,197 @@
+/*
+	This program is for Gnu LINUX, not AVR.
+	Build with: sh host/BUILD (from the top of the tree)
+
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+
+*/
+
+/*
+	Replays a recorded MISO stream through the master's deframer and
+	decoder (host/slip.c) and reports MB/s and messages/s, fed whole and
+	in 32 byte reads as gpsdo.py polls. The stream is the file named on
+	the command line, either a capture from "gpsdo.py --capture" (its
+	MISO records) or raw MISO bytes, or else about a megabyte recorded
+	here from the firmware: telemetry, PPS and capture stream messages,
+	some with escapes, with idle NULs between bursts.
+
+	The numbers are only comparable between runs on the same machine.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "config.h"
+#include "sim.h"
+#include "spi.h"
+#include "slip.h"
+
+#define STREAM_LEN (1 << 20)
+
+static uint8_t * stream;
+static size_t slen;
+
+static void record(uint8_t miso)
+{
+	if (slen < STREAM_LEN)
+	    stream[slen++] = miso;
+}
+
+static size_t varint(const uint8_t * p, size_t i, size_t end, uint64_t * v)
+{
+	uint8_t shift = 0;
+
+	*v = 0;
+	while (i < end)
+	{
+	    *v |= (uint64_t)(p[i] & 0x7F) << shift;
+	    shift += 7;
+	    if (!(p[i++] & 0x80))
+		return i;
+	}
+	return end + 1;
+}
+
+static void uncapture(void)
+// Keep only the MISO bytes of a capture file (see gpsdo.py), in place
+{
+	static const char magic[] = "GPSDOCAP\x01";
+	size_t i = sizeof magic - 1, out = 0;
+
+	if (slen < i || memcmp(stream, magic, i))
+	    return;
+	while (i < slen)
+	{
+	    uint8_t kind = stream[i++];
+	    uint64_t dt, n;
+
+	    if (kind == 2)
+	    {
+		i += 8;
+		continue;
+	    }
+	    i = varint(stream, i, slen, &dt);
+	    i = varint(stream, i, slen, &n);
+	    if (i > slen || n > slen - i)
+		break;
+	    if (kind == 0)
+	    {
+		memmove(stream + out, stream + i, n);
+		out += n;
+	    }
+	    i += n;
+	}
+	slen = out;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void generate(void)
+// Record messages as the firmware sends them
+{
+	uint32_t x = 1;
+
+	sim_init(F_CPU);
+	spi_init();
+	sei();
+	sim_spi_hook = record;
+	while (slen < STREAM_LEN)
+	{
+	    struct spi_buf * buf;
+
+	    while ((buf = spi_getbuf()))
+	    {
+		uint8_t n = x % 3 == 0 ? 21 : x % 3 == 1 ? 11 : 4 + x % 17;
+
+		*(buf->ptr++) = x % 3 == 0 ? SPICMD_TLM : x % 3 == 1 ? SPICMD_PPS : SPICMD_STREAM;
+		for (uint8_t i = 1; i < n; i++)
+		{
+		    x = x * 1103515245 + 12345;
+		    *(buf->ptr++) = x >> 24;
+		}
+		spi_tx_queue(buf);
+	    }
+	    for (uint16_t i = 0; i < 200; i++)
+		sim_spi(NUL);
+	}
+	sim_spi_hook = 0;
+}
+
+static void run(const char * name, size_t piece, int reps)
+{
+	struct slip s;
+	struct slip_msg m;
+	int64_t f[16];
+	uint64_t msgs = 0, fields = 0;
+	double t;
+
+	t = now();
+	for (int r = 0; r < reps; r++)
+	{
+	    slip_init(&s);
+	    for (size_t i = 0; i < slen; i += piece)
+	    {
+		slip_input(&s, stream + i, i + piece < slen ? piece : slen - i);
+		while (slip_next(&s, &m))
+		{
+		    int n = slip_decode(&m, f, 16);
+
+		    msgs++;
+		    fields += n > 0 ? n : 0;
+		}
+	    }
+	}
+	t = now() - t;
+	printf("%-10s %8.1f MB/s %10.0f messages/s  %u messages, %u copied, %u bad, %llu fields decoded\n",
+		name, (double)slen * reps / t / 1e6, msgs / t, s.frames, s.copied, s.bad,
+		(unsigned long long)(fields / reps));
+}
+
+int main(int argc, char ** argv)
+{
+	stream = malloc(STREAM_LEN);
+	if (argc > 1)
+	{
+	    FILE * f = fopen(argv[1], "rb");
+
+	    if (!f)
+	    {
+		perror(argv[1]);
+		return 1;
+	    }
+	    slen = fread(stream, 1, STREAM_LEN, f);
+	    fclose(f);
+	    uncapture();
+	} else {
+	    generate();
+	}
+	printf("%zu bytes\n", slen);
+	run("whole", slen, 50);
+	run("32 bytes", 32, 50);
+	return 0;
+}
@@ -0,0 +1,179 @@
+/*
+	This program is for Gnu LINUX, not AVR.
+	Build with: sh host/BUILD (from the top of the tree)
+
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+
+*/
+
+/*
+	The master's deframer (host/slip.c) on a stream recorded from the
+	firmware: frames with and without escapes, idle NULs between them,
+	and a damaged frame. Fed whole, it must give the same messages as the
+	simulator's own deframer, copying only those with escapes, and drop
+	the damaged one; fed in pieces of 1, 3 and 7 bytes it must give the
+	same again. The fixed layout messages must decode to what was sent.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "config.h"
+#include "sim.h"
+#include "spi.h"
+#include "slip.h"
+
+static int fail;
+static uint8_t stream[4096];		// MISO bytes, as recorded
+static size_t slen;
+
+struct got {
+	uint8_t seq, len;
+	uint8_t data[32];
+};
+
+static void check(int ok, const char * what)
+{
+	printf("%s: %s\n", ok ? "ok  " : "FAIL", what);
+	if (!ok) fail = 1;
+}
+
+static int same(const struct got * a, const struct got * b, int n)
+{
+	for (int i = 0; i < n; i++)
+	    if (a[i].seq != b[i].seq || a[i].len != b[i].len || memcmp(a[i].data, b[i].data, a[i].len))
+		return 0;
+	return 1;
+}
+
+static void record(uint8_t miso)
+{
+	if (slen < sizeof stream)
+	    stream[slen++] = miso;
+}
+
+static void queue(const uint8_t * msg, uint8_t n)
+{
+	struct spi_buf * buf = spi_getbuf();
+
+	memcpy(buf->buf, msg, n);
+	buf->ptr = buf->buf + n;
+	spi_tx_queue(buf);
+}
+
+static void clock_out(uint16_t n)
+{
+	while (n--)
+	    sim_spi(NUL);
+}
+
+static int deframe(size_t piece, struct got * g, int max, struct slip * s)
+// Feed the stream in pieces, returning the messages
+{
+	struct slip_msg m;
+	int n = 0;
+
+	slip_init(s);
+	for (size_t i = 0; i < slen; i += piece)
+	{
+	    slip_input(s, stream + i, i + piece < slen ? piece : slen - i);
+	    while (slip_next(s, &m))
+	    {
+		if (n < max)
+		{
+		    g[n].seq = m.seq;
+		    g[n].len = m.len;
+		    memcpy(g[n].data, m.data, m.len);
+		}
+		n++;
+	    }
+	}
+	return n;
+}
+
+int main()
+{
+	static const uint8_t pps[] = { SPICMD_PPS, 0x00, 0x09, 0x3D, 0x00, 0x10, 0x00, 0xF6, 0xFF, 0xFF, 0xFF };
+	static const uint8_t esc[] = { SPICMD_HOLD, END, ESC, END, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+	static const uint8_t tlm[] = { SPICMD_TLM, 1, 4, 100, 0, 0, 0, 0xC0, 0xDB, 0, 0, 5, 0, 0, 0, 0, 0x80, 0x20, 3, 0, 0 };
+	struct got want[16], got[16];
+	struct slip s;
+	struct slip_msg m;
+	int nwant = 0, n;
+	int64_t f[16];
+	char what[120];
+
+	sim_init(F_CPU);
+	spi_init();
+	sei();
+	sim_spi_hook = record;
+
+	queue(pps, sizeof pps);
+	queue(esc, sizeof esc);
+	clock_out(80);
+	queue(tlm, sizeof tlm);
+	queue(pps, sizeof pps);
+	clock_out(80);
+	while ((n = sim_spi_recv(want[nwant].data, sizeof want[0].data, 0)) >= 0)
+	{
+	    want[nwant].len = n;
+	    want[nwant++].seq = sim_spi_seq;
+	}
+
+	// A copy of the first frame, damaged
+	{
+	    size_t start = 0, end;
+
+	    while (!stream[start])
+		start++;
+	    end = (uint8_t *)memchr(stream + start, END, slen - start) - stream;
+	    memcpy(stream + slen, stream + start, end - start + 1);
+	    stream[slen + 3] ^= 0x10;
+	    slen += end - start + 1;
+	}
+
+	n = deframe(slen, got, 16, &s);
+	snprintf(what, sizeof what, "whole: %d messages (%d sent), %u bad, %u copied, %llu bytes",
+		n, nwant, s.bad, s.copied, (unsigned long long)s.bytes);
+	check(n == nwant && s.bad == 1 && s.copied == 2 && same(got, want, n), what);
+	for (int i = 0; i < 3; i++)
+	{
+	    static const size_t pieces[] = { 1, 3, 7 };
+
+	    n = deframe(pieces[i], got, 16, &s);
+	    snprintf(what, sizeof what, "in pieces of %zu: %d messages, %u bad", pieces[i], n, s.bad);
+	    check(n == nwant && s.bad == 1 && same(got, want, n), what);
+	}
+
+	// Decoding
+	m = (struct slip_msg){ .data = pps, .len = sizeof pps };
+	n = slip_decode(&m, f, 16);
+	check(n == 3 && f[0] == 4000000 && f[1] == 16 && f[2] == -10, "PPS message decoded");
+	m = (struct slip_msg){ .data = tlm, .len = sizeof tlm };
+	n = slip_decode(&m, f, 16);
+	check(n == 8 && f[0] == 1 && f[1] == 4 && f[2] == 100 && f[3] == 0xDBC0 && f[4] == 5 && f[5] == 0x8000
+		&& f[6] == 0x0320 && f[7] == 0, "telemetry decoded");
+	m = (struct slip_msg){ .data = tlm, .len = sizeof tlm - 1 };
+	check(slip_decode(&m, f, 16) < 0, "short message refused");
+	m = (struct slip_msg){ .data = (const uint8_t []){ SPICMD_STREAM, 0, 0, 0 }, .len = 4 };
+	check(slip_decode(&m, f, 16) < 0 && !slip_layout(SPICMD_STREAM), "no fixed layout for a capture stream");
+
+	return fail;
+}
@@ -0,0 +1,210 @@
+/*
+	This program is for Gnu LINUX, not AVR.
+	Build with: sh host/BUILD (from the top of the tree)
+
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+
+*/
+
+/*
+	Framing on the SPI bus. Messages are escaped when they are queued and
+	unescaped when they are read, and each frame carries a sequence
+	number, its length and a CRC. Messages made of every byte value, and
+	ones of only END and ESC at the longest, are queued and clocked out to
+	the simulated master, which must get them back byte for byte, in
+	sequence. A frame damaged on the way must cost the master only that
+	frame, and a resend request must bring it back, or say it has gone,
+	or leave it be if it has yet to go.
+	A command with END and ESC in it, clocked in with idle NULs and a
+	leading END around it, must reach msg1() unescaped; one with a bad
+	escape or CRC must be dropped.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "config.h"
+#include "sim.h"
+#include "spi.h"
+
+static int fail;
+static uint8_t cmd[SPIBUF_CLEN];	// Last message passed to msg1()
+static int cmdn;
+static int cmds;
+
+static void check(int ok, const char * what)
+{
+	printf("%s: %s\n", ok ? "ok  " : "FAIL", what);
+	if (!ok) fail = 1;
+}
+
+// Replaces the stub in sim.c
+void msg1(struct spi_buf * buf)
+{
+	cmdn = buf->cnt - 1;
+	memcpy(cmd, (char *)buf->ptr, cmdn);
+	cmds++;
+}
+
+static struct spi_buf * queue(const uint8_t * msg, int n)
+{
+	struct spi_buf * buf = spi_getbuf();
+
+	for (int i = 0; i < n; i++)
+	    *(buf->ptr++) = msg[i];
+	spi_tx_queue(buf);
+	return buf;
+}
+
+static void clock_in(const uint8_t * frame, int n)
+{
+	for (int i = 0; i < n; i++)
+	    sim_spi(frame[i]);
+	spi_xeq();
+}
+
+int main()
+{
+	uint8_t msg[SPIBUF_NUM][SPIBUF_DLEN];
+	uint8_t got[64];
+	uint8_t seq = 0;
+	int n, ok = 1;
+	char what[100];
+
+	sim_init(F_CPU);
+	spi_init();
+	sei();
+
+	// Every byte value, 0 to 255, after a message type, in messages of 2
+	// to SPIBUF_DLEN bytes, numbered in turn
+	for (int v = 0, k = 0; v < 256; k++)
+	{
+	    int len = 2 + k % (SPIBUF_DLEN - 1);
+
+	    msg[0][0] = SPICMD_PPS;
+	    for (int i = 1; i < len; i++)
+		msg[0][i] = v++;
+	    queue(msg[0], len);
+	    n = sim_spi_recv(got, sizeof got, 2 * SPIBUF_CLEN);
+	    if (n != len || memcmp(got, msg[0], len) || sim_spi_seq != seq++)
+		ok = 0;
+	}
+	check(ok && !sim_spi_bad, "every byte value comes through, in sequence");
+
+	// Queue as many as there are buffers to send from (one is kept to
+	// receive), all escapes, at the longest
+	for (int m = 0; m < SPIBUF_NUM - 1; m++)
+	{
+	    for (int i = 0; i < SPIBUF_DLEN; i++)
+		msg[m][i] = (i + m) & 1 ? END : ESC;
+	    queue(msg[m], SPIBUF_DLEN);
+	}
+	for (n = 0; n < SPIBUF_NUM - 1; n++)
+	    if (sim_spi_recv(got, sizeof got, 2 * SPIBUF_CLEN) != SPIBUF_DLEN || memcmp(got, msg[n], SPIBUF_DLEN))
+		ok = 0;
+	snprintf(what, sizeof what, "%d messages of %d escaped bytes read back", SPIBUF_NUM - 1, SPIBUF_DLEN);
+	check(ok && !sim_spi_bad, what);
+	seq += SPIBUF_NUM - 1;
+
+	// Damage the first of two frames on the way: the second still comes
+	// through, and the gap shows which to ask for
+	{
+	    static const uint8_t a[] = { SPICMD_PPS, 1, 2, 3 };
+	    static const uint8_t b[] = { SPICMD_PPS, 4, 5, 6 };
+	    struct spi_buf * buf = queue(a, sizeof a);
+
+	    queue(b, sizeof b);
+	    buf->buf[4] ^= 0x10;
+	    n = sim_spi_recv(got, sizeof got, 4 * SPIBUF_CLEN);
+	    snprintf(what, sizeof what, "damaged frame dropped (%u bad), next read as %u after %u",
+		     sim_spi_bad, sim_spi_seq, seq - 1);
+	    check(sim_spi_bad == 1 && n == sizeof b && !memcmp(got, b, sizeof b) && sim_spi_seq == (uint8_t)(seq + 1), what);
+
+	    // It was damaged on the wire as far as the MCU knows, so it
+	    // still has it, but not the one before the all-escape frames
+	    buf->buf[4] ^= 0x10;
+	    got[0] = SPICMD_RESEND;
+	    got[1] = seq;
+	    sim_spi_send(got, 2);
+	    spi_xeq();
+	    n = sim_spi_recv(got, sizeof got, 4 * SPIBUF_CLEN);
+	    check(n == sizeof a && !memcmp(got, a, sizeof a) && sim_spi_seq == seq, "resent on request");
+	    got[0] = SPICMD_RESEND;
+	    got[1] = seq - SPIBUF_NUM - 1;
+	    sim_spi_send(got, 2);
+	    spi_xeq();
+	    n = sim_spi_recv(got, sizeof got, 4 * SPIBUF_CLEN);
+	    check(n == 2 && got[0] == SPICMD_RESEND && got[1] == (uint8_t)(seq - SPIBUF_NUM - 1),
+		  "a frame that has gone is reported");
+
+	    // One that has yet to go comes once, in its turn, with nothing said
+	    got[0] = SPICMD_RESEND;
+	    got[1] = spi_seq;
+	    sim_spi_send(got, 2);
+	    queue(b, sizeof b);
+	    spi_xeq();
+	    n = sim_spi_recv(got, sizeof got, 4 * SPIBUF_CLEN);
+	    ok = n == sizeof b && !memcmp(got, b, sizeof b) && sim_spi_seq == (uint8_t)(spi_seq - 1);
+	    check(ok && sim_spi_recv(got, sizeof got, 4 * SPIBUF_CLEN) < 0, "a frame waiting to go is not resent");
+	}
+
+	// A command with 0x01 END 0x02 ESC 0x03 in it, after idle and an END
+	{
+	    static const uint8_t want[] = { 1, END, 0x02, ESC, 0x03 };
+
+	    cmds = 0;
+	    sim_spi(NUL);
+	    sim_spi(END);
+	    sim_spi_send(want, sizeof want);
+	    sim_spi(NUL);
+	    spi_xeq();
+	    check(cmds == 1 && cmdn == sizeof want - 1 && !memcmp(cmd, want + 1, sizeof want - 1),
+		  "command unescaped in the background");
+	}
+	{
+	    static const uint8_t frame[] = { 0x01, 0x00, 0x01, ESC, 0x02, 0x00, END, NUL };
+
+	    cmds = 0;
+	    clock_in(frame, sizeof frame);
+	    check(cmds == 0, "command with a bad escape dropped");
+	}
+	{
+	    static const uint8_t frame[] = { 0x01, 0x00, 0x01, 0x12, 0x34, END, NUL };
+
+	    cmds = 0;
+	    n = spi_crcerr;
+	    clock_in(frame, sizeof frame);
+	    check(cmds == 0 && spi_crcerr == n + 1, "command with a bad CRC dropped");
+	}
+
+	// And the buffers have all come back, free or sent, but the one
+	// kept ready to receive
+	{
+	    struct spi_buf * b[SPIBUF_NUM];
+
+	    n = 0;
+	    while (n < SPIBUF_NUM && (b[n] = spi_getbuf()))
+		n++;
+	    snprintf(what, sizeof what, "%d of %d buffers to be had, one ready to receive", n, SPIBUF_NUM);
+	    check(n == SPIBUF_NUM - 1, what);
+	}
+
+	return fail;
+}
@@ -0,0 +1,185 @@
+/*
+	This program is for Gnu LINUX, not AVR.
+	Build with: sh host/BUILD (from the top of the tree)
+
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+
+*/
+
+/*
+	The capture stream. With records batched 16 to a frame, ten minutes
+	of pulses from an oscillator 445 Hz out with 3 cycles of jitter, a few
+	missing, are read as they come and decoded. Every record must be
+	there, in order; the good ones must add up to the seconds and the
+	phase pps.c has; and the bytes each second takes on the wire, framing
+	and all, must be a small part of what a 25 kHz SPI clock carries.
+	Records that find no buffer must not be counted as sent.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "sim.h"
+#include "osc.h"
+#include "spi.h"
+#include "pps.h"
+#include "event.h"
+#include "cmd.h"
+#include "stream.h"
+
+static int fail;
+
+static uint16_t next;			// Next record number expected
+static uint32_t records, frames, gaps;
+static uint32_t secs;			// Good pulses: seconds, and
+static int64_t phase;			// their errors added up
+static uint32_t flagged;		// Records with a status
+static uint32_t longer;			// Good pulses more than a second after the last
+
+static void check(int ok, const char * what)
+{
+	printf("%s: %s\n", ok ? "ok  " : "FAIL", what);
+	if (!ok) fail = 1;
+}
+
+static const uint8_t * varint(const uint8_t * p, uint32_t * v)
+{
+	uint8_t shift = 0;
+
+	*v = 0;
+	do
+	{
+	    *v |= (uint32_t)(*p & 0x7F) << shift;
+	    shift += 7;
+	} while (*p++ & 0x80);
+	return p;
+}
+
+static void decode(const uint8_t * m, int len)
+// Decode a SPICMD_STREAM message the way the master would
+{
+	const uint8_t * p = m + 4, * end = m + len;
+	uint16_t first = m[1] | m[2] << 8;
+	int32_t err = 0;
+
+	frames++;
+	if (first != next)
+	    gaps++;
+	next = first + m[3];
+	for (uint8_t i = 0; i < m[3] && p < end; i++)
+	{
+	    uint32_t v, n = 1;
+	    uint8_t status = STREAM_OK;
+
+	    p = varint(p, &v);
+	    err += (int32_t)((v >> 1) >> 1) ^ -(int32_t)((v >> 1) & 1);
+	    if (v & 1)
+	    {
+		status = *p++;
+		p = varint(p, &n);
+		flagged++;
+	    }
+	    records++;
+	    if (status == STREAM_OK)
+	    {
+		secs += n;
+		phase += err;
+		longer += n != 1;
+	    }
+	}
+	if (p != end)
+	    gaps++;
+}
+
+static void drain(void)
+{
+	uint8_t frame[32];
+	int len;
+
+	while ((len = sim_spi_recv(frame, sizeof frame, 200)) >= 0)
+	{
+	    if (len >= 4 && frame[0] == SPICMD_STREAM)
+		decode(frame, len);
+	}
+}
+
+static void command(const uint8_t * msg, uint8_t n)
+{
+	sim_spi_send(msg, n);
+	spi_xeq();
+}
+
+int main()
+{
+	struct osc o = { .y0 = 445, .wpm = 3 };
+	static const uint8_t on[] = { SPICMD_SET, PARAM_STREAM, 16, 0, 0, 0 };
+	static const uint8_t off[] = { SPICMD_SET, PARAM_STREAM, 0, 0, 0, 0 };
+	char what[160];
+	double per;
+
+	sim_init(F_CPU);
+	spi_init();
+	pps_init(150000);
+	sei();
+	command(on, sizeof on);
+	check(stream_batch == 16, "stream turned on");
+
+	osc_init(&o);
+	for (uint16_t i = 0; i < 600; i++)
+	{
+	    osc_second(&o, i % 97 != 50);
+	    drain();
+	}
+	command(off, sizeof off);
+	drain();
+
+	snprintf(what, sizeof what, "%lu records in %lu frames (%lu sent), %lu with a status (%u glitches, %u outliers, %lu after a gap), %lu gaps",
+		(unsigned long)records, (unsigned long)frames, (unsigned long)stream_frames, (unsigned long)flagged,
+		pps_glitch, pps_outlier, (unsigned long)longer, (unsigned long)gaps);
+	check(records == stream_records && frames == stream_frames && !gaps
+		&& flagged == pps_glitch + pps_outlier + longer && longer >= 6, what);
+	snprintf(what, sizeof what, "good pulses add up to %lu s (%lu), phase %lld (%lld)",
+		(unsigned long)secs, (unsigned long)pps_secs, (long long)phase, (long long)pps_phase);
+	check(secs == pps_secs && phase == pps_phase, what);
+
+	per = (double)stream_bytes / stream_records;
+	snprintf(what, sizeof what, "%.2f bytes per sample on the wire, %.3f%% of a 25 kHz SPI clock",
+		per, per * 8 / 25000 * 100);
+	check(per < 2.5, what);
+
+	// Every buffer taken, so a batch cannot go
+	{
+	    struct spi_buf * held[SPIBUF_NUM];
+	    uint32_t sent = stream_records;
+	    uint16_t rec = stream_rec;
+	    int n = 0;
+
+	    while (n < SPIBUF_NUM && (held[n] = spi_getbuf()))
+		n++;
+	    stream_set(4);
+	    for (uint8_t i = 0; i < 4; i++)
+		stream_pps(0, 1, STREAM_OK);
+	    snprintf(what, sizeof what, "a batch with no buffer: %lu records counted, record number %u on to %u",
+		    (unsigned long)(stream_records - sent), rec, stream_rec);
+	    check(stream_records == sent && stream_rec == (uint16_t)(rec + 4), what);
+	}
+
+	return fail;
+}
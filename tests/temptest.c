@@ -0,0 +1,146 @@
+/*
+	This program is for Gnu LINUX, not AVR.
+	Build with: sh host/BUILD (from the top of the tree)
+
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+
+*/
+
+/*
+	Temperature compensation against the simulated oscillator, whose
+	frequency follows a temperature that swings every two hours and
+	every 25 minutes, read through a simulated thermistor on the ADC with
+	half an LSB of noise. The loop locks and learns the slope for six
+	hours, is measured while tracking for four more, then PPS stops for
+	two hours while the temperature climbs. The same run, with the same
+	noise, is made with the correction off and on, and the wander while
+	locked and the time error in holdover are compared.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "config.h"
+#include "sim.h"
+#include "osc.h"
+#include "time.h"
+#include "pps.h"
+#include "efc.h"
+#include "disc.h"
+#include "hold.h"
+#include "temp.h"
+
+#define ADC_MID 512			// Thermistor divider, ADC steps at 0 degrees
+#define ADC_DEG 20			// and per degree
+#define LEARN (6 * 3600)
+#define TRACK (4 * 3600)
+#define OUTAGE (2 * 3600)
+
+static int fail;
+static struct osc o;
+
+static void check(int ok, const char * what)
+{
+	printf("%s: %s\n", ok ? "ok  " : "FAIL", what);
+	if (!ok) fail = 1;
+}
+
+static uint16_t thermistor(uint8_t mux)
+{
+	double v = ADC_MID + ADC_DEG * o.temp + 0.5 * osc_gauss();
+
+	if (mux != TEMP_MUX) return 0;
+	return v < 0 ? 0 : v > 1023 ? 1023 : lround(v);
+}
+
+static double temperature(uint32_t t)
+// Degrees: swings, then a rise of 1.5 degrees an hour in the outage
+{
+	double d = 2 * sin(2 * M_PI * t / 7200) + 0.5 * sin(2 * M_PI * t / 1500);
+
+	if (t > LEARN + TRACK)
+	    d += 1.5 * (t - LEARN - TRACK) / 3600;
+	return d;
+}
+
+static void second(uint8_t pulse)
+{
+	o.temp = temperature(o.t + 1);
+	osc_second(&o, pulse);
+}
+
+static void run(uint8_t on, double * wander, double * te)
+{
+	double s = 0, s2 = 0, x0;
+	uint32_t i;
+
+	o = (struct osc){ .y0 = 0.4, .kv = DISC_KV, .aging = 1e-6, .rwfm = 2e-6, .wpm = 1, .tc = 0.01 };
+	sim_init(F_CPU);
+	sim_adc_hook = thermistor;
+	time_init();
+	pps_init(150000);
+	sei();
+	osc_seed(15);
+	osc_init(&o);
+	second(1);
+	disc_init(EFC_MID, 0);
+	temp_init();
+	temp_on = on;
+
+	for (i = 0; i < LEARN; i++)
+	    second(1);
+	for (i = 0; i < TRACK; i++)
+	{
+	    second(1);
+	    s += o.x;
+	    s2 += o.x * o.x;
+	}
+	*wander = sqrt(s2 / TRACK - (s / TRACK) * (s / TRACK));
+	x0 = o.x;
+	for (i = 0; i < OUTAGE; i++)
+	    second(0);
+	*te = o.x - x0;
+	second(1);
+}
+
+int main()
+{
+	double w[2], te[2], k, t;
+	char what[80];
+
+	for (uint8_t on = 0; on < 2; on++)
+	{
+	    run(on, &w[on], &te[on]);
+	    k = -o.tc / DISC_KV / (ADC_DEG << TEMP_OVS);
+	    printf("Correction %-3s: wander %5.1f cycles rms locked, holdover time error %6.1f cycles, "
+		"slope %.3f codes/step (true %.3f), %u updates, state %u\n",
+		on ? "on" : "off", w[on], te[on], temp_k, k, temp_n, disc_mode);
+	}
+
+	t = (ADC_MID + ADC_DEG * o.temp) * (1 << TEMP_OVS);
+	snprintf(what, sizeof what, "%d bit reading %u, thermistor %.1f", TEMP_BITS, temp_t, t);
+	check(fabs(temp_t - t) < 1 << TEMP_OVS, what);
+	check(temp_ok && fabs(temp_k - k) < 0.1 * fabs(k), "slope learned to 10%");
+	check(disc_mode == DISC_TRK || disc_mode == DISC_ACQ, "back from holdover");
+	check(w[1] < w[0] / 4, "locked wander a quarter");
+	check(fabs(te[1]) < fabs(te[0]) / 10, "holdover time error a tenth");
+
+	return fail;
+}
@@ -0,0 +1,175 @@
+/*
+	This program is for Gnu LINUX, not AVR.
+	Build with: sh host/BUILD (from the top of the tree)
+
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+
+*/
+
+/*
+	Compares the cost of a 10ms tick with 5, 32 and 128 periodic timers
+	running, using the timer wheel in time.c and the list scan it
+	replaced, which counted down every active timer on every tick. The
+	cost includes calling back and rescheduling the timers that expire.
+	A reference copy of the old scan is below; time.c is compiled in
+	here with a pool big enough for 128 timers.
+
+	Each timer has a different interval, and the number of expiries of
+	every timer is compared between the two so that a difference in
+	behaviour shows up as well as a difference in speed.
+*/
+
+#define TIMEBUF_NUM 128
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "sim.h"
+
+#include "time.c"
+
+#define TICKS 2000000
+
+static uint32_t expired[TIMEBUF_NUM];		// Expiries, timer wheel
+static uint32_t list_expired[TIMEBUF_NUM];	// Expiries, list scan
+
+static unsigned char count(struct tlist * tl)
+{
+	expired[tl->tl_ucontext]++;
+	return 0;
+}
+
+static unsigned char list_count(struct tlist * tl)
+{
+	list_expired[tl->tl_ucontext]++;
+	return 0;
+}
+
+// The old active list: every entry holds its own count of ticks to go
+static struct tlist list_bufs[TIMEBUF_NUM];
+static struct tlist * list_active;
+
+static void list_tick(void)
+// proc_timer() and the rescheduling half of time_xeq() as they were
+{
+	struct tlist *ptr;
+	struct tlist **pptr;
+	struct tlist *done = 0;
+
+	pptr = &list_active;
+	ptr = list_active;
+	while (ptr)
+	{
+	    if ((ptr->tl_ticks)--)
+	    {
+		pptr = &(ptr->tl_next);
+		ptr = ptr->tl_next;
+	    } else {
+		*pptr = ptr->tl_next;
+		ptr->tl_next = done;
+		done = ptr;
+		ptr = *pptr;
+	    };
+	};
+	while ((ptr = done))
+	{
+	    done = ptr->tl_next;
+	    ptr->tl_ufn(ptr);
+	    ptr->tl_ticks = ptr->tl_interval;
+	    ptr->tl_next = list_active;
+	    list_active = ptr;
+	};
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint8_t interval(uint8_t i)
+{
+	return 1 + (i * 37) % 200;
+}
+
+int main()
+{
+	static const uint8_t timers[] = {5, 32, 128};
+	int fail = 0;
+
+	printf("timers   list ns/tick   wheel ns/tick   expiries\n");
+	for (uint8_t t = 0; t < sizeof(timers); t++)
+	{
+	    uint8_t n = timers[t];
+	    double t0, t_list, t_wheel;
+
+	    // Old list scan
+	    list_active = 0;
+	    for (uint8_t i = 0; i < n; i++)
+	    {
+		list_bufs[i].tl_ticks = list_bufs[i].tl_interval = interval(i);
+		list_bufs[i].tl_ucontext = i;
+		list_bufs[i].tl_ufn = list_count;
+		list_bufs[i].tl_next = list_active;
+		list_active = &list_bufs[i];
+		list_expired[i] = 0;
+	    }
+	    t0 = now();
+	    for (uint32_t k = 0; k < TICKS; k++)
+		list_tick();
+	    t_list = now() - t0;
+
+	    // Timer wheel
+	    sim_init(F_CPU);
+	    time_init();
+	    TCCR0 = 0;
+	    sei();
+	    for (uint8_t i = 0; i < n; i++)
+	    {
+		expired[i] = 0;
+		time_set(count, interval(i), i, 0, 1);
+	    }
+	    t0 = now();
+	    for (uint32_t k = 0; k < TICKS; k++)
+	    {
+		std_timer = 1;
+		proc_timer();
+		time_xeq();
+	    }
+	    t_wheel = now() - t0;
+
+	    uint32_t total = 0;
+	    for (uint8_t i = 0; i < n; i++)
+	    {
+		total += expired[i];
+		if (expired[i] != list_expired[i])
+		{
+		    printf("timer %u: %lu expiries, list scan had %lu\n", i,
+			(unsigned long)expired[i], (unsigned long)list_expired[i]);
+		    fail = 1;
+		}
+	    }
+	    printf("%6u %14.1f %15.1f %10lu\n", n, t_list * 1e9 / TICKS,
+		t_wheel * 1e9 / TICKS, (unsigned long)total);
+	}
+	return fail;
+}
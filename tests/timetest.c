@@ -0,0 +1,120 @@
+/*
+	This program is for Gnu LINUX, not AVR.
+	Build with: sh host/BUILD (from the top of the tree)
+
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+
+*/
+
+/*
+	Checks the timer service against the simulated Timer0:
+
+	- a 1 second periodic timer keeps time to within one prescale
+	  count over a simulated day,
+	- in tickless mode Timer0 interrupts far less often than every
+	  10ms while the only timer is a second away,
+	- a short timer set while the scheduler is asleep still expires
+	  on the right tick.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "config.h"
+#include "sim.h"
+#include "time.h"
+
+#define DAY 86400L
+#define TICK (F_CPU / 100)
+
+static uint64_t first;			// Cycle of first 1 second expiry
+static uint32_t seconds;		// Expiries of the 1 second timer
+static int64_t worst;			// Largest error seen, cycles
+static uint64_t short_set;		// When the short timer was set
+static int64_t short_err;		// Error of short timer expiry
+static uint32_t shorts;
+
+static int fail;
+
+static unsigned char short_timer(struct tlist * tl)
+{
+	short_err = (int64_t)(sim_cycles - short_set) - 3 * TICK;
+	shorts++;
+	return 1;
+}
+
+static unsigned char second(struct tlist * tl)
+{
+	int64_t err;
+
+	if (!seconds++)
+	{
+	    first = sim_cycles;
+	}
+	err = (int64_t)(sim_cycles - first) - (int64_t)(seconds - 1) * F_CPU;
+	if (llabs(err) > llabs(worst))
+	{
+	    worst = err;
+	}
+
+	// Once a minute, set a timer that expires on the third tick
+	if (seconds % 60 == 0)
+	{
+	    short_set = sim_cycles;
+	    time_set(short_timer, 2, 0, 0, 0);
+	}
+	return 0;
+}
+
+static void background(void)
+{
+	proc_timer();
+	time_xeq();
+}
+
+static void check(int ok, const char * what)
+{
+	printf("%s: %s\n", ok ? "ok  " : "FAIL", what);
+	if (!ok) fail = 1;
+}
+
+int main()
+{
+	struct sim_rates rate = {0};
+
+	sim_init(F_CPU);
+	time_init();
+	sei();
+	time_set(second, 99, 0, 0, 1);
+	sim_run(&rate, (uint64_t)F_CPU * DAY, background);
+
+	printf("%lu expiries, worst error %lld cycles, %lu Timer0 interrupts\n",
+		(unsigned long)seconds, (long long)worst,
+		(unsigned long)sim_count[SIM_TIMER0_COMP]);
+	check(seconds >= DAY - 1 && seconds <= DAY, "1 second timer count over a day");
+	check(llabs(worst) <= 1024, "1 second timer error within one prescale count");
+	check(shorts == DAY / 60 - (short_set + 3 * TICK > sim_cycles),
+		"short timers set while asleep all expired");
+	check(llabs(short_err) <= 1024, "short timer expired on the third tick");
+#if TIME_TICKLESS
+	check(sim_count[SIM_TIMER0_COMP] < DAY * 25, "tickless: fewer than 25 interrupts/second");
+#endif
+	return fail;
+}
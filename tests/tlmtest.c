@@ -0,0 +1,146 @@
+/*
+	This program is for Gnu LINUX, not AVR.
+	Build with: sh host/BUILD (from the top of the tree)
+
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+
+*/
+
+/*
+	Latest-value telemetry and the overwrite-oldest event queue. More
+	event messages are queued than there are buffers with nobody reading:
+	the master must then get the one already going and the latest, with
+	the rest counted as dropped and the gap in the sequence numbers
+	showing it. After 100 seconds of pulses with nobody reading, the
+	telemetry the master asks for must be that second's, with the copy
+	behind it the update before. A reply waiting to go must not be
+	overwritten by the events queued after it.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "config.h"
+#include "sim.h"
+#include "osc.h"
+#include "spi.h"
+#include "pps.h"
+#include "efc.h"
+#include "event.h"
+#include "tlm.h"
+
+static int fail;
+
+static void check(int ok, const char * what)
+{
+	printf("%s: %s\n", ok ? "ok  " : "FAIL", what);
+	if (!ok) fail = 1;
+}
+
+int main()
+{
+	struct osc o = { .y0 = 445, .wpm = 3 };
+	static const uint8_t cmd[] = { SPICMD_TLM };
+	uint8_t frame[32];
+	uint8_t seqs[8], ids[8];
+	int len, n = 0;
+	char what[256];
+
+	sim_init(F_CPU);
+	spi_init();
+	pps_init(150000);
+	sei();
+
+	// Ten events, nobody reading
+	for (uint8_t i = 0; i < 10; i++)
+	{
+	    struct spi_buf * buf = spi_evbuf();
+
+	    *(buf->ptr++) = SPICMD_HOLD;
+	    *(buf->ptr++) = i;
+	    spi_tx_queue(buf);
+	}
+	while (n < 8 && (len = sim_spi_recv(frame, sizeof frame, 200)) >= 0)
+	{
+	    seqs[n] = sim_spi_seq;
+	    ids[n++] = frame[1];
+	}
+	// (one buffer is kept to receive)
+	snprintf(what, sizeof what, "10 events into %d buffers: read %d, %u, %u (seq %u, %u, %u), %u dropped",
+		SPIBUF_NUM - 1, ids[0], ids[1], ids[2], seqs[0], seqs[1], seqs[2], spi_dropped);
+	check(n == SPIBUF_NUM - 1 && spi_dropped == 11 - SPIBUF_NUM && ids[0] == 0 && seqs[0] == 0
+		&& ids[1] == 12 - SPIBUF_NUM && seqs[1] == 12 - SPIBUF_NUM && ids[n - 1] == 9, what);
+
+	// 100 seconds, nobody reading, then ask
+	osc_init(&o);
+	for (uint8_t i = 0; i < 100; i++)
+	    osc_second(&o, 1);
+	sim_spi_send(cmd, sizeof cmd);
+	spi_xeq();
+	while ((len = sim_spi_recv(frame, sizeof frame, 200)) >= 0 && frame[0] != SPICMD_TLM)
+	    ;
+	{
+	    uint32_t secs = frame[3] | frame[4] << 8 | frame[5] << 16 | (uint32_t)frame[6] << 24;
+	    int32_t phase = frame[7] | frame[8] << 8 | frame[9] << 16 | (uint32_t)frame[10] << 24;
+	    int32_t med = frame[11] | frame[12] << 8 | frame[13] << 16 | (uint32_t)frame[14] << 24;
+	    uint16_t efc = frame[15] | frame[16] << 8;
+	    uint16_t drops = frame[19] | frame[20] << 8;
+
+	    snprintf(what, sizeof what, "telemetry after 100 s: second %lu (%lu), phase %ld (%lld), median %ld, EFC %u, %u dropped (%u)",
+		    (unsigned long)secs, (unsigned long)pps_secs, (long)phase, (long long)pps_phase, (long)med, efc, drops, spi_dropped);
+	    check(len == 21 && secs == pps_secs && phase == (int32_t)pps_phase && med == pps_med
+		    && efc == efc_get() && drops == spi_dropped && frame[1] == tlm[tlm_cur].n, what);
+	}
+	check(tlm[!tlm_cur].secs < tlm[tlm_cur].secs && tlm[!tlm_cur].n == (uint8_t)(tlm[tlm_cur].n - 1),
+		"the copy behind is the update before");
+
+	// An event going out, a query answered behind it, then ten more events
+	{
+	    uint16_t dropped = spi_dropped;
+	    int tlms = 0;
+
+	    for (uint8_t i = 0; i < 11; i++)
+	    {
+		struct spi_buf * buf;
+
+		if (i == 1)
+		{
+		    sim_spi_send(cmd, sizeof cmd);
+		    spi_xeq();
+		};
+		buf = spi_evbuf();
+		*(buf->ptr++) = SPICMD_HOLD;
+		*(buf->ptr++) = i;
+		spi_tx_queue(buf);
+	    }
+	    n = 0;
+	    while (n < 8 && (len = sim_spi_recv(frame, sizeof frame, 200)) >= 0)
+	    {
+		tlms += frame[0] == SPICMD_TLM;
+		ids[n++] = frame[0] == SPICMD_HOLD ? frame[1] : 0xFF;
+	    }
+	    snprintf(what, sizeof what, "a reply queued among 11 events is kept: %d frames, %d replies, last event %u, %u dropped",
+		    n, tlms, ids[n - 1], spi_dropped - dropped);
+	    check(n == SPIBUF_NUM - 1 && tlms == 1 && ids[n - 1] == 10
+		    && spi_dropped - dropped == 13 - SPIBUF_NUM, what);
+	}
+
+	return fail;
+}
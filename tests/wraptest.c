@@ -0,0 +1,90 @@
+/*
+	This program is for Gnu LINUX, not AVR.
+	Build with: sh host/BUILD (from the top of the tree)
+
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+
+*/
+
+/*
+	Sweeps PPS captures across every cycle of a window around the Timer 1
+	wrap, with the capture ISR held off for a range of latencies (as it
+	would be by another ISR or a cli() section). The TIMER1_CAPT ISR runs
+	before TIMER1_OVF when both are pending, so this is where the
+	overflow count used to come out 65536 short. Each timestamp posted to
+	the event ring must equal the simulated cycle count at the edge.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "sim.h"
+#include "pps.h"
+#include "event.h"
+
+#define WINDOW 1024			// Cycles either side of the wrap
+
+extern struct event event_ring[EVENT_NUM];
+
+int main()
+{
+	static const uint16_t latency[] = {0, 1, 2, 50, 500, 5000};
+	uint32_t bad = 0;
+	uint32_t runs = 0;
+
+	for (uint8_t l = 0; l < sizeof(latency) / sizeof(latency[0]); l++)
+	{
+	    for (int32_t d = -WINDOW; d <= WINDOW; d++)
+	    {
+		struct event * ev;
+		uint64_t edge;
+		uint64_t ts;
+
+		sim_init(F_CPU);
+		pps_init(150000);
+		sei();
+
+		// Three wraps in, then interrupts off just before the next
+		sim_advance(4 * 0x10000 - WINDOW - 1);
+		cli();
+		sim_advance(WINDOW + 1 + d);
+		edge = sim_cycles;
+		sim_capture();
+		sim_advance(latency[l]);
+		sei();
+		sim_dispatch();
+
+		ev = &event_ring[event_tail & (EVENT_NUM - 1)];
+		ts = ((uint64_t)ev->ev_context << 32) | ev->ev_data.longs;
+		if ((uint8_t)(event_head - event_tail) != 1 || ts != edge)
+		{
+		    if (bad++ < 10)
+			printf("latency %u, edge %+ld: timestamp %llu, expected %llu\n",
+			    latency[l], (long)d, (unsigned long long)ts,
+			    (unsigned long long)edge);
+		}
+		event_tail = event_head;
+		runs++;
+	    }
+	}
+	printf("%s: %lu captures around the Timer 1 wrap, %lu wrong\n",
+		bad ? "FAIL" : "ok  ", (unsigned long)runs, (unsigned long)bad);
+	return bad != 0;
+}
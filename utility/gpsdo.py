@@ -19,116 +19,553 @@
 """
 
 
-import spidev
+import sys
 import time
 import struct
 from collections import deque
 
 
+# Control codes
+NUL = 0			# This is the idle character in both directions
+END = 0xC0
+ESC = 0xDB
+ESC_END = 0xDC
+ESC_ESC = 0xDD
+
+SPICMD_RESEND = 7
+SPICMD_STREAM = 15
+STREAM_STATUS = {0: 'ok', 1: 'glitch', 2: 'outlier', 3: 'trim'}
+
+# The MCU's data ready output (PB3, see spi.c), if wired to a GPIO input
+DRDY_CHIP = '/dev/gpiochip0'
+DRDY_LINE = 25
+
+
+# Capture files (Capture, read_capture()): CAPTURE_MAGIC, then records of
+# a kind byte and, for CAPTURE_MISO and CAPTURE_MOSI, the microseconds
+# since the record before and the length as varints, then the bytes; for
+# CAPTURE_MARK the host time in microseconds since the epoch (8 bytes).
+# Each run starts with a mark and only appends, so a capture can be left
+# running for weeks and a crash costs at most the last record.
+CAPTURE_MAGIC = b'GPSDOCAP\x01'
+CAPTURE_MISO = 0
+CAPTURE_MOSI = 1
+CAPTURE_MARK = 2
+
+
+def crc16(data, crc=0xFFFF):
+    # The CRC-CCITT of avr-libc's _crc_ccitt_update(), as the MCU uses it
+    for b in data:
+        b ^= crc & 0xFF
+        b = (b ^ (b << 4)) & 0xFF
+        crc = (((b << 8) | (crc >> 8)) ^ (b >> 4) ^ (b << 3)) & 0xFFFF
+    return crc
+
+
+class GpioLine():
+    # A data ready line read through the GPIO character device (libgpiod
+    # 2.x Python bindings), waiting for rising edges
+    def __init__(self, chip, offset):
+        import gpiod
+        from gpiod.line import Edge, Value
+        self.offset = offset
+        self.active = Value.ACTIVE
+        self.req = gpiod.request_lines(chip, consumer='gpsdo',
+                                       config={offset: gpiod.LineSettings(edge_detection=Edge.RISING)})
+
+    def value(self):
+        return self.req.get_value(self.offset) == self.active
+
+    def wait(self, timeout):
+        # True once the line is high, waiting up to timeout seconds for it
+        if self.value():
+            return True
+        if self.req.wait_edge_events(timeout):
+            self.req.read_edge_events()
+        return self.value()
+
+    def close(self):
+        self.req.release()
+
+
+class MockLine():
+    # Stands in for GpioLine in tests: the line is whatever level() says,
+    # e.g. whether a simulated MCU has bytes waiting
+    def __init__(self, level):
+        self.level = level
+        self.waits = 0
+
+    def value(self):
+        return bool(self.level())
+
+    def wait(self, timeout):
+        self.waits += 1
+        return self.value()
+
+
+class Idle():
+    # A bus with nothing on it, to use spiman's framing on its own
+    def xfer(self, data):
+        return [NUL] * len(data)
+
+    def close(self):
+        pass
+
+
+def get_varint(data, i):
+    # The varint at data[i], and the index after it
+    v = shift = 0
+    while True:
+        v |= (data[i] & 0x7F) << shift
+        shift += 7
+        i += 1
+        if not data[i - 1] & 0x80:
+            return v, i
+
+
+def put_varint(v):
+    out = bytearray()
+    while v >= 0x80:
+        out.append(v & 0x7F | 0x80)
+        v >>= 7
+    out.append(v)
+    return bytes(out)
+
+
+class Capture():
+    # Wraps the SPI device, appending both directions of every transfer,
+    # with the host time, to a capture file for utility/replay.py
+    def __init__(self, spi, path):
+        self.spi = spi
+        self.f = open(path, 'ab')
+        if self.f.tell() == 0:
+            self.f.write(CAPTURE_MAGIC)
+        self.f.write(bytes([CAPTURE_MARK]) + struct.pack('<Q', time.time_ns() // 1000))
+        self.t = time.monotonic_ns() // 1000
+
+    def record(self, kind, data):
+        now = time.monotonic_ns() // 1000
+        self.f.write(bytes([kind]) + put_varint(now - self.t) + put_varint(len(data)) + bytes(data))
+        self.t = now
+
+    def xfer(self, data):
+        self.record(CAPTURE_MOSI, data)
+        resp = self.spi.xfer(data)
+        self.record(CAPTURE_MISO, resp)
+        self.f.flush()
+        return resp
+
+    def close(self):
+        self.f.close()
+        self.spi.close()
+
+
+def read_capture(f):
+    # (kind, host time in microseconds, bytes) for each record in an open
+    # capture file, stopping at a record cut short
+    data = f.read()
+    if not data.startswith(CAPTURE_MAGIC):
+        raise ValueError("not a capture file")
+    i, t = len(CAPTURE_MAGIC), 0
+    try:
+        while i < len(data):
+            kind = data[i]
+            if kind == CAPTURE_MARK:
+                if i + 9 > len(data):
+                    return
+                t = struct.unpack_from('<Q', data, i + 1)[0]
+                i += 9
+                yield kind, t, b''
+                continue
+            dt, i = get_varint(data, i + 1)
+            n, i = get_varint(data, i)
+            if i + n > len(data):
+                return
+            t += dt
+            yield kind, t, data[i:i + n]
+            i += n
+    except IndexError:
+        return
+
+
+def native_deframer():
+    # host/slip.c through utility/slip.py, or None to deframe here
+    try:
+        import slip
+        return slip.Deframer()
+    except (ImportError, OSError, AttributeError):
+        return None
+
+
+def drdy_line():
+    # The data ready line, or None to poll if there is no such GPIO
+    try:
+        return GpioLine(DRDY_CHIP, DRDY_LINE)
+    except (ImportError, OSError):
+        return None
+
+
 class spiman():
-    def __init__(self, speed=10000):
-        self.spi = spidev.SpiDev(0,0)
-        self.spi.open(0,0)
-        self.spi.max_speed_hz = speed
-        self.spi.mode = 0
-        self.fragment = bytes()
-        self.resync = False
+    # Frames, both ways, are: len seq type data... crc_lo crc_hi, SLIP
+    # escaped and ended by END (see spi.c). A frame that fails its CRC is
+    # dropped on its own, and a gap in the MCU's sequence numbers is asked
+    # for again.
+    RESEND_MAX = 16     # Frames a gap is waited for; larger gaps are taken as the MCU restarting
+
+    def __init__(self, speed=10000, spi=None, drdy=None, native=None):
+        if spi is None:
+            import spidev
+            spi = spidev.SpiDev(0,0)
+            spi.open(0,0)
+            spi.max_speed_hz = speed
+            spi.mode = 0
+        self.spi = spi
+        self.drdy = drdy        # Data ready line, or None to poll
+        self.native = native    # Native deframer, or None
+        self.clocked = 0        # Bytes clocked
+        self.frame = bytearray()
+        self.esc = False
+        self.bad = False
+        self.seq = None         # Last sequence number from the MCU
+        self.txseq = 0
+        self.missing = set()
+        self.stray = None       # Last sequence number too far behind to place
+        self.requests = deque()
+        self.answers = {}       # Command replies, by request ID
+        self.wire = 0           # Bytes on the wire of the frame being read
+        self.last_wire = 0
+        self.stream_rec = None  # Next capture record number expected
+        self.stream_n = 0       # Capture records, and the bytes they took
+        self.stream_bytes = 0
+        self.crcerr = 0
+        self.lost = 0
+        self.frames = 0         # Good frames received
 
     def __del__(self):
         self.spi.close()
 
-    def strip(self, resp):
-        if not resp:
-            return bytes()
-        i = 0
-        while resp[i] == 0:
-            i += 1
-            if i >= len(resp): break
-        return resp[i:]
+    def encode(self, msg):
+        body = bytes([len(msg), self.txseq]) + msg
+        self.txseq = (self.txseq + 1) & 0xFF
+        crc = crc16(body)
+        body += bytes([crc & 0xFF, crc >> 8])
+        return body.replace(bytes([ESC]), bytes([ESC, ESC_ESC])).replace(bytes([END]), bytes([ESC, ESC_END])) + bytes([END])
 
-    def transfer(self, msg=None):
-        # Send message, or if none, send idle characters to receive messages
-        if  msg:
-            msg.replace(bytes([ESC]), bytes([ESC, ESC_ESC]))
-            msg.replace(bytes([END]), bytes([ESC, ESC_END]))
+    def deframe(self, b):
+        # Returns a good frame (unescaped, without its END) when one ends
+        if b == END:
+            self.last_wire, self.wire = self.wire + 1, 0
+            frame, bad = bytes(self.frame), self.bad
+            self.frame = bytearray()
+            self.esc = self.bad = False
+            if not frame:
+                return None
+            if bad or len(frame) < 5 or frame[0] != len(frame) - 4 \
+                    or crc16(frame[:-2]) != frame[-2] | frame[-1] << 8:
+                self.crcerr += 1
+                print(f"Bad frame dropped: {list(frame)}")
+                return None
+            return frame
+        if not self.frame and not self.esc and b == NUL:
+            return None
+        self.wire += 1
+        if self.esc:
+            self.esc = False
+            if b not in (ESC_END, ESC_ESC):
+                self.bad = True
+            self.frame.append(END if b == ESC_END else ESC)
+        elif b == ESC:
+            self.esc = True
         else:
-            msg = bytes(32 * (0x00,))
-        resp = bytes(self.spi.xfer(msg))
-        resplen = len(resp)
-        fullresp = resp
-
-        if self.resync:
-            resp = self.strip(resp)
-            if not resp:
+            self.frame.append(b)
+        return None
+
+    def sequence(self, seq):
+        # Note gaps, and ask for what is missing. Returns False for a
+        # frame already seen, or too far behind to place. Missing frames
+        # are only waited for over the next RESEND_MAX, so that none is
+        # still wanted when the sequence number comes round again. Two
+        # frames in a row from too far behind mean the MCU restarted.
+        if self.seq is None:
+            self.seq = seq
+            return True
+        ahead = (seq - self.seq) & 0xFF
+        if ahead == 0 or ahead >= 0x80:
+            if seq in self.missing:
+                self.missing.discard(seq)
                 return True
-            i = 0
-            while resp[i] != END:
-                i += 1
-                if i >= len(resp): return True
-            resp = resp[i+1:]
-            self.resync = False
-            if not resp: return True
-
-
-        # If we're mid-message, add the response to what we have so fare
-        if self.fragment:
-            resp = self.fragment + resp
-            self.fragment = bytes()
-        # Otherwise the next non-null byte shoudl be the beginning of a message
+            if 0x100 - ahead <= self.RESEND_MAX or ahead == 0:
+                return False
+            if self.stray is None or seq != (self.stray + 1) & 0xFF:
+                self.stray = seq
+                return False
+            ahead = 1
+            self.missing.clear()
+        if ahead <= self.RESEND_MAX:
+            for k in range(1, ahead):
+                s = (self.seq + k) & 0xFF
+                self.missing.add(s)
+                self.requests.append(bytes([SPICMD_RESEND, s]))
+        self.seq = seq
+        self.stray = None
+        self.missing = {s for s in self.missing if (seq - s) & 0xFF <= self.RESEND_MAX}
+        return True
+
+    def stream(self, msg):
+        # Capture records (see stream.c): each the difference from the
+        # last, zigzag coded, low bit set if a status and seconds follow
+        first, count = msg[1] | msg[2] << 8, msg[3]
+        if self.stream_rec is not None and first != self.stream_rec:
+            print(f"Capture records {self.stream_rec} to {first - 1} lost")
+        self.stream_rec = (first + count) & 0xFFFF
+        err, i, recs = 0, 4, []
+        for k in range(count):
+            v, i = get_varint(msg, i)
+            z = v >> 1
+            err += (z >> 1) ^ -(z & 1)
+            status, n = 0, 1
+            if v & 1:
+                status = msg[i]
+                n, i = get_varint(msg, i + 1)
+            recs.append(f"{err}" + ("" if not v & 1 else f"({STREAM_STATUS.get(status, status)}, {n}s)"))
+        self.stream_n += count
+        self.stream_bytes += self.last_wire
+        print(f"Records {first}-{first + count - 1}: " + " ".join(recs)
+              + f"  [{self.stream_bytes / self.stream_n:.2f} bytes per sample]")
+
+    def dispatch(self, seq, msg):
+        self.frames += 1
+        if not self.sequence(seq):
+            return
+        if msg[0] == SPICMD_RESEND:
+            self.missing.discard(msg[1])
+            self.lost += 1
+            print(f"Frame {msg[1]} lost")
+            return
+        if msg[0] == SPICMD_STREAM and len(msg) >= 4:
+            self.stream(msg)
+            return
+        if msg[0] in replies and len(msg) >= 3:
+            # Command reply: type, request ID, status, ...
+            self.answers[msg[1]] = msg
+            print(f"Request {msg[1]}: {replies[msg[0]](msg[2], msg[3:])}")
+            return
+        cmd = cmds.get(msg[0], None)
+        if cmd and len(msg) == struct.calcsize(cmd['decoder']):
+            cmd['fn'](*struct.unpack(cmd['decoder'], msg))
         else:
-            resp = self.strip(resp)
+            print(f"Unknown message: {list(msg)}")
 
-        resp.replace(bytes([ESC, ESC_ESC]), bytes([ESC]))
-        resp.replace(bytes([ESC, ESC_END]), bytes([END]))
-        
-        if resp:
-            # Look up message type byte
-            cmd = cmds.get(int(resp[0]), None)
-            if cmd:
-                if len(resp) < cmd['len']:
-                    self.fragment = resp
-                    return True
-
-                l = cmd['len']
-                if resp[l-1] == END:
-                    r = resp[:l]
-                    resp = self.strip(resp[l:])
-                    cmd['fn'](*struct.unpack("<BIBiB", r))
-                    self.fragment = resp
-                    return len(resp) > 0
-
-            print(f"Resynchronizing - resp: {list(resp)}, frag: {list(self.fragment)}, len={resplen}")
-            print(fullresp)
-            self.fragment = bytes()
-            self.resync = True
+    def poll(self, timeout):
+        # Wait up to timeout seconds for the MCU to have something, and
+        # read it, with the data ready line; or else clock idle bytes
+        # until nothing comes
+        if self.drdy:
+            if self.drdy.wait(timeout):
+                self.read_ready()
+            while self.requests:
+                self.transfer()
+        else:
+            while self.transfer():
+                pass
+            time.sleep(timeout)
+
+    def request(self, msg):
+        # Send a command (see cmd.c). Returns its request ID, which is the
+        # sequence number of the frame it goes in; the reply carries it.
+        req = self.txseq
+        self.transfer(msg)
+        return req
+
+    def transfer(self, msg=None):
+        # Send message, or a resend request, or if none, send idle
+        # characters to receive messages. Returns True if anything came.
+        if not msg and self.requests:
+            msg = self.requests.popleft()
+        out = self.encode(msg) if msg else bytes(32 * (NUL,))
+        resp = bytes(self.spi.xfer(list(out)))
+        self.clocked += len(out)
+        self.feed(resp)
+        return any(resp) or bool(self.requests)
+
+    def feed(self, resp):
+        if self.native:
+            bad = self.native.bad
+            for seq, msg, wire in self.native.feed(resp):
+                self.last_wire = wire
+                self.dispatch(seq, msg)
+            self.crcerr += self.native.bad - bad
+            return
+        for b in resp:
+            frame = self.deframe(b)
+            if frame:
+                self.dispatch(frame[1], frame[2:-2])
+
+    def partial(self):
+        # The first byte and length of a frame begun but not ended
+        if self.native:
+            return self.native.partial()
+        return (self.frame[0] if self.frame else None), len(self.frame)
+
+    def clock(self, n):
+        # Clock n idle bytes in, returning them
+        resp = bytes(self.spi.xfer([NUL] * n))
+        self.clocked += n
+        self.feed(resp)
+        return resp
+
+    def read_ready(self):
+        # Read while the data ready line is high, each read sized from
+        # the frame's length byte: len + 4 more bytes to its END, and one
+        # more for each ESC among them. After an idle spell the MCU's
+        # first byte is a NUL.
+        while self.drdy.value():
+            first, have = self.partial()
+            if not have:
+                b = self.clock(1)[0]
+                if b == NUL:
+                    b = self.clock(1)[0]
+                if b == NUL:
+                    break
+                first, have = self.partial()
+                if not have:
+                    continue
+            need = max(first + 5 - have, 1)
+            while need:
+                need = self.clock(need).count(ESC)
         
 
+# cmds structure defines the available message types
+cmds = {1: {'name': 'Oscillator Interval',
+            'decoder': '<BIHi',
+            'fn': lambda cmd, fcpu, interval, variance: \
+                      print(f"F_CPU: {fcpu}, Interval {interval}, Variance: {variance}"),
+           },
+        2: {'name': 'Allan Deviation',
+            'decoder': '<BBHII',
+            'fn': lambda cmd, tau, n, adev, mdev: \
+                      print(f"Tau: {1 << tau:4d}s, N: {n:5d}, ADEV: {adev * 1e-12:.3e}, MDEV: {mdev * 1e-12:.3e}"),
+           },
+        3: {'name': 'Holdover',
+            'decoder': '<BBBIii',
+            'fn': lambda cmd, on, points, secs, est, meas: \
+                      print(f"Holdover {'for' if on else 'ended after'} {secs}s, {points} points, "
+                            f"time error estimated {est}" + ("" if on else f", measured {meas}") + " cycles"),
+           },
+        4: {'name': 'Kalman Filter',
+            'decoder': '<Bbbbbiii',
+            'fn': lambda cmd, r, q0, q1, q2, phase, freq, drift: \
+                      print(f"Kalman R: 2^{r/2:g}, Q: 2^{q0/2:g} 2^{q1/2:g} 2^{q2/2:g}, "
+                            f"phase {phase / 256:.2f}, frequency {freq / 65536:.5f}, drift {drift / 2**32:.3e}"),
+           },
+        5: {'name': 'Lock State',
+            'decoder': '<BBBIIIHH',
+            'fn': lambda cmd, state, merit, since, now, locked, changes, rms: \
+                      print(f"State: {STATES.get(state, state)} for {now - since}s, merit {merit}, "
+                            f"rms phase {rms}, " + (f"locked at {locked}s" if locked else "not yet locked")
+                            + f", {changes} changes"),
+           },
+        6: {'name': 'Temperature',
+            'decoder': '<BBBHHihH',
+            'fn': lambda cmd, on, ok, reading, mean, slope, ff, n: \
+                      print(f"Temperature {reading} (mean {mean}), slope {slope / 65536:.4f} codes/step "
+                            + ("" if ok else "(not yet) ") + f"from {n} updates, correction "
+                            + (f"{ff} codes" if on else "off")),
+           },
+        8: {'name': 'Telemetry',
+            'decoder': '<BBBIiiHHH',
+            'fn': lambda cmd, n, state, secs, phase, med, efc, temp, drops: \
+                      print(f"{secs}s: {STATES.get(state, state)}, phase {phase}, {med} cycles/s, "
+                            f"EFC {efc}, temperature {temp}, {drops} reports dropped"),
+           },
+        }
+
+
+# Replies to the commands in cmd.c, given their status and the rest
+PARAMS = {1: 'pps_tol', 2: 'rlog', 3: 'tau_coarse', 4: 'tau_acq', 5: 'tau_trk',
+          6: 'zeta_milli', 7: 'kd', 8: 'temp_on', 9: 'cpu_hz', 10: 'stream'}
+STATS = {0: ('pps', '<IHHHHH', 'seconds missed glitches resyncs outliers reacquisitions'),
+         1: ('spi', '<HHB', 'bad_frames dropped next_seq'),
+         2: ('loop', '<BHIHI', 'state changes locked_at holdovers kalman_updates'),
+         3: ('stream', '<III', 'records frames bytes'),
+         4: ('event', '<HB', 'lost peak')}
+CMD_STATUS = {0: 'ok', 1: 'no such id', 2: 'out of range', 3: 'read only', 4: 'bad length', 5: 'unknown command'}
+
+def param_reply(status, data):
+    name = PARAMS.get(data[0], data[0]) if data else '?'
+    value = struct.unpack('<i', data[1:5])[0] if len(data) >= 5 else None
+    return f"{name} = {value}" + ("" if status == 0 else f" ({CMD_STATUS.get(status, status)})")
+
+def stats_reply(status, data):
+    if status or not data or data[0] not in STATS:
+        return f"statistics: {CMD_STATUS.get(status, status)}"
+    name, fmt, fields = STATS[data[0]]
+    return f"{name} " + ", ".join(f"{f} {v}" for f, v in zip(fields.split(), struct.unpack(fmt, data[1:])))
+
+def version_reply(status, data):
+    major, minor, caps, dlen, hz = struct.unpack('<BBHBI', data)
+    names = [n for b, n in ((1, 'kalman'), (2, 'temp'), (4, 'rc'), (8, 'tickless'), (16, 'cpu_measure')) if caps & b]
+    return f"version {major}.{minor}, {hz} Hz, messages to {dlen} bytes, " + (" ".join(names) or "no options")
+
+replies = {9: param_reply,
+           10: param_reply,
+           11: stats_reply,
+           12: lambda status, data: f"counters reset ({CMD_STATUS.get(status, status)})",
+           13: version_reply,
+           14: lambda status, data: f"{CMD_STATUS.get(status, status)}: type {data[0] if data else '?'}",
+           }
+
+STATES = {0: 'off', 1: 'warm up', 2: 'coarse acquire', 3: 'fine acquire', 4: 'locked', 5: 'holdover'}
+
+
 if __name__ == '__main__':
-    # cmds structure defines the available message types
-    cmds = {1: {'name': 'Oscillator Interval',
-                'decoder': '<BIBiB',
-                'len': 11,
-                'fn': lambda cmd, fcpu, interval, variance, end: \
-                          print(f"F_CPU: {fcpu}, Interval {interval}, Variance: {variance}"),
-               },
-            }
+    spi = spiman(10000, drdy=drdy_line(), native=native_deframer())
 
+    # Ask for the Allan deviation every ADEV_QUERY seconds
+    ADEV_QUERY = 600
+    SPICMD_ADEV = 2
+    last_query = time.time()
 
-    # Control codes
-    NUL = 0			# This is the idle character in both directions
-    END = 0xC0
-    ESC = 0xDB
-    ESC_END = 0xDC
-    ESC_ESC = 0xDD
+    # And the telemetry every TLM_QUERY seconds
+    TLM_QUERY = 10
+    SPICMD_TLM = 8
+    last_tlm = time.time()
 
+    # Or, with arguments, send one command and print the reply:
+    #   gpsdo.py get|set <id> [value] | stats <block> | reset | version
+    # ("gpsdo.py set 10 16" streams every pulse, 16 to a frame; run it
+    # again without arguments to print them)
+    COMMANDS = {'get': 9, 'set': 10, 'stats': 11, 'reset': 12, 'version': 13}
 
-    spi = spiman(10000)
+    # "--capture file" first appends everything on the bus to the file
+    if sys.argv[1:2] == ['--capture']:
+        spi.spi = Capture(spi.spi, sys.argv[2])
+        del sys.argv[1:3]
+    if len(sys.argv) > 1:
+        args = sys.argv[1:]
+        msg = bytes([COMMANDS[args[0]]])
+        if args[0] in ('get', 'set', 'stats'):
+            msg += bytes([int(args[1])])
+        if args[0] == 'set':
+            msg += struct.pack('<i', int(args[2]))
+        req = spi.request(msg)
+        for tries in range(50):
+            if req in spi.answers:
+                break
+            spi.poll(0.1)
+        else:
+            print(f"No reply to request {req}")
+        sys.exit(0)
 
     try:
         while True:
-            while spi.transfer():
-                pass
-            time.sleep(1)
+            spi.poll(1)
+            if time.time() - last_query >= ADEV_QUERY:
+                spi.transfer(bytes([SPICMD_ADEV]))
+                last_query = time.time()
+            if time.time() - last_tlm >= TLM_QUERY:
+                spi.transfer(bytes([SPICMD_TLM]))
+                last_tlm = time.time()
 
     except KeyboardInterrupt:
         # Ctrl+C pressed, so...
@@ -0,0 +1,96 @@
+"""
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+"""
+
+"""
+    Replays capture files written by "gpsdo.py --capture file" through
+    gpsdo.py's decoding, as fast as it will go: the MISO bytes through
+    the deframer (host/slip.c if built, else gpsdo.py's own, or that with
+    --python) and on to the same decoders and printing as when it ran,
+    and the MOSI bytes through a deframer of their own to show what the
+    Pi sent. -q prints only the summary, for timing it.
+
+        replay.py [-q] [--python] capture...
+"""
+
+import contextlib
+import datetime
+import os
+import sys
+import time
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import gpsdo
+
+
+class Stats():
+    def __init__(self):
+        self.records = 0
+        self.miso = 0           # Bytes each way
+        self.mosi = 0
+        self.sent = 0           # Frames the Pi sent
+        self.first = None       # Host time span, microseconds
+        self.last = None
+        self.seconds = 0        # Replaying
+
+
+def replay(path, quiet=False, native=True, out=sys.stdout):
+    # Replay one capture; returns its Stats and the spiman it went through
+    spi = gpsdo.spiman(spi=gpsdo.Idle(), native=gpsdo.native_deframer() if native else None)
+    mosi = gpsdo.spiman(spi=gpsdo.Idle())
+    st = Stats()
+    sink = open(os.devnull, 'w') if quiet else out
+    t = time.time()
+    with open(path, 'rb') as f, contextlib.redirect_stdout(sink):
+        for kind, us, data in gpsdo.read_capture(f):
+            st.records += 1
+            if kind == gpsdo.CAPTURE_MARK:
+                print(f"== {datetime.datetime.fromtimestamp(us / 1e6)}: capture started")
+                continue
+            if st.first is None:
+                st.first = us
+            st.last = us
+            if kind == gpsdo.CAPTURE_MISO:
+                st.miso += len(data)
+                spi.feed(data)
+            elif kind == gpsdo.CAPTURE_MOSI:
+                st.mosi += len(data)
+                for b in data:
+                    frame = mosi.deframe(b)
+                    if frame:
+                        st.sent += 1
+                        print(f"-> {list(frame[2:-2])}")
+    st.seconds = time.time() - t
+    if quiet:
+        sink.close()
+    return st, spi
+
+
+if __name__ == '__main__':
+    args = sys.argv[1:]
+    quiet = '-q' in args
+    native = '--python' not in args
+    for path in [a for a in args if not a.startswith('-')]:
+        st, spi = replay(path, quiet, native)
+        span = (st.last - st.first) / 1e6 if st.first is not None else 0
+        print(f"{path}: {st.records} records over {span:.1f}s, {st.miso} bytes in, {st.mosi} out, "
+              f"{spi.frames} frames received, {st.sent} sent, "
+              f"{spi.crcerr} bad, {spi.lost} lost; replayed in {st.seconds:.3f}s, "
+              f"{(st.miso + st.mosi) / max(st.seconds, 1e-9) / 1e6:.1f} MB/s"
+              + (" (slip.c)" if spi.native else " (python)"))
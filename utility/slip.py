@@ -0,0 +1,169 @@
+"""
+    GPSDO - Discipline an adjustable oscillator (typically OCXO) with GPS timing signals
+    Copyright (C) 2021  Chris Sullivan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    You may contact the author via his Github page: SullivanChrisJ
+"""
+
+"""
+    Python bindings (ctypes) for host/slip.c, the native deframer and
+    decoder, built as host/build/libslip.so by host/BUILD; on the Pi:
+
+        gcc -O2 -fPIC -shared -Ihost -iquote source -o host/build/libslip.so host/slip.c
+
+    or name another with GPSDO_SLIP. Run on its own it replays a
+    recorded MISO stream (a file of raw bytes, or one made up here)
+    through this and through gpsdo.py's own deframer and reports MB/s.
+"""
+
+import ctypes
+import os
+import struct
+import sys
+import time
+
+SLIP_MAX = 64
+
+
+class Msg(ctypes.Structure):
+    _fields_ = [('data', ctypes.POINTER(ctypes.c_uint8)),
+                ('len', ctypes.c_uint8),
+                ('seq', ctypes.c_uint8),
+                ('wire', ctypes.c_uint16)]
+
+
+class Slip(ctypes.Structure):
+    # struct slip in slip.h
+    _fields_ = [('in_', ctypes.c_void_p),
+                ('end', ctypes.c_void_p),
+                ('buf', ctypes.c_uint8 * SLIP_MAX),
+                ('len', ctypes.c_int),
+                ('esc', ctypes.c_uint8),
+                ('wire', ctypes.c_uint16),
+                ('bytes', ctypes.c_uint64),
+                ('frames', ctypes.c_uint32),
+                ('bad', ctypes.c_uint32),
+                ('copied', ctypes.c_uint32)]
+
+
+def load(path=None):
+    path = path or os.environ.get('GPSDO_SLIP') or \
+        os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'host', 'build', 'libslip.so')
+    lib = ctypes.CDLL(path)
+    lib.slip_init.argtypes = [ctypes.POINTER(Slip)]
+    lib.slip_input.argtypes = [ctypes.POINTER(Slip), ctypes.c_char_p, ctypes.c_size_t]
+    lib.slip_next.argtypes = [ctypes.POINTER(Slip), ctypes.POINTER(Msg)]
+    lib.slip_drain.argtypes = [ctypes.POINTER(Slip), ctypes.c_void_p, ctypes.c_size_t]
+    lib.slip_drain.restype = ctypes.c_size_t
+    lib.slip_decode.argtypes = [ctypes.POINTER(Msg), ctypes.POINTER(ctypes.c_int64), ctypes.c_int]
+    lib.slip_layout.argtypes = [ctypes.c_uint8]
+    lib.slip_layout.restype = ctypes.c_char_p
+    return lib
+
+
+class Deframer():
+    # Feed it MISO bytes as they come; it returns the good messages in them
+    def __init__(self, lib=None):
+        self.lib = lib or load()
+        self.s = Slip()
+        self.out = ctypes.create_string_buffer(16384)
+        self.layouts = {}
+        self.lib.slip_init(self.s)
+
+    def feed(self, data):
+        # [(seq, message, bytes on the wire)] for the frames ending in data,
+        # a buffer full of messages per call into the library
+        data = bytes(data)
+        out = []
+        self.lib.slip_input(self.s, data, len(data))
+        while True:
+            n = self.lib.slip_drain(self.s, self.out, len(self.out))
+            if not n:
+                return out
+            buf = self.out.raw[:n]
+            i = 0
+            while i < n:
+                seq, length, wire = buf[i], buf[i + 1], buf[i + 2] | buf[i + 3] << 8
+                out.append((seq, buf[i + 4:i + 4 + length], wire))
+                i += 4 + length
+
+    def decode(self, msg):
+        # The fields of a fixed layout message, or None, using slip.c's
+        # table of layouts (struct's format letters)
+        if not msg:
+            return None
+        s = self.layouts.get(msg[0], False)
+        if s is False:
+            layout = self.lib.slip_layout(msg[0])
+            s = self.layouts[msg[0]] = struct.Struct('<' + layout.decode()) if layout else None
+        if s is None or s.size != len(msg) - 1:
+            return None
+        return s.unpack_from(msg, 1)
+
+    def partial(self):
+        # The first byte and length of a frame begun but not ended
+        if self.s.len > 0:
+            return self.s.buf[0], self.s.len
+        return None, 0
+
+    @property
+    def bad(self):
+        return self.s.bad
+
+    @property
+    def frames(self):
+        return self.s.frames
+
+
+if __name__ == '__main__':
+    sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+    import gpsdo
+    import random
+
+    if len(sys.argv) > 1:
+        with open(sys.argv[1], 'rb') as f:
+            stream = f.read()
+    else:
+        # Telemetry and PPS messages as the MCU frames them, random data
+        random.seed(1)
+        mcu = gpsdo.spiman(spi=gpsdo.Idle())
+        parts = []
+        for i in range(20000):
+            msg = bytes([8] + [random.randrange(256) for k in range(20)]) if i % 2 else \
+                  bytes([1] + [random.randrange(256) for k in range(10)])
+            parts.append(mcu.encode(msg) + bytes(i % 7))
+        stream = b''.join(parts)
+
+    print(f"{len(stream)} bytes")
+    for piece in (len(stream), 4096, 32):
+        d = Deframer()
+        t = time.time()
+        n = 0
+        for i in range(0, len(stream), piece):
+            for seq, msg, wire in d.feed(stream[i:i + piece]):
+                d.decode(msg)
+                n += 1
+        t = time.time() - t
+        print(f"native, {piece:7d} byte reads: {len(stream) / t / 1e6:7.2f} MB/s, {n / t:9.0f} messages/s, {d.bad} bad")
+
+    py = gpsdo.spiman(spi=gpsdo.Idle())
+    t = time.time()
+    n = 0
+    for b in stream:
+        if py.deframe(b):
+            n += 1
+    t = time.time() - t
+    print(f"python, byte at a time: {len(stream) / t / 1e6:7.2f} MB/s, {n / t:9.0f} messages/s, {py.crcerr} bad")